@@ -3,16 +3,28 @@
 
 MBALIGN  equ 1 << 0            ; Align loaded modules on page boundaries
 MEMINFO  equ 1 << 1            ; Provide memory map
-FLAGS    equ MBALIGN | MEMINFO ; Multiboot flag field
+VIDEO    equ 1 << 2            ; Ask for the video mode below
+FLAGS    equ MBALIGN | MEMINFO | VIDEO ; Multiboot flag field
 MAGIC    equ 0x1BADB002        ; Magic number for multiboot
 CHECKSUM equ -(MAGIC + FLAGS)  ; Checksum
 
+; Preferred console mode; the kernel falls back to VGA text if the
+; loader does not provide a linear framebuffer
+VIDEO_WIDTH  equ 1024
+VIDEO_HEIGHT equ 768
+VIDEO_DEPTH  equ 32
+
 ; Multiboot header
 section .multiboot
 align 4
     dd MAGIC
     dd FLAGS
     dd CHECKSUM
+    dd 0, 0, 0, 0, 0           ; Load address fields (unused without flag 16)
+    dd 0                       ; Mode type: linear framebuffer
+    dd VIDEO_WIDTH
+    dd VIDEO_HEIGHT
+    dd VIDEO_DEPTH
 
 ; Stack
 section .bss
@@ -58,6 +70,24 @@ idt_load:
     lidt [eax]
     ret
 
+; Stack switch between cooperative contexts
+; void context_switch(uint32_t *save_esp, uint32_t next_esp)
+global context_switch
+context_switch:
+    mov eax, [esp + 4]         ; Where to save the current stack pointer
+    mov edx, [esp + 8]         ; Stack to resume
+    push ebp                   ; Callee-saved registers stay on the old stack
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret                        ; Return into the resumed context
+
 ; ISR stubs - CPU exceptions
 %macro ISR_NOERRCODE 1
 global isr%1
@@ -138,6 +168,19 @@ IRQ 13, 45
 IRQ 14, 46
 IRQ 15, 47
 
+; Cross-CPU call IPI (vector 0xF0), handled like an IRQ
+global irq_ipi
+irq_ipi:
+    cli
+    push dword 0
+    push dword 0xF0
+    jmp irq_common_stub
+
+; Local APIC spurious vector: nothing was delivered, so no EOI
+global irq_spurious
+irq_spurious:
+    iret
+
 ; Common ISR stub
 extern isr_handler
 isr_common_stub:
@@ -146,10 +189,9 @@ isr_common_stub:
     push eax                   ; Save data segment
 
     mov ax, 0x10               ; Load kernel data segment
-    mov ds, ax
+    mov ds, ax                 ; (GS keeps pointing at the per-CPU area)
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     push esp                   ; Push pointer to registers struct
     call isr_handler
@@ -159,7 +201,6 @@ isr_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     popa
     add esp, 8                 ; Clean up error code and ISR number
@@ -176,7 +217,6 @@ irq_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     push esp
     call irq_handler
@@ -186,8 +226,63 @@ irq_common_stub:
     mov ds, bx
     mov es, bx
     mov fs, bx
-    mov gs, bx
 
     popa
     add esp, 8
     iret
+
+; Application processor startup. smp_init copies this block to
+; SMP_TRAMPOLINE_BASE (below 1 MiB) and points the startup IPI there;
+; it runs in real mode until the far jump, so every address in it is
+; rebased to where the copy lives.
+TRAMPOLINE_BASE equ 0x8000
+%define TRAMPOLINE(label) (TRAMPOLINE_BASE + (label - ap_trampoline_start))
+
+extern smp_ap_entry
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_boot_stack
+global ap_boot_index
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TRAMPOLINE(ap_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                  ; Protected mode, paging stays off
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(ap_protected)
+
+bits 32
+ap_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, [TRAMPOLINE(ap_boot_stack)]
+    push dword [TRAMPOLINE(ap_boot_index)]
+    mov eax, smp_ap_entry      ; Absolute: the kernel is not rebased
+    call eax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+ap_gdt:                        ; Flat code and data, replaced by gdt_init_cpu
+    dq 0
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+ap_gdt_ptr:
+    dw 23
+    dd TRAMPOLINE(ap_gdt)
+ap_boot_stack:                 ; Filled in by smp_init for each CPU
+    dd 0
+ap_boot_index:
+    dd 0
+ap_trampoline_end:
@@ -0,0 +1,128 @@
+/*
+ * MelonOS - ACPI Tables
+ * RSDP search and RSDT/XSDT walk; paging is off, so physical
+ * addresses are used as pointers directly
+ */
+
+#include "acpi.h"
+#include "string.h"
+
+#define BDA_EBDA_SEGMENT 0x40E
+#define BIOS_ROM_START   0xE0000
+#define BIOS_ROM_LENGTH  0x20000
+#define EBDA_SCAN_LENGTH 1024
+
+typedef struct {
+    char signature[8];            /* "RSD PTR " */
+    uint8_t checksum;             /* Over the first 20 bytes */
+    char oem_id[6];
+    uint8_t revision;             /* 2 and up adds the XSDT fields */
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint32_t xsdt_low;
+    uint32_t xsdt_high;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+/* Firmware tables sit at fixed low addresses; hide the constant from
+   the compiler so it does not treat them as null-page accesses */
+static const void *physical(uint32_t address) {
+    __asm__ ("" : "+r"(address));
+    return (const void *)address;
+}
+
+uint8_t acpi_checksum(const void *data, uint32_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        sum = (uint8_t)(sum + bytes[i]);
+    }
+    return sum;
+}
+
+uint32_t bios_ebda_address(void) {
+    uint32_t segment = *(const volatile uint16_t *)physical(BDA_EBDA_SEGMENT);
+    uint32_t address = segment << 4;
+
+    /* The EBDA lives just under 640 KiB */
+    return (address >= 0x80000 && address < 0xA0000) ? address : 0;
+}
+
+const void *bios_scan(uint32_t start, uint32_t length, const char *signature, uint32_t sig_len) {
+    for (uint32_t at = start; at + sig_len <= start + length; at += 16) {
+        if (memcmp(physical(at), signature, sig_len) == 0) {
+            return physical(at);
+        }
+    }
+    return 0;
+}
+
+static const acpi_rsdp_t *find_rsdp(void) {
+    uint32_t ebda = bios_ebda_address();
+    const acpi_rsdp_t *rsdp = 0;
+
+    if (ebda != 0) {
+        rsdp = (const acpi_rsdp_t *)bios_scan(ebda, EBDA_SCAN_LENGTH, "RSD PTR ", 8);
+    }
+    if (rsdp == 0 || acpi_checksum(rsdp, 20) != 0) {
+        rsdp = (const acpi_rsdp_t *)bios_scan(BIOS_ROM_START, BIOS_ROM_LENGTH, "RSD PTR ", 8);
+    }
+    if (rsdp == 0 || acpi_checksum(rsdp, 20) != 0) {
+        return 0;
+    }
+    return rsdp;
+}
+
+static const acpi_sdt_header_t *checked_table(uint32_t address) {
+    const acpi_sdt_header_t *table;
+
+    if (address == 0) {
+        return 0;
+    }
+    table = (const acpi_sdt_header_t *)physical(address);
+    if (table->length < sizeof(acpi_sdt_header_t) || acpi_checksum(table, table->length) != 0) {
+        return 0;
+    }
+    return table;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    const acpi_rsdp_t *rsdp = find_rsdp();
+    const acpi_sdt_header_t *root;
+    uint32_t entry_size = 4;
+    uint32_t count;
+
+    if (rsdp == 0) {
+        return 0;
+    }
+
+    /* Prefer the RSDT; the XSDT only helps if it sits below 4 GiB */
+    root = checked_table(rsdp->rsdt_address);
+    if (root == 0 && rsdp->revision >= 2 && rsdp->xsdt_high == 0) {
+        root = checked_table(rsdp->xsdt_low);
+        entry_size = 8;
+    }
+    if (root == 0) {
+        return 0;
+    }
+
+    count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *entry = (const uint8_t *)(root + 1) + i * entry_size;
+        uint32_t address;
+        const acpi_sdt_header_t *table;
+
+        memcpy(&address, entry, 4);
+        if (entry_size == 8 && (entry[4] | entry[5] | entry[6] | entry[7]) != 0) {
+            continue;
+        }
+
+        table = checked_table(address);
+        if (table != 0 && memcmp(table->signature, signature, 4) == 0) {
+            return table;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,486 @@
+/*
+ * MelonOS - Local APIC and IOAPIC
+ * MADT / MP table parsing, IOAPIC redirection and the LAPIC timer
+ */
+
+#include "apic.h"
+#include "acpi.h"
+#include "clock.h"
+#include "cpu.h"
+#include "idt.h"
+#include "math64.h"
+#include "string.h"
+
+#define IA32_APIC_BASE_MSR    0x1B
+#define IA32_APIC_BASE_ENABLE (1u << 11)
+
+/* Local APIC registers (byte offsets from the base) */
+#define LAPIC_ID          0x020
+#define LAPIC_TPR         0x080
+#define LAPIC_EOI         0x0B0
+#define LAPIC_SVR         0x0F0
+#define LAPIC_ICR_LOW     0x300
+#define LAPIC_ICR_HIGH    0x310
+#define LAPIC_LVT_TIMER   0x320
+#define LAPIC_TIMER_INIT  0x380
+#define LAPIC_TIMER_COUNT 0x390
+#define LAPIC_TIMER_DIV   0x3E0
+
+#define LAPIC_SVR_ENABLE  0x100
+#define LAPIC_LVT_MASKED  0x10000
+#define LAPIC_DIVIDE_16   0x3
+#define LAPIC_ICR_PENDING (1u << 12)
+
+/* IOAPIC: an index register and a data window */
+#define IOAPIC_REGSEL     0x00
+#define IOAPIC_WINDOW     0x10
+#define IOAPIC_VERSION    0x01
+#define IOAPIC_REDIR      0x10
+
+#define REDIR_ACTIVE_LOW  (1u << 13)
+#define REDIR_LEVEL       (1u << 15)
+#define REDIR_MASKED      (1u << 16)
+
+/* MPS INTI flags, shared by MADT overrides and MP interrupt entries */
+#define INTI_POLARITY_MASK 0x3
+#define INTI_ACTIVE_LOW    0x3
+#define INTI_TRIGGER_MASK  0xC
+#define INTI_LEVEL         0xC
+
+#define ISA_IRQS     16
+#define IRQ_VECTOR   32
+#define NO_GSI       0xFFFFFFFFu
+
+/* LAPIC timer calibration window, and the shortest shot worth taking */
+#define CALIBRATE_NS     10000000u
+#define TIMER_MIN_NS     5000u
+#define TIMER_MAX_NS     10000000000ull
+
+typedef struct {
+    volatile uint32_t *base;
+    uint32_t gsi_base;
+    uint32_t pins;
+} ioapic_t;
+
+static int active = 0;
+static const char *source = "none";
+static volatile uint32_t *lapic = 0;
+static uint8_t cpu_ids[APIC_MAX_CPUS];
+static int cpu_count = 0;
+static ioapic_t ioapics[APIC_MAX_IOAPICS];
+static int ioapic_count = 0;
+static uint32_t timer_khz = 0;
+
+/* Where each ISA IRQ arrives, and how it is signalled */
+static uint32_t isa_gsi[ISA_IRQS];
+static uint16_t isa_flags[ISA_IRQS];
+static uint8_t isa_overridden[ISA_IRQS];
+
+static uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+    (void)lapic[LAPIC_ID / 4];  /* Read back so the write has landed */
+}
+
+static uint32_t ioapic_read(const ioapic_t *io, uint32_t reg) {
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    return io->base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(const ioapic_t *io, uint32_t reg, uint32_t value) {
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    io->base[IOAPIC_WINDOW / 4] = value;
+}
+
+static void add_cpu(uint8_t id, int bootstrap) {
+    if (cpu_count == APIC_MAX_CPUS) {
+        return;
+    }
+    if (bootstrap && cpu_count > 0) {
+        /* Keep the bootstrap processor first */
+        cpu_ids[cpu_count++] = cpu_ids[0];
+        cpu_ids[0] = id;
+        return;
+    }
+    cpu_ids[cpu_count++] = id;
+}
+
+static void add_ioapic(uint32_t address, uint32_t gsi_base) {
+    if (ioapic_count == APIC_MAX_IOAPICS || address == 0) {
+        return;
+    }
+    ioapics[ioapic_count].base = (volatile uint32_t *)address;
+    ioapics[ioapic_count].gsi_base = gsi_base;
+    ioapics[ioapic_count].pins = 0;
+    ioapic_count++;
+}
+
+static void add_override(uint8_t irq, uint32_t gsi, uint16_t flags) {
+    if (irq < ISA_IRQS) {
+        isa_gsi[irq] = gsi;
+        isa_flags[irq] = flags;
+        isa_overridden[irq] = 1;
+    }
+}
+
+/* ACPI Multiple APIC Description Table */
+static int parse_madt(void) {
+    const acpi_sdt_header_t *madt = acpi_find_table("APIC");
+    const uint8_t *entry;
+    const uint8_t *end;
+    uint32_t lapic_address;
+
+    if (madt == 0 || madt->length < sizeof(*madt) + 8) {
+        return -1;
+    }
+
+    memcpy(&lapic_address, madt + 1, 4);
+    lapic = (volatile uint32_t *)lapic_address;
+
+    entry = (const uint8_t *)(madt + 1) + 8;
+    end = (const uint8_t *)madt + madt->length;
+    while (entry + 2 <= end && entry[1] >= 2 && entry + entry[1] <= end) {
+        uint32_t value;
+        uint32_t gsi_base;
+        uint16_t flags;
+
+        switch (entry[0]) {
+        case 0:  /* Processor local APIC: ACPI ID, APIC ID, flags */
+            memcpy(&value, entry + 4, 4);
+            if (value & 1) {
+                add_cpu(entry[3], 0);
+            }
+            break;
+        case 1:  /* IOAPIC: ID, reserved, address, GSI base */
+            memcpy(&value, entry + 4, 4);
+            memcpy(&gsi_base, entry + 8, 4);
+            add_ioapic(value, gsi_base);
+            break;
+        case 2:  /* Interrupt source override: bus, source, GSI, flags */
+            memcpy(&value, entry + 4, 4);
+            memcpy(&flags, entry + 8, 2);
+            if (entry[2] == 0) {
+                add_override(entry[3], value, flags);
+            }
+            break;
+        default:
+            break;
+        }
+        entry += entry[1];
+    }
+
+    source = "ACPI MADT";
+    return 0;
+}
+
+/* Intel MultiProcessor Specification tables, for firmware without ACPI */
+static int parse_mp_table(void) {
+    const uint8_t *floating = 0;
+    const uint8_t *table;
+    const uint8_t *entry;
+    uint32_t ebda = bios_ebda_address();
+    uint32_t address;
+    uint16_t length;
+    uint16_t count;
+    uint8_t isa_bus = 0xFF;
+
+    if (ebda != 0) {
+        floating = (const uint8_t *)bios_scan(ebda, 1024, "_MP_", 4);
+    }
+    if (floating == 0) {
+        floating = (const uint8_t *)bios_scan(0x9FC00, 1024, "_MP_", 4);
+    }
+    if (floating == 0) {
+        floating = (const uint8_t *)bios_scan(0xF0000, 0x10000, "_MP_", 4);
+    }
+    if (floating == 0 || acpi_checksum(floating, 16) != 0) {
+        return -1;
+    }
+
+    /* A default configuration (no table) is too old to bother with */
+    memcpy(&address, floating + 4, 4);
+    if (address == 0) {
+        return -1;
+    }
+    table = (const uint8_t *)address;
+    memcpy(&length, table + 4, 2);
+    if (memcmp(table, "PCMP", 4) != 0 || acpi_checksum(table, length) != 0) {
+        return -1;
+    }
+
+    memcpy(&address, table + 36, 4);
+    lapic = (volatile uint32_t *)address;
+    memcpy(&count, table + 34, 2);
+
+    entry = table + 44;
+    for (uint16_t i = 0; i < count && entry < table + length; i++) {
+        uint16_t flags;
+
+        switch (entry[0]) {
+        case 0:  /* Processor: APIC ID, version, flags (enabled, BSP) */
+            if (entry[3] & 1) {
+                add_cpu(entry[1], (entry[3] & 2) != 0);
+            }
+            entry += 20;
+            break;
+        case 1:  /* Bus: ID and a 6-character type */
+            if (memcmp(entry + 2, "ISA", 3) == 0) {
+                isa_bus = entry[1];
+            }
+            entry += 8;
+            break;
+        case 2:  /* IOAPIC: ID, version, flags, address */
+            memcpy(&address, entry + 4, 4);
+            if (entry[3] & 1) {
+                add_ioapic(address, ioapic_count == 0 ? 0 : ioapics[ioapic_count - 1].gsi_base + 24);
+            }
+            entry += 8;
+            break;
+        case 3:  /* I/O interrupt: type, flags, bus, bus IRQ, IOAPIC, pin */
+            memcpy(&flags, entry + 2, 2);
+            if (entry[1] == 0 && entry[4] == isa_bus) {
+                add_override(entry[5], entry[7], flags);
+            }
+            entry += 8;
+            break;
+        default:
+            entry += 8;
+            break;
+        }
+    }
+
+    source = "MP table";
+    return 0;
+}
+
+static ioapic_t *ioapic_for(uint32_t gsi, uint32_t *pin) {
+    for (int i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].pins) {
+            *pin = gsi - ioapics[i].gsi_base;
+            return &ioapics[i];
+        }
+    }
+    return 0;
+}
+
+static uint32_t redirection(int irq) {
+    uint32_t low = (uint32_t)(IRQ_VECTOR + irq) | REDIR_MASKED;
+
+    /* Fixed delivery in physical mode; ISA defaults to edge, active high */
+    if ((isa_flags[irq] & INTI_POLARITY_MASK) == INTI_ACTIVE_LOW) {
+        low |= REDIR_ACTIVE_LOW;
+    }
+    if ((isa_flags[irq] & INTI_TRIGGER_MASK) == INTI_LEVEL) {
+        low |= REDIR_LEVEL;
+    }
+    return low;
+}
+
+static void route_isa_irqs(uint16_t open_lines) {
+    for (int irq = 0; irq < ISA_IRQS; irq++) {
+        ioapic_t *io;
+        uint32_t pin;
+
+        /* An override moving another IRQ onto this pin takes it over
+           (IRQ0 usually lands on pin 2, where the cascade would be) */
+        for (int other = 0; other < ISA_IRQS; other++) {
+            if (other != irq && isa_overridden[other] && isa_gsi[other] == isa_gsi[irq] &&
+                !isa_overridden[irq]) {
+                isa_gsi[irq] = NO_GSI;
+            }
+        }
+        if (irq == 2 || isa_gsi[irq] == NO_GSI) {
+            continue;
+        }
+
+        io = ioapic_for(isa_gsi[irq], &pin);
+        if (io == 0) {
+            isa_gsi[irq] = NO_GSI;
+            continue;
+        }
+
+        ioapic_write(io, IOAPIC_REDIR + pin * 2 + 1, (uint32_t)cpu_ids[0] << 24);
+        ioapic_write(io, IOAPIC_REDIR + pin * 2, redirection(irq));
+        if (open_lines & (1u << irq)) {
+            ioapic_set_masked(irq, 0);
+        }
+    }
+}
+
+static void lapic_enable(void) {
+    uint64_t base_msr = cpu_rdmsr(IA32_APIC_BASE_MSR);
+
+    cpu_wrmsr(IA32_APIC_BASE_MSR, base_msr | IA32_APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+/* Count LAPIC timer ticks across a TSC-timed window */
+static void calibrate_timer(void) {
+    uint64_t start;
+    uint64_t elapsed;
+    uint32_t counted;
+
+    timer_khz = 0;
+    if (!clock_has_tsc()) {
+        return;
+    }
+
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | IRQ_VECTOR);
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIVIDE_16);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFFu);
+    start = clock_ns();
+    clock_delay_ns(CALIBRATE_NS);
+    counted = 0xFFFFFFFFu - lapic_read(LAPIC_TIMER_COUNT);
+    elapsed = clock_ns() - start;
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    if (counted != 0 && elapsed != 0 && (elapsed >> 32) == 0) {
+        timer_khz = (uint32_t)div64_u32((uint64_t)counted * 1000000u, (uint32_t)elapsed, 0);
+    }
+}
+
+int apic_init(void) {
+    cpuid_regs_t regs;
+
+    active = 0;
+    cpu_count = 0;
+    ioapic_count = 0;
+    for (int irq = 0; irq < ISA_IRQS; irq++) {
+        isa_gsi[irq] = (uint32_t)irq;
+        isa_flags[irq] = 0;
+        isa_overridden[irq] = 0;
+    }
+
+    if (!cpu_has_cpuid()) {
+        return -1;
+    }
+    cpu_cpuid(1, 0, &regs);
+    if (!(regs.edx & CPUID_1_EDX_APIC) || !(regs.edx & CPUID_1_EDX_MSR)) {
+        return -1;
+    }
+    if (parse_madt() != 0 && parse_mp_table() != 0) {
+        return -1;
+    }
+    if (lapic == 0 || ioapic_count == 0) {
+        return -1;
+    }
+
+    /* The firmware may have moved the LAPIC; the MSR is authoritative */
+    lapic = (volatile uint32_t *)((uint32_t)cpu_rdmsr(IA32_APIC_BASE_MSR) & 0xFFFFF000u);
+    lapic_enable();
+    if (cpu_count == 0) {
+        add_cpu(lapic_id(), 1);
+    }
+
+    for (int i = 0; i < ioapic_count; i++) {
+        ioapics[i].pins = ((ioapic_read(&ioapics[i], IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+        for (uint32_t pin = 0; pin < ioapics[i].pins; pin++) {
+            ioapic_write(&ioapics[i], IOAPIC_REDIR + pin * 2, REDIR_MASKED);
+        }
+    }
+
+    /* ACPI lists the bootstrap processor first; make sure it is this one */
+    for (int i = 1; i < cpu_count; i++) {
+        if (cpu_ids[i] == lapic_id()) {
+            cpu_ids[i] = cpu_ids[0];
+            cpu_ids[0] = lapic_id();
+        }
+    }
+
+    route_isa_irqs(pic_disable());
+    active = 1;
+
+    calibrate_timer();
+    return 0;
+}
+
+int apic_is_active(void) {
+    return active;
+}
+
+const char *apic_source(void) {
+    return source;
+}
+
+int apic_cpu_count(void) {
+    return active ? cpu_count : 1;
+}
+
+uint8_t apic_cpu_id(int index) {
+    return (index >= 0 && index < cpu_count) ? cpu_ids[index] : 0;
+}
+
+uint8_t lapic_id(void) {
+    return lapic == 0 ? 0 : (uint8_t)(lapic_read(LAPIC_ID) >> 24);
+}
+
+void lapic_eoi(void) {
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t command) {
+    uint32_t flags = cpu_irq_save();
+
+    /* The high half only takes effect with the write to the low half */
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        cpu_pause();
+    }
+
+    cpu_irq_restore(flags);
+}
+
+void apic_init_ap(void) {
+    lapic_enable();
+}
+
+void ioapic_set_masked(int irq, int masked) {
+    ioapic_t *io;
+    uint32_t pin;
+    uint32_t low;
+
+    if (irq < 0 || irq >= ISA_IRQS || isa_gsi[irq] == NO_GSI) {
+        return;
+    }
+    io = ioapic_for(isa_gsi[irq], &pin);
+    if (io == 0) {
+        return;
+    }
+
+    low = ioapic_read(io, IOAPIC_REDIR + pin * 2);
+    low = masked ? (low | REDIR_MASKED) : (low & ~REDIR_MASKED);
+    ioapic_write(io, IOAPIC_REDIR + pin * 2, low);
+}
+
+uint32_t apic_timer_khz(void) {
+    return timer_khz;
+}
+
+void apic_timer_enable(uint8_t vector) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, vector);  /* One-shot, unmasked */
+}
+
+uint64_t apic_timer_oneshot(uint64_t ns) {
+    uint64_t count;
+
+    if (ns < TIMER_MIN_NS) {
+        ns = TIMER_MIN_NS;
+    } else if (ns > TIMER_MAX_NS) {
+        ns = TIMER_MAX_NS;
+    }
+
+    /* Round up so the shot never lands before ns */
+    count = div64_u32(ns * timer_khz, 1000000u, 0) + 1;
+    if (count > 0xFFFFFFFFu) {
+        count = 0xFFFFFFFFu;
+    }
+
+    lapic[LAPIC_TIMER_INIT / 4] = (uint32_t)count;
+    return div64_u32(count * 1000000u, timer_khz, 0);
+}
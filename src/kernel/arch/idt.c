@@ -4,13 +4,16 @@
  */
 
 #include "idt.h"
+#include "apic.h"
+#include "sched.h"
+#include "smp.h"
 #include "io.h"
 #include "vga.h"
 #include "string.h"
 
-/* GDT */
-static gdt_entry_t gdt_entries[5];
-static gdt_ptr_t gdt_ptr;
+/* GDT, one per CPU so each can point GS at its own per-CPU area */
+static gdt_entry_t gdt_entries[SMP_MAX_CPUS][GDT_ENTRIES];
+static gdt_ptr_t gdt_ptrs[SMP_MAX_CPUS];
 
 /* IDT */
 static idt_entry_t idt_entries[256];
@@ -18,6 +21,7 @@ static idt_ptr_t idt_ptr;
 
 /* IRQ handlers */
 static irq_handler_t irq_handlers[16] = { 0 };
+static irq_handler_t ipi_handler = 0;
 
 /* Exception messages */
 static const char *exception_messages[] = {
@@ -46,26 +50,37 @@ static const char *exception_messages[] = {
 };
 
 /* Set a GDT gate */
-static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
-    gdt_entries[num].base_low    = (base & 0xFFFF);
-    gdt_entries[num].base_middle = (base >> 16) & 0xFF;
-    gdt_entries[num].base_high   = (base >> 24) & 0xFF;
-    gdt_entries[num].limit_low   = (limit & 0xFFFF);
-    gdt_entries[num].granularity = ((limit >> 16) & 0x0F) | (gran & 0xF0);
-    gdt_entries[num].access      = access;
+static void gdt_set_gate(gdt_entry_t *gdt, int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    gdt[num].base_low    = (base & 0xFFFF);
+    gdt[num].base_middle = (base >> 16) & 0xFF;
+    gdt[num].base_high   = (base >> 24) & 0xFF;
+    gdt[num].limit_low   = (limit & 0xFFFF);
+    gdt[num].granularity = ((limit >> 16) & 0x0F) | (gran & 0xF0);
+    gdt[num].access      = access;
 }
 
-void gdt_init(void) {
-    gdt_ptr.limit = (sizeof(gdt_entry_t) * 5) - 1;
-    gdt_ptr.base  = (uint32_t)&gdt_entries;
+void gdt_init_cpu(int cpu, void *percpu, uint32_t percpu_size) {
+    gdt_entry_t *gdt = gdt_entries[cpu];
+    uint16_t selector = GDT_PERCPU_SELECTOR;
+
+    gdt_ptrs[cpu].limit = (sizeof(gdt_entry_t) * GDT_ENTRIES) - 1;
+    gdt_ptrs[cpu].base  = (uint32_t)gdt;
+
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);                /* Null segment */
+    gdt_set_gate(gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Kernel Code segment */
+    gdt_set_gate(gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Kernel Data segment */
+    gdt_set_gate(gdt, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF); /* User Code segment */
+    gdt_set_gate(gdt, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF); /* User Data segment */
+    gdt_set_gate(gdt, 5, (uint32_t)percpu, percpu_size - 1, 0x92, 0x40); /* Per-CPU data */
+
+    gdt_flush((uint32_t)&gdt_ptrs[cpu]);
 
-    gdt_set_gate(0, 0, 0, 0, 0);                /* Null segment */
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); /* Kernel Code segment */
-    gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF); /* Kernel Data segment */
-    gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF); /* User Code segment */
-    gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF); /* User Data segment */
+    /* The interrupt stubs leave GS alone, so it keeps this for good */
+    __asm__ volatile ("mov %0, %%gs" : : "r"(selector));
+}
 
-    gdt_flush((uint32_t)&gdt_ptr);
+void gdt_init(void) {
+    gdt_init_cpu(0, percpu_of(0), sizeof(percpu_t));
 }
 
 /* Set an IDT gate */
@@ -165,6 +180,15 @@ void idt_init(void) {
     idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
     idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
 
+    /* Local APIC vectors: cross-CPU calls, and spurious interrupts
+       (no EOI wanted) */
+    idt_set_gate(APIC_IPI_VECTOR, (uint32_t)irq_ipi, 0x08, 0x8E);
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)irq_spurious, 0x08, 0x8E);
+
+    idt_install();
+}
+
+void idt_install(void) {
     idt_load((uint32_t)&idt_ptr);
 }
 
@@ -182,16 +206,30 @@ void isr_handler(registers_t *regs) {
 /* IRQ handler - called from assembly */
 void irq_handler(registers_t *regs) {
     /* Send EOI (End of Interrupt) */
-    if (regs->int_no >= 40) {
-        outb(0xA0, 0x20);  /* Slave PIC EOI */
+    if (apic_is_active()) {
+        lapic_eoi();
+    } else {
+        if (regs->int_no >= 40) {
+            outb(0xA0, 0x20);  /* Slave PIC EOI */
+        }
+        outb(0x20, 0x20);      /* Master PIC EOI */
+    }
+
+    if (regs->int_no == APIC_IPI_VECTOR) {
+        if (ipi_handler) {
+            ipi_handler(regs);
+        }
+        sched_irq_exit();
+        return;
     }
-    outb(0x20, 0x20);      /* Master PIC EOI */
 
     /* Call registered handler */
     int irq_num = regs->int_no - 32;
     if (irq_num >= 0 && irq_num < 16 && irq_handlers[irq_num]) {
         irq_handlers[irq_num](regs);
     }
+
+    sched_irq_exit();
 }
 
 void irq_install_handler(int irq, irq_handler_t handler) {
@@ -200,8 +238,51 @@ void irq_install_handler(int irq, irq_handler_t handler) {
     }
 }
 
+void ipi_install_handler(irq_handler_t handler) {
+    ipi_handler = handler;
+}
+
 void irq_uninstall_handler(int irq) {
     if (irq >= 0 && irq < 16) {
         irq_handlers[irq] = 0;
     }
 }
+
+void irq_unmask(int irq) {
+    uint16_t port = (irq < 8) ? 0x21 : 0xA1;
+
+    if (irq < 0 || irq >= 16) {
+        return;
+    }
+    if (apic_is_active()) {
+        ioapic_set_masked(irq, 0);
+        return;
+    }
+
+    outb(port, inb(port) & ~(1u << (irq & 7)));
+    if (irq >= 8) {
+        outb(0x21, inb(0x21) & ~(1u << 2));  /* Cascade line */
+    }
+}
+
+void irq_mask(int irq) {
+    uint16_t port = (irq < 8) ? 0x21 : 0xA1;
+
+    if (irq < 0 || irq >= 16) {
+        return;
+    }
+    if (apic_is_active()) {
+        ioapic_set_masked(irq, 1);
+        return;
+    }
+
+    outb(port, inb(port) | (1u << (irq & 7)));
+}
+
+uint16_t pic_disable(void) {
+    uint16_t open = (uint16_t)~(inb(0x21) | (inb(0xA1) << 8));
+
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+    return open;
+}
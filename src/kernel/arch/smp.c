@@ -0,0 +1,283 @@
+/*
+ * MelonOS - Multiprocessor Support
+ * INIT-SIPI-SIPI startup through the real-mode trampoline in boot.asm,
+ * and a one-slot call mailbox per CPU driven by IPIs
+ */
+
+#include "smp.h"
+#include "apic.h"
+#include "clock.h"
+#include "cpu.h"
+#include "idt.h"
+#include "sched.h"
+#include "string.h"
+#include "timer.h"
+
+/* Startup timing from the MP specification: 10 ms after INIT, 200 us
+   between the two startup IPIs */
+#define INIT_DELAY_NS    10000000u
+#define SIPI_DELAY_NS    200000u
+#define ONLINE_TIMEOUT_NS 100000000u
+
+/* Extra time for an AP that reached C just as the timeout expired to
+   finish its own setup */
+#define SETUP_TIMEOUT_NS  1000000000u
+
+/* The trampoline image and the two words it reads once in protected mode */
+extern uint8_t ap_trampoline_start[];
+extern uint8_t ap_trampoline_end[];
+extern uint32_t ap_boot_stack;
+extern uint32_t ap_boot_index;
+
+#define TRAMPOLINE_WORD(symbol) \
+    ((volatile uint32_t *)(SMP_TRAMPOLINE_BASE + ((uint32_t)&(symbol) - (uint32_t)ap_trampoline_start)))
+
+DEFINE_LOCK_STATS(mailbox_stats, "smp mailboxes");
+
+static percpu_t cpus[SMP_MAX_CPUS] = { [0] = { .self = &cpus[0], .online = 1 } };
+static uint8_t ap_stacks[SMP_MAX_CPUS - 1][SMP_STACK_SIZE] __attribute__((aligned(16)));
+static volatile int online_count = 1;
+
+/*
+ * Who owns an AP that is being started. The AP claims itself on its
+ * first C instruction, by which point it has read the trampoline words,
+ * and marks itself online once set up; a boot processor that gives up
+ * before either step marks it abandoned, and the AP then halts instead
+ * of coming online late.
+ */
+#define AP_WAITING   0
+#define AP_CLAIMED   1
+#define AP_ONLINE    2
+#define AP_ABANDONED 3
+
+static volatile int ap_boot_state[SMP_MAX_CPUS];
+
+void smp_ap_entry(int index);
+
+percpu_t *percpu_of(int index) {
+    return (index >= 0 && index < SMP_MAX_CPUS) ? &cpus[index] : 0;
+}
+
+/* Run whatever was posted to this CPU (interrupts off) */
+static void serve_calls(percpu_t *cpu) {
+    uint32_t requested;
+
+    while ((requested = __atomic_load_n(&cpu->call_requested, __ATOMIC_ACQUIRE)) != cpu->call_started) {
+        smp_call_fn_t fn = cpu->call_fn;
+        void *arg = cpu->call_arg;
+
+        /* Once started is published the sender may post the next call */
+        __atomic_store_n(&cpu->call_started, requested, __ATOMIC_RELEASE);
+        fn(arg);
+        cpu->calls_handled++;
+        __atomic_store_n(&cpu->call_completed, requested, __ATOMIC_RELEASE);
+    }
+}
+
+static void ipi_handler(registers_t *regs) {
+    (void)regs;
+    serve_calls(this_cpu());
+}
+
+/* Spin until *word reaches target, answering calls meanwhile */
+static void wait_for(volatile uint32_t *word, uint32_t target) {
+    percpu_t *self = this_cpu();
+
+    while ((int32_t)(__atomic_load_n(word, __ATOMIC_ACQUIRE) - target) < 0) {
+        uint32_t flags = cpu_irq_save();
+        serve_calls(self);
+        cpu_irq_restore(flags);
+        cpu_pause();
+    }
+}
+
+/* Take a mailbox with interrupts off, so the sender is not switched out
+   while others queue behind it. A sender spinning here may be the one
+   another CPU's call waits on, so it keeps answering calls meanwhile. */
+static uint32_t mailbox_lock(percpu_t *target) {
+    percpu_t *self = this_cpu();
+    uint32_t flags = cpu_irq_save();
+
+    while (!spin_trylock(&target->call_lock)) {
+        serve_calls(self);
+        cpu_pause();
+    }
+    return flags;
+}
+
+int smp_call(int index, smp_call_fn_t fn, void *arg, int wait) {
+    percpu_t *target = percpu_of(index);
+    uint32_t ticket;
+    uint32_t flags;
+
+    if (target == 0 || !target->online || fn == 0) {
+        return -1;
+    }
+    if (target == this_cpu()) {
+        uint32_t flags = cpu_irq_save();
+        fn(arg);
+        cpu_irq_restore(flags);
+        return 0;
+    }
+
+    flags = mailbox_lock(target);
+    target->call_fn = fn;
+    target->call_arg = arg;
+    ticket = target->call_requested + 1;
+    __atomic_store_n(&target->call_requested, ticket, __ATOMIC_RELEASE);
+    lapic_send_ipi(target->apic_id, APIC_IPI_FIXED | APIC_IPI_VECTOR);
+
+    wait_for(&target->call_started, ticket);
+    spin_unlock_irqrestore(&target->call_lock, flags);
+
+    if (wait) {
+        wait_for(&target->call_completed, ticket);
+    }
+    return 0;
+}
+
+void smp_call_others(smp_call_fn_t fn, void *arg, int wait) {
+    int self = smp_cpu_index();
+
+    for (int i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i != self && cpus[i].online) {
+            smp_call(i, fn, arg, wait);
+        }
+    }
+}
+
+void smp_kick(int index) {
+    percpu_t *target = percpu_of(index);
+
+    if (target != 0 && target->online && target != this_cpu()) {
+        lapic_send_ipi(target->apic_id, APIC_IPI_FIXED | APIC_IPI_VECTOR);
+    }
+}
+
+int smp_cpu_count(void) {
+    return online_count;
+}
+
+/* First C code on an application processor, on its own stack */
+static void ap_halt(void) {
+    while (1) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+void smp_ap_entry(int index) {
+    percpu_t *cpu = &cpus[index];
+    int expected = AP_WAITING;
+
+    if (!__atomic_compare_exchange_n(&ap_boot_state[index], &expected, AP_CLAIMED, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        ap_halt();
+    }
+
+    gdt_init_cpu(index, cpu, sizeof(*cpu));
+    idt_install();
+    apic_init_ap();
+
+    /* The local timer only ends time slices here; CPU 0 keeps time */
+    if (apic_timer_khz() != 0) {
+        apic_timer_enable(TIMER_VECTOR);
+    }
+
+    expected = AP_CLAIMED;
+    if (!__atomic_compare_exchange_n(&ap_boot_state[index], &expected, AP_ONLINE, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        ap_halt();
+    }
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&online_count, 1, __ATOMIC_RELEASE);
+
+    /* Parked in hlt until an IPI brings a call or a thread to run */
+    sched_idle_cpu();
+}
+
+/* Stop an AP still in the given boot state (put it back to
+   wait-for-SIPI); returns 0 if it has moved on */
+static int abandon_cpu(int index, int state) {
+    if (!__atomic_compare_exchange_n(&ap_boot_state[index], &state, AP_ABANDONED, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    lapic_send_ipi(cpus[index].apic_id, APIC_IPI_INIT);
+    clock_delay_ns(INIT_DELAY_NS);
+    return 1;
+}
+
+/*
+ * An AP missed the online timeout. If it never reached C it may still
+ * be about to read the trampoline words, so it is abandoned and put
+ * back to wait-for-SIPI with INIT before the next AP's words go in;
+ * returns -1 then. One that claimed itself just in time is already
+ * past the trampoline and gets SETUP_TIMEOUT_NS more to finish its own
+ * setup; if it hangs there it is abandoned and stopped the same way.
+ */
+static int give_up_cpu(int index) {
+    uint64_t deadline;
+
+    if (abandon_cpu(index, AP_WAITING)) {
+        return -1;
+    }
+
+    /* Once it has marked itself online it stores online right after */
+    deadline = clock_ns() + SETUP_TIMEOUT_NS;
+    while (!__atomic_load_n(&cpus[index].online, __ATOMIC_ACQUIRE)) {
+        if (clock_ns() >= deadline && abandon_cpu(index, AP_CLAIMED)) {
+            return -1;
+        }
+        cpu_pause();
+    }
+    return 0;
+}
+
+static int start_cpu(int index) {
+    percpu_t *cpu = &cpus[index];
+    uint64_t deadline;
+
+    cpu->self = cpu;
+    cpu->index = index;
+    cpu->apic_id = apic_cpu_id(index);
+    spin_lock_init(&cpu->call_lock, LOCK_STATS_REF(&mailbox_stats));
+
+    *TRAMPOLINE_WORD(ap_boot_stack) = (uint32_t)&ap_stacks[index - 1][SMP_STACK_SIZE];
+    *TRAMPOLINE_WORD(ap_boot_index) = (uint32_t)index;
+
+    lapic_send_ipi(cpu->apic_id, APIC_IPI_INIT);
+    clock_delay_ns(INIT_DELAY_NS);
+    for (int attempt = 0; attempt < 2 && !cpu->online; attempt++) {
+        lapic_send_ipi(cpu->apic_id, APIC_IPI_STARTUP | (SMP_TRAMPOLINE_BASE >> 12));
+        clock_delay_ns(SIPI_DELAY_NS);
+    }
+
+    deadline = clock_ns() + ONLINE_TIMEOUT_NS;
+    while (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+        if (clock_ns() >= deadline) {
+            return give_up_cpu(index);
+        }
+        cpu_pause();
+    }
+    return 0;
+}
+
+int smp_init(void) {
+    cpus[0].apic_id = lapic_id();
+    spin_lock_init(&cpus[0].call_lock, LOCK_STATS_REF(&mailbox_stats));
+    ipi_install_handler(ipi_handler);
+
+    if (!apic_is_active() || apic_cpu_count() < 2) {
+        return online_count;
+    }
+
+    memcpy((void *)SMP_TRAMPOLINE_BASE, ap_trampoline_start,
+           (size_t)(ap_trampoline_end - ap_trampoline_start));
+
+    /* One at a time: the trampoline has a single stack slot, which
+       start_cpu only hands on once the last AP is done with it */
+    for (int index = 1; index < apic_cpu_count(); index++) {
+        start_cpu(index);
+    }
+    return online_count;
+}
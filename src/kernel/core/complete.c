@@ -0,0 +1,233 @@
+/*
+ * MelonOS - Tab Completion
+ * Completes program names from the registry trie and paths from a
+ * cached directory listing
+ */
+
+#include "complete.h"
+#include "fs.h"
+#include "program.h"
+#include "string.h"
+#include "trie.h"
+#include "vga.h"
+
+/* A directory can hold at most one entry per inode */
+#define DIR_CACHE_ENTRIES 96
+#define DIR_CACHE_NODES   (DIR_CACHE_ENTRIES * (FS_NAME_MAX_LEN + 1))
+
+/*
+ * The last directory listed, kept until fs_generation() moves on. Tab
+ * pressed again on the same word, or on another name in the same
+ * directory, is answered from here without reading the disk.
+ */
+static struct {
+    int valid;
+    uint32_t generation;
+    char dir[FS_PATH_MAX_LEN + 1];
+    fs_entry_info_t entries[DIR_CACHE_ENTRIES];
+    trie_t names;             /* Values are entries index + 1 */
+} dir_cache;
+
+static trie_node_t dir_nodes[DIR_CACHE_NODES];
+
+typedef struct {
+    int paths;                /* Entries come from dir_cache */
+    int width;                /* Widest candidate */
+    int columns;
+    int column;
+} candidate_list_t;
+
+static const trie_t *directory_names(const char *dir) {
+    size_t count = 0;
+
+    if (dir_cache.valid && dir_cache.generation == fs_generation() &&
+        strcmp(dir_cache.dir, dir) == 0) {
+        return &dir_cache.names;
+    }
+
+    dir_cache.valid = 0;
+    if (!fs_is_ready() || fs_list_dir(dir, dir_cache.entries, DIR_CACHE_ENTRIES, &count) != 0) {
+        return 0;
+    }
+    if (count > DIR_CACHE_ENTRIES) {
+        count = DIR_CACHE_ENTRIES;
+    }
+
+    trie_init(&dir_cache.names, dir_nodes, DIR_CACHE_NODES);
+    for (size_t i = 0; i < count; i++) {
+        trie_insert(&dir_cache.names, dir_cache.entries[i].name, (uint16_t)(i + 1));
+    }
+
+    strcpy(dir_cache.dir, dir);
+    dir_cache.generation = fs_generation();
+    dir_cache.valid = 1;
+    return &dir_cache.names;
+}
+
+static int is_directory(const candidate_list_t *list, uint16_t value) {
+    return list->paths && dir_cache.entries[value - 1].type == FS_NODE_DIR;
+}
+
+static void measure_candidate(const char *word, uint16_t value, void *ctx) {
+    candidate_list_t *list = (candidate_list_t *)ctx;
+    int width = (int)strlen(word) + is_directory(list, value);
+
+    if (width > list->width) {
+        list->width = width;
+    }
+}
+
+static void print_candidate(const char *word, uint16_t value, void *ctx) {
+    candidate_list_t *list = (candidate_list_t *)ctx;
+    int width = (int)strlen(word);
+
+    if (list->column == list->columns) {
+        vga_putchar('\n');
+        list->column = 0;
+    }
+
+    if (is_directory(list, value)) {
+        vga_print_colored(word, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
+        vga_putchar('/');
+        width++;
+    } else {
+        vga_print(word);
+    }
+
+    list->column++;
+    if (list->column < list->columns) {
+        for (; width < list->width + 2; width++) {
+            vga_putchar(' ');
+        }
+    }
+}
+
+static void list_candidates(const trie_t *names, const char *prefix, int paths) {
+    candidate_list_t list;
+
+    list.paths = paths;
+    list.width = 0;
+    list.column = 0;
+    trie_visit(names, prefix, measure_candidate, &list);
+
+    list.columns = vga_get_width() / (list.width + 2);
+    if (list.columns < 1) {
+        list.columns = 1;
+    }
+
+    vga_putchar('\n');
+    trie_visit(names, prefix, print_candidate, &list);
+    vga_putchar('\n');
+}
+
+/* Insert text at *pos, dropping whatever does not fit in max_len */
+static void insert_text(char *buffer, int *len, int *pos, int max_len, const char *text, int count) {
+    if (count > max_len - *len) {
+        count = max_len - *len;
+    }
+    if (count <= 0) {
+        return;
+    }
+
+    memmove(&buffer[*pos + count], &buffer[*pos], (size_t)(*len - *pos));
+    memcpy(&buffer[*pos], text, (size_t)count);
+    *len += count;
+    *pos += count;
+    buffer[*len] = '\0';
+}
+
+int complete_line(char *buffer, int *len, int *pos, int max_len, int list) {
+    char word[FS_PATH_MAX_LEN + 1];
+    char dir[FS_PATH_MAX_LEN + 1];
+    char extra[TRIE_MAX_WORD + 1];
+    const trie_t *names;
+    const char *leaf = word;
+    int start = *pos;
+    int paths = 0;
+    int step_over = 0;
+    int added;
+    size_t count;
+
+    while (start > 0 && buffer[start - 1] != ' ') {
+        start--;
+    }
+    for (int i = 0; i < start; i++) {
+        if (buffer[i] != ' ') {
+            paths = 1;
+            break;
+        }
+    }
+
+    if (*pos - start > FS_PATH_MAX_LEN) {
+        return 0;
+    }
+    memcpy(word, &buffer[start], (size_t)(*pos - start));
+    word[*pos - start] = '\0';
+
+    if (!paths) {
+        names = program_names();
+    } else {
+        /* Split at the last slash: list what comes before, match the rest */
+        int slash = -1;
+
+        for (int i = 0; word[i]; i++) {
+            if (word[i] == '/') {
+                slash = i;
+            }
+        }
+
+        if (slash < 0) {
+            dir[0] = '\0';
+        } else if (slash == 0) {
+            strcpy(dir, "/");
+        } else {
+            memcpy(dir, word, (size_t)slash);
+            dir[slash] = '\0';
+        }
+        leaf = &word[slash + 1];
+
+        names = directory_names(dir);
+        if (names == 0) {
+            return 0;
+        }
+    }
+
+    if (strlen(leaf) >= TRIE_MAX_WORD) {
+        return 0;
+    }
+
+    count = trie_complete(names, leaf, extra, TRIE_MAX_WORD);
+    if (count == 0) {
+        return 0;
+    }
+    added = (int)strlen(extra);
+
+    if (count == 1) {
+        char match[2 * TRIE_MAX_WORD];
+        uint16_t value;
+
+        strcpy(match, leaf);
+        strcat(match, extra);
+        value = trie_lookup(names, match);
+
+        if (paths && dir_cache.entries[value - 1].type == FS_NODE_DIR) {
+            extra[added++] = '/';
+        } else if (*pos < *len && buffer[*pos] == ' ') {
+            step_over = 1;  /* Reuse the separator already there */
+        } else {
+            extra[added++] = ' ';
+        }
+        extra[added] = '\0';
+    }
+
+    insert_text(buffer, len, pos, max_len, extra, added);
+    if (step_over) {
+        (*pos)++;
+    }
+
+    if (count > 1 && added == 0 && list) {
+        list_candidates(names, leaf, paths);
+        return 1;
+    }
+    return 0;
+}
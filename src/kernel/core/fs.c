@@ -5,7 +5,9 @@
 
 #include "fs.h"
 #include "ata.h"
+#include "sched.h"
 #include "string.h"
+#include "task_pool.h"
 
 #define FS_MAGIC                0x4D465331u /* MFS1 */
 #define FS_VERSION              2u
@@ -26,6 +28,10 @@
 
 #define FS_NODE_ANY             0u
 
+/* parallel_for slice sizes: sectors zeroed and bitmap bits counted */
+#define FS_ZERO_GRAIN           64u
+#define FS_SCAN_GRAIN           256u
+
 typedef struct __attribute__((packed)) {
     uint32_t magic;
     uint32_t version;
@@ -50,8 +56,13 @@ typedef struct __attribute__((packed)) {
     uint32_t direct[FS_MAX_DIRECT_BLOCKS];
 } fs_inode_t;
 
+/* Held by every public call: they all share the metadata buffers below,
+   re-read them from disk and may sleep on the disk meanwhile */
+static mutex_t fs_lock = MUTEX_INIT;
+
 static int fs_ready = 0;
 static uint16_t cwd_inode = FS_ROOT_INODE;
+static uint32_t generation = 0;   /* See fs_generation() */
 static fs_superblock_t superblock;
 
 static uint8_t inode_bitmap[ATA_SECTOR_SIZE];
@@ -137,6 +148,7 @@ static int fs_read_metadata(void) {
 static int fs_write_metadata(void) {
     uint8_t superblock_sector[ATA_SECTOR_SIZE];
 
+    generation++;
     memset(superblock_sector, 0, sizeof(superblock_sector));
     memcpy(superblock_sector, &superblock, sizeof(superblock));
 
@@ -378,7 +390,7 @@ static int fs_resolve_parent(const char *path, uint16_t *out_parent, char *out_l
     return -1;
 }
 
-int fs_init(void) {
+static int fs_init_locked(void) {
     uint8_t superblock_sector[ATA_SECTOR_SIZE];
 
     if (ata_init() != 0) {
@@ -409,6 +421,7 @@ int fs_init(void) {
     }
 
     cwd_inode = FS_ROOT_INODE;
+    generation++;
     fs_ready = 1;
     return 0;
 }
@@ -417,8 +430,39 @@ int fs_is_ready(void) {
     return fs_ready;
 }
 
-int fs_format(void) {
-    uint8_t zero_sector[ATA_SECTOR_SIZE];
+static const uint8_t zero_sector[ATA_SECTOR_SIZE];
+
+/* parallel_for body for fs_format; arg points at a shared failure flag */
+static void fs_zero_sectors(uint32_t begin, uint32_t end, void *arg) {
+    volatile int *failed = arg;
+
+    for (uint32_t sector = begin; sector < end && !*failed; sector++) {
+        if (ata_write_sector(fs_sector_lba(sector), zero_sector) != 0) {
+            *failed = 1;
+        }
+    }
+}
+
+typedef struct {
+    const uint8_t *bitmap;
+    uint32_t set;
+} fs_bit_count_t;
+
+/* parallel_for body counting the set bits of a bitmap */
+static void fs_count_bits(uint32_t begin, uint32_t end, void *arg) {
+    fs_bit_count_t *count = arg;
+    uint32_t set = 0;
+
+    for (uint32_t i = begin; i < end; i++) {
+        if (bitmap_get(count->bitmap, i)) {
+            set++;
+        }
+    }
+    __atomic_add_fetch(&count->set, set, __ATOMIC_RELAXED);
+}
+
+static int fs_format_locked(void) {
+    volatile int failed = 0;
     fs_inode_t *inodes;
 
     if (ata_init() != 0) {
@@ -426,7 +470,6 @@ int fs_format(void) {
         return -1;
     }
 
-    memset(zero_sector, 0, sizeof(zero_sector));
     memset(&superblock, 0, sizeof(superblock));
     memset(inode_bitmap, 0, sizeof(inode_bitmap));
     memset(data_bitmap, 0, sizeof(data_bitmap));
@@ -458,19 +501,20 @@ int fs_format(void) {
         return -1;
     }
 
-    for (uint32_t sector = FS_DATA_START_SECTOR; sector < FS_TOTAL_SECTORS; sector++) {
-        if (ata_write_sector(fs_sector_lba(sector), zero_sector) != 0) {
-            fs_ready = 0;
-            return -1;
-        }
+    /* The bulk of mkfs; slices go to whichever CPUs are free */
+    parallel_for(FS_DATA_START_SECTOR, FS_TOTAL_SECTORS, FS_ZERO_GRAIN, fs_zero_sectors, (void *)&failed);
+    if (failed) {
+        fs_ready = 0;
+        return -1;
     }
 
     cwd_inode = FS_ROOT_INODE;
+    generation++;
     fs_ready = 1;
     return 0;
 }
 
-int fs_mkdir(const char *path) {
+static int fs_mkdir_locked(const char *path) {
     fs_inode_t *inodes;
     uint16_t parent;
     char leaf[FS_NAME_MAX_LEN + 1];
@@ -514,7 +558,7 @@ int fs_mkdir(const char *path) {
     return 0;
 }
 
-int fs_rmdir(const char *path) {
+static int fs_rmdir_locked(const char *path) {
     fs_inode_t *inodes;
     uint16_t inode_index;
 
@@ -553,7 +597,7 @@ int fs_rmdir(const char *path) {
     return 0;
 }
 
-int fs_list_dir(const char *path, fs_entry_info_t *entries, size_t max_entries, size_t *out_count) {
+static int fs_list_dir_locked(const char *path, fs_entry_info_t *entries, size_t max_entries, size_t *out_count) {
     fs_inode_t *inodes;
     uint16_t dir;
     size_t count = 0;
@@ -596,7 +640,7 @@ int fs_list_dir(const char *path, fs_entry_info_t *entries, size_t max_entries,
     return 0;
 }
 
-int fs_set_cwd(const char *path) {
+static int fs_set_cwd_locked(const char *path) {
     fs_inode_t *inodes;
     uint16_t inode_index;
 
@@ -618,10 +662,15 @@ int fs_set_cwd(const char *path) {
     }
 
     cwd_inode = inode_index;
+    generation++;
     return 0;
 }
 
-int fs_get_cwd(char *buffer, size_t buffer_size) {
+uint32_t fs_generation(void) {
+    return generation;
+}
+
+static int fs_get_cwd_locked(char *buffer, size_t buffer_size) {
     fs_inode_t *inodes;
     uint16_t stack[FS_MAX_INODES];
     uint16_t current;
@@ -681,7 +730,7 @@ int fs_get_cwd(char *buffer, size_t buffer_size) {
     return 0;
 }
 
-int fs_write_file(const char *path, const uint8_t *data, uint32_t size) {
+static int fs_write_file_locked(const char *path, const uint8_t *data, uint32_t size) {
     fs_inode_t *inodes;
     uint16_t parent;
     char leaf[FS_NAME_MAX_LEN + 1];
@@ -772,7 +821,7 @@ int fs_write_file(const char *path, const uint8_t *data, uint32_t size) {
     return 0;
 }
 
-int fs_read_file(const char *path, uint8_t *buffer, uint32_t buffer_size, uint32_t *out_size) {
+static int fs_read_file_locked(const char *path, uint8_t *buffer, uint32_t buffer_size, uint32_t *out_size) {
     fs_inode_t *inodes;
     uint16_t inode_index;
     fs_inode_t *inode;
@@ -825,7 +874,7 @@ int fs_read_file(const char *path, uint8_t *buffer, uint32_t buffer_size, uint32
     return 0;
 }
 
-int fs_delete_file(const char *path) {
+static int fs_delete_file_locked(const char *path) {
     fs_inode_t *inodes;
     uint16_t inode_index;
     fs_inode_t *inode;
@@ -860,9 +909,9 @@ int fs_delete_file(const char *path) {
     return 0;
 }
 
-int fs_get_info(fs_info_t *info) {
-    uint32_t used_inodes = 0;
-    uint32_t free_data_blocks = 0;
+static int fs_get_info_locked(fs_info_t *info) {
+    fs_bit_count_t used_inodes = { inode_bitmap, 0 };
+    fs_bit_count_t used_data_blocks = { data_bitmap, 0 };
 
     if (!fs_ready || info == 0) {
         return -1;
@@ -872,23 +921,114 @@ int fs_get_info(fs_info_t *info) {
         return -1;
     }
 
-    for (uint32_t i = 0; i < superblock.max_inodes; i++) {
-        if (bitmap_get(inode_bitmap, i)) {
-            used_inodes++;
-        }
-    }
-
-    for (uint32_t i = 0; i < superblock.max_data_blocks; i++) {
-        if (!bitmap_get(data_bitmap, i)) {
-            free_data_blocks++;
-        }
-    }
+    parallel_for(0, superblock.max_inodes, FS_SCAN_GRAIN, fs_count_bits, &used_inodes);
+    parallel_for(0, superblock.max_data_blocks, FS_SCAN_GRAIN, fs_count_bits, &used_data_blocks);
 
     info->total_sectors = superblock.fs_total_sectors;
-    info->free_data_blocks = free_data_blocks;
+    info->free_data_blocks = superblock.max_data_blocks - used_data_blocks.set;
     info->total_data_blocks = superblock.max_data_blocks;
-    info->used_inodes = used_inodes;
+    info->used_inodes = used_inodes.set;
     info->total_inodes = superblock.max_inodes;
 
     return 0;
 }
+
+/* Public entry points: one caller at a time in the metadata */
+int fs_init(void) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_init_locked();
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_format(void) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_format_locked();
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_mkdir(const char *path) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_mkdir_locked(path);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_rmdir(const char *path) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_rmdir_locked(path);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_list_dir(const char *path, fs_entry_info_t *entries, size_t max_entries, size_t *out_count) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_list_dir_locked(path, entries, max_entries, out_count);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_set_cwd(const char *path) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_set_cwd_locked(path);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_get_cwd(char *buffer, size_t buffer_size) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_get_cwd_locked(buffer, buffer_size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_write_file(const char *path, const uint8_t *data, uint32_t size) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_write_file_locked(path, data, size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_read_file(const char *path, uint8_t *buffer, uint32_t buffer_size, uint32_t *out_size) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_read_file_locked(path, buffer, buffer_size, out_size);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_delete_file(const char *path) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_delete_file_locked(path);
+    mutex_unlock(&fs_lock);
+    return result;
+}
+
+int fs_get_info(fs_info_t *info) {
+    int result;
+
+    mutex_lock(&fs_lock);
+    result = fs_get_info_locked(info);
+    mutex_unlock(&fs_lock);
+    return result;
+}
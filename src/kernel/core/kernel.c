@@ -14,15 +14,30 @@
 #include "program.h"
 #include "program_builtin.h"
 #include "timer.h"
+#include "clock.h"
+#include "apic.h"
+#include "smp.h"
+#include "sched.h"
+#include "timer_wheel.h"
+#include "task_pool.h"
 #include "shell.h"
 #include "string.h"
+#include "serial.h"
+#include "framebuffer.h"
+#include "kprintf.h"
 
 /* Kernel entry point */
 void kernel_main(uint32_t magic, uint32_t mboot_addr) {
-    (void)magic;
-    (void)mboot_addr;
+    char message[64];
 
-    /* Initialize VGA text mode display */
+    /* Select memcpy/memset variants before anything copies in bulk */
+    string_init();
+
+    /* Bring up COM1 first so the whole boot log reaches the serial console */
+    serial_init(SERIAL_DEFAULT_BAUD);
+
+    /* Use the linear framebuffer if the loader set one up, otherwise VGA text mode */
+    fb_init(magic, mboot_addr);
     vga_init();
 
     /* Boot splash */
@@ -49,17 +64,85 @@ void kernel_main(uint32_t magic, uint32_t mboot_addr) {
     idt_init();
     vga_print_status("Interrupt Descriptor Table initialized", "OK", VGA_COLOR_LIGHT_GREEN);
 
+    /* Report which copy/fill routines CPUID selected */
+    strcpy(message, "String routines: ");
+    strcat(message, string_accel_name());
+    vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+
     /* Initialize timer at 100 Hz */
     timer_init(100);
     vga_print_status("PIT Timer initialized (100 Hz)", "OK", VGA_COLOR_LIGHT_GREEN);
 
+    /* Calibrate the TSC against PIT channel 2 */
+    clock_init();
+    if (clock_has_tsc()) {
+        ksnprintf(message, sizeof(message), "TSC clock calibrated (%u.%03u MHz)",
+                  clock_tsc_khz() / 1000, clock_tsc_khz() % 1000);
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    } else {
+        vga_print_status("No TSC; clock limited to timer ticks", "WARN", VGA_COLOR_YELLOW);
+    }
+
+    /* Hand interrupt delivery to the APICs when the firmware lists them */
+    if (apic_init() == 0) {
+        ksnprintf(message, sizeof(message), "IOAPIC interrupt routing (%s)", apic_source());
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    } else {
+        vga_print_status("No APIC found; keeping the 8259 PIC", "WARN", VGA_COLOR_YELLOW);
+    }
+
+    /* With a clock to keep time, the timer only fires for deadlines */
+    if (timer_enable_oneshot() == 0) {
+        ksnprintf(message, sizeof(message), "Tickless timer (one-shot %s)", timer_source());
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    } else {
+        vga_print_status("Periodic timer kept (no TSC clock)", "WARN", VGA_COLOR_YELLOW);
+    }
+
     /* Initialize keyboard */
     keyboard_init();
     vga_print_status("PS/2 Keyboard initialized", "OK", VGA_COLOR_LIGHT_GREEN);
 
+    ksnprintf(message, sizeof(message), "%d virtual consoles (Alt+F1..F%d)", VGA_CONSOLES, VGA_CONSOLES);
+    vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+
+    if (serial_is_present()) {
+        vga_print_status("Serial console on COM1 (115200 8N1)", "OK", VGA_COLOR_LIGHT_GREEN);
+    } else {
+        vga_print_status("No UART on COM1", "WARN", VGA_COLOR_YELLOW);
+    }
+
+    if (fb_is_available()) {
+        ksnprintf(message, sizeof(message), "Framebuffer console %ux%ux%u (%dx%d cells)",
+                  fb_width(), fb_height(), fb_bpp(), vga_get_width(), vga_get_height());
+    } else {
+        ksnprintf(message, sizeof(message), "VGA text console %dx%d",
+                  vga_get_width(), vga_get_height());
+    }
+    vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+
     /* Enable interrupts only after IRQ handlers are installed */
     __asm__ volatile ("sti");
 
+    /* Wake the other processors and park them until work is sent */
+    if (smp_init() > 1) {
+        ksnprintf(message, sizeof(message), "%d of %d CPUs online", smp_cpu_count(), apic_cpu_count());
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    }
+
+    /* From here on the boot code is thread "main" and may be preempted */
+    sched_init();
+    if (timer_wheel_start() == 0) {
+        ksnprintf(message, sizeof(message), "Scheduler running on %d CPU(s)", smp_cpu_count());
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    } else {
+        vga_print_status("No thread for software timers", "WARN", VGA_COLOR_YELLOW);
+    }
+    if (task_pool_init() > 0) {
+        ksnprintf(message, sizeof(message), "Task pool with %d worker(s)", task_pool_workers());
+        vga_print_status(message, "OK", VGA_COLOR_LIGHT_GREEN);
+    }
+
     /* Register shell-launchable programs */
     programs_init();
     programs_register_builtin();
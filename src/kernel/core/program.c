@@ -7,13 +7,25 @@
 #include "string.h"
 
 #define MAX_PROGRAMS 32
+#define PROGRAM_ARENA_SIZE (64 * 1024)
+#define PROGRAM_TRIE_NODES 512
 
 static program_t registry[MAX_PROGRAMS];
 static size_t registry_count = 0;
 
+/* Registered names; each word's value is its registry index + 1 */
+static trie_node_t name_nodes[PROGRAM_TRIE_NODES];
+static trie_t names;
+
+/* Scratch memory handed to each program run */
+static uint8_t arena_storage[PROGRAM_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+static arena_t scratch_arena;
+
 void programs_init(void) {
     registry_count = 0;
     memset(registry, 0, sizeof(registry));
+    trie_init(&names, name_nodes, PROGRAM_TRIE_NODES);
+    arena_init(&scratch_arena, arena_storage, sizeof(arena_storage));
 }
 
 int program_register(const program_t *program) {
@@ -21,7 +33,12 @@ int program_register(const program_t *program) {
         return -1;
     }
 
-    if (registry_count >= MAX_PROGRAMS || program_find(program->name) != 0) {
+    if (registry_count >= MAX_PROGRAMS) {
+        return -1;
+    }
+
+    /* Fails for duplicates as well as when the trie is full */
+    if (trie_insert(&names, program->name, (uint16_t)(registry_count + 1)) != 0) {
         return -1;
     }
 
@@ -30,17 +47,18 @@ int program_register(const program_t *program) {
 }
 
 const program_t *program_find(const char *name) {
+    uint16_t value;
+
     if (name == 0) {
         return 0;
     }
 
-    for (size_t index = 0; index < registry_count; index++) {
-        if (strcmp(registry[index].name, name) == 0) {
-            return &registry[index];
-        }
-    }
+    value = trie_lookup(&names, name);
+    return value != 0 ? &registry[value - 1] : 0;
+}
 
-    return 0;
+const trie_t *program_names(void) {
+    return &names;
 }
 
 const program_t *program_get(size_t index) {
@@ -57,11 +75,19 @@ size_t program_count(void) {
 
 int program_run(const char *name, int argc, char *argv[]) {
     const program_t *program = program_find(name);
+    arena_mark_t mark;
 
     if (program == 0) {
         return -1;
     }
 
+    /* Roll back to the caller's position so nested runs stay intact */
+    mark = arena_mark(&scratch_arena);
     program->entry(argc, argv);
+    arena_release(&scratch_arena, mark);
     return 0;
+}
+
+arena_t *program_arena(void) {
+    return &scratch_arena;
 }
\ No newline at end of file
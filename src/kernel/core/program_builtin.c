@@ -10,8 +10,19 @@
 #include "fs.h"
 #include "string.h"
 #include "timer.h"
+#include "apic.h"
+#include "smp.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "task_pool.h"
+#include "clock.h"
+#include "math64.h"
 #include "vga.h"
+#include "framebuffer.h"
 #include "io.h"
+#include "kprintf.h"
+
+#define LIST_MAX_ENTRIES 64
 
 static void program_help(int argc, char *argv[]);
 static void program_clear(int argc, char *argv[]);
@@ -37,6 +48,10 @@ static void program_cd(int argc, char *argv[]);
 static void program_pwd(int argc, char *argv[]);
 static void program_tree(int argc, char *argv[]);
 static void program_fsinfo(int argc, char *argv[]);
+static void program_search(int argc, char *argv[]);
+static void program_cpus(int argc, char *argv[]);
+static void program_ps(int argc, char *argv[]);
+static void program_locks(int argc, char *argv[]);
 static uint8_t cmos_read(uint8_t reg);
 static uint8_t bcd_to_bin(uint8_t bcd);
 static int path_join(const char *base, const char *name, char *out, size_t out_size);
@@ -67,7 +82,11 @@ void programs_register_builtin(void) {
         { "write",    "Write text file (write <path> <text>)", program_write },
         { "cat",      "Print file contents (cat <path>)",      program_cat },
         { "rm",       "Delete a file (rm <path>)",             program_rm },
-        { "fsinfo",   "Show filesystem status",                program_fsinfo }
+        { "fsinfo",   "Show filesystem status",                program_fsinfo },
+        { "search",   "Find text in scrollback (search [text])", program_search },
+        { "cpus",     "List processors and ping each one",     program_cpus },
+        { "ps",       "List kernel threads",                   program_ps },
+        { "locks",    "Show lock contention counters",         program_locks }
     };
 
     for (size_t index = 0; index < sizeof(builtins) / sizeof(builtins[0]); index++) {
@@ -143,9 +162,29 @@ static void program_about(int argc, char *argv[]) {
     vga_print(MELONOS_VERSION);
     vga_println("");
     vga_print("  Arch:     i386 (x86 32-bit)\n");
-    vga_print("  Display:  VGA Text Mode 80x25\n");
+    if (fb_is_available()) {
+        kprintf("  Display:  Framebuffer %ux%ux%u, %dx%d cells\n",
+                fb_width(), fb_height(), fb_bpp(), vga_get_width(), vga_get_height());
+    } else {
+        kprintf("  Display:  VGA text mode %dx%d\n", vga_get_width(), vga_get_height());
+    }
     vga_print("  Input:    PS/2 Keyboard\n");
-    vga_print("  Timer:    PIT @ 100 Hz\n");
+    if (timer_is_oneshot()) {
+        kprintf("  Timer:    %s one-shot (tickless)\n", timer_source());
+    } else {
+        vga_print("  Timer:    PIT @ 100 Hz\n");
+    }
+    if (apic_is_active()) {
+        kprintf("  IRQs:     IOAPIC (%s)\n", apic_source());
+        kprintf("  CPUs:     %d online\n", smp_cpu_count());
+    } else {
+        vga_print("  IRQs:     8259 PIC\n");
+    }
+    if (clock_has_tsc()) {
+        kprintf("  Clock:    TSC @ %u.%03u MHz\n", clock_tsc_khz() / 1000, clock_tsc_khz() % 1000);
+    } else {
+        vga_print("  Clock:    timer ticks\n");
+    }
     vga_println("");
 }
 
@@ -163,19 +202,14 @@ static void program_uptime(int argc, char *argv[]) {
     minutes = (uptime % 3600) / 60;
     seconds = uptime % 60;
 
-    vga_print("Uptime: ");
     if (hours > 0) {
-        vga_print_int(hours);
-        vga_print("h ");
+        kprintf("Uptime: %uh %um %us\n", hours, minutes, seconds);
+    } else {
+        kprintf("Uptime: %um %us\n", minutes, seconds);
     }
-    vga_print_int(minutes);
-    vga_print("m ");
-    vga_print_int(seconds);
-    vga_println("s");
-
-    vga_print("Ticks:  ");
-    vga_print_int(timer_get_ticks());
-    vga_println("");
+    kprintf("Ticks:  %u\n", timer_get_ticks());
+    kprintf("Timer interrupts: %u (%s)\n", timer_get_interrupts(),
+            timer_is_oneshot() ? "tickless" : "periodic");
 }
 
 static void program_reboot(int argc, char *argv[]) {
@@ -184,6 +218,7 @@ static void program_reboot(int argc, char *argv[]) {
     (void)argc;
     (void)argv;
 
+    shell_history_save();
     vga_print_colored("Rebooting...\n", VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
 
     good = 0x02;
@@ -202,6 +237,7 @@ static void program_shutdown(int argc, char *argv[]) {
     (void)argc;
     (void)argv;
 
+    shell_history_save();
     vga_println("");
     vga_print_colored("  Shutting down MelonOS...\n", VGA_COLOR_YELLOW, VGA_COLOR_BLACK);
     vga_print_colored("  Goodbye! It is now safe to turn off your computer.\n\n", VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
@@ -231,9 +267,7 @@ static void program_color(int argc, char *argv[]) {
     }
 
     vga_set_color((enum vga_color)color, VGA_COLOR_BLACK);
-    vga_print("Text color changed to ");
-    vga_print_int(color);
-    vga_println("");
+    kprintf("Text color changed to %d\n", color);
 }
 
 static void program_history(int argc, char *argv[]) {
@@ -249,10 +283,7 @@ static void program_history(int argc, char *argv[]) {
     }
 
     for (size_t index = 0; index < count; index++) {
-        vga_print("  ");
-        vga_print_int((int)(index + 1));
-        vga_print("  ");
-        vga_println(shell_history_entry(index));
+        kprintf("  %zu  %s\n", index + 1, shell_history_entry(index));
     }
 }
 
@@ -295,14 +326,7 @@ static void program_calc(int argc, char *argv[]) {
             return;
     }
 
-    vga_print_int(a);
-    vga_print(" ");
-    vga_putchar(op);
-    vga_print(" ");
-    vga_print_int(b);
-    vga_print(" = ");
-    vga_print_int(result);
-    vga_println("");
+    kprintf("%d %c %d = %d\n", a, op, b, result);
 }
 
 static void program_melon(int argc, char *argv[]) {
@@ -346,38 +370,8 @@ static void program_date(int argc, char *argv[]) {
     month = bcd_to_bin(cmos_read(0x08));
     year = bcd_to_bin(cmos_read(0x09));
 
-    vga_print("Date: 20");
-    if (year < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(year);
-    vga_putchar('-');
-    if (month < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(month);
-    vga_putchar('-');
-    if (day < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(day);
-
-    vga_print(" Time: ");
-    if (hour < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(hour);
-    vga_putchar(':');
-    if (minute < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(minute);
-    vga_putchar(':');
-    if (second < 10) {
-        vga_putchar('0');
-    }
-    vga_print_int(second);
-    vga_print(" UTC\n");
+    kprintf("Date: 20%02u-%02u-%02u Time: %02u:%02u:%02u UTC\n",
+            year, month, day, hour, minute, second);
 }
 
 static void program_mem(int argc, char *argv[]) {
@@ -390,17 +384,10 @@ static void program_mem(int argc, char *argv[]) {
     lo_mem = cmos_read(0x15) | (cmos_read(0x16) << 8);
     hi_mem = cmos_read(0x17) | (cmos_read(0x18) << 8);
 
-    vga_print("Base memory:     ");
-    vga_print_int(lo_mem);
-    vga_println(" KB");
-
-    vga_print("Extended memory: ");
-    vga_print_int(hi_mem);
-    vga_println(" KB");
-
-    vga_print("Total:           ~");
-    vga_print_int((lo_mem + hi_mem) / 1024);
-    vga_println(" MB");
+    kprintf("Base memory:     %u KB\n"
+            "Extended memory: %u KB\n"
+            "Total:           ~%u MB\n",
+            lo_mem, hi_mem, (lo_mem + hi_mem) / 1024u);
 }
 
 static void program_mkfs(int argc, char *argv[]) {
@@ -416,7 +403,7 @@ static void program_mkfs(int argc, char *argv[]) {
 }
 
 static void program_ls(int argc, char *argv[]) {
-    fs_entry_info_t entries[64];
+    fs_entry_info_t *entries;
     const char *target = "";
     size_t count = 0;
 
@@ -429,7 +416,13 @@ static void program_ls(int argc, char *argv[]) {
         return;
     }
 
-    if (fs_list_dir(target, entries, 64, &count) != 0) {
+    entries = arena_alloc(program_arena(), LIST_MAX_ENTRIES * sizeof(fs_entry_info_t));
+    if (entries == 0) {
+        vga_println("Out of scratch memory.");
+        return;
+    }
+
+    if (fs_list_dir(target, entries, LIST_MAX_ENTRIES, &count) != 0) {
         vga_println("Failed to read directory.");
         return;
     }
@@ -439,7 +432,7 @@ static void program_ls(int argc, char *argv[]) {
         return;
     }
 
-    for (size_t i = 0; i < count && i < 64; i++) {
+    for (size_t i = 0; i < count && i < LIST_MAX_ENTRIES; i++) {
         vga_print("  ");
         if (entries[i].type == FS_NODE_DIR) {
             vga_print_colored("<DIR> ", VGA_COLOR_LIGHT_BLUE, VGA_COLOR_BLACK);
@@ -449,16 +442,12 @@ static void program_ls(int argc, char *argv[]) {
             vga_print_colored("<FILE>", VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
             vga_print(" ");
             vga_print_colored(entries[i].name, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-            vga_print("  ");
-            vga_print_int((int)entries[i].size);
-            vga_println(" bytes");
+            kprintf("  %u bytes\n", entries[i].size);
         }
     }
 
-    if (count > 64) {
-        vga_print("  ... and ");
-        vga_print_int((int)(count - 64));
-        vga_println(" more");
+    if (count > LIST_MAX_ENTRIES) {
+        kprintf("  ... and %zu more\n", count - LIST_MAX_ENTRIES);
     }
 }
 
@@ -587,7 +576,10 @@ static int path_join(const char *base, const char *name, char *out, size_t out_s
 }
 
 static void print_tree_recursive(const char *path, int depth) {
-    fs_entry_info_t entries[64];
+    arena_t *arena = program_arena();
+    arena_mark_t mark;
+    fs_entry_info_t *entries;
+    char *child_path;
     size_t count = 0;
 
     if (depth > 8) {
@@ -595,13 +587,22 @@ static void print_tree_recursive(const char *path, int depth) {
         return;
     }
 
-    if (fs_list_dir(path, entries, 64, &count) != 0) {
+    /* Each level's scratch is handed back before returning to the parent */
+    mark = arena_mark(arena);
+    entries = arena_alloc(arena, LIST_MAX_ENTRIES * sizeof(fs_entry_info_t));
+    child_path = arena_alloc(arena, FS_PATH_MAX_LEN + 1);
+    if (entries == 0 || child_path == 0) {
+        vga_println("  ... (out of scratch memory)");
+        arena_release(arena, mark);
         return;
     }
 
-    for (size_t i = 0; i < count && i < 64; i++) {
-        char child_path[FS_PATH_MAX_LEN + 1];
+    if (fs_list_dir(path, entries, LIST_MAX_ENTRIES, &count) != 0) {
+        arena_release(arena, mark);
+        return;
+    }
 
+    for (size_t i = 0; i < count && i < LIST_MAX_ENTRIES; i++) {
         for (int indent = 0; indent < depth; indent++) {
             vga_print("  ");
         }
@@ -610,13 +611,15 @@ static void print_tree_recursive(const char *path, int depth) {
         vga_print(entries[i].name);
         if (entries[i].type == FS_NODE_DIR) {
             vga_println("/");
-            if (path_join(path, entries[i].name, child_path, sizeof(child_path)) == 0) {
+            if (path_join(path, entries[i].name, child_path, FS_PATH_MAX_LEN + 1) == 0) {
                 print_tree_recursive(child_path, depth + 1);
             }
         } else {
             vga_println("");
         }
     }
+
+    arena_release(arena, mark);
 }
 
 static void program_tree(int argc, char *argv[]) {
@@ -668,14 +671,11 @@ static void program_write(int argc, char *argv[]) {
         return;
     }
 
-    vga_print("Wrote ");
-    vga_print_int((int)size);
-    vga_print(" bytes to ");
-    vga_println(argv[1]);
+    kprintf("Wrote %u bytes to %s\n", size, argv[1]);
 }
 
 static void program_cat(int argc, char *argv[]) {
-    uint8_t buffer[FS_READ_BUFFER_SIZE + 1];
+    uint8_t *buffer;
     uint32_t size = 0;
 
     if (argc < 2) {
@@ -688,6 +688,12 @@ static void program_cat(int argc, char *argv[]) {
         return;
     }
 
+    buffer = arena_alloc(program_arena(), FS_READ_BUFFER_SIZE + 1);
+    if (buffer == 0) {
+        vga_println("Out of scratch memory.");
+        return;
+    }
+
     if (fs_read_file(argv[1], buffer, FS_READ_BUFFER_SIZE, &size) != 0) {
         vga_println("Read failed or file not found.");
         return;
@@ -733,18 +739,121 @@ static void program_fsinfo(int argc, char *argv[]) {
         return;
     }
 
-    vga_print("Total sectors:    ");
-    vga_print_int((int)info.total_sectors);
-    vga_println("");
-    vga_print("Data blocks:      ");
-    vga_print_int((int)info.total_data_blocks);
-    vga_println("");
-    vga_print("Free data blocks: ");
-    vga_print_int((int)info.free_data_blocks);
-    vga_println("");
-    vga_print("Inodes used:      ");
-    vga_print_int((int)info.used_inodes);
-    vga_print("/");
-    vga_print_int((int)info.total_inodes);
-    vga_println("");
-}
\ No newline at end of file
+    kprintf("Total sectors:    %u\n"
+            "Data blocks:      %u\n"
+            "Free data blocks: %u\n"
+            "Inodes used:      %u/%u\n",
+            info.total_sectors, info.total_data_blocks, info.free_data_blocks,
+            info.used_inodes, info.total_inodes);
+}
+
+static void program_search(int argc, char *argv[]) {
+    static char text[CONSOLE_MAX_COLS + 1];
+    static int last_match = -1;
+    int before;
+    int line;
+
+    if (argc >= 2) {
+        size_t len = 0;
+
+        /* Rejoin the words; the shell split them on spaces */
+        for (int index = 1; index < argc; index++) {
+            const char *word = argv[index];
+
+            if (index > 1 && len < CONSOLE_MAX_COLS) {
+                text[len++] = ' ';
+            }
+            while (*word && len < CONSOLE_MAX_COLS) {
+                text[len++] = *word++;
+            }
+        }
+        text[len] = '\0';
+
+        /* Skip the line holding the command itself */
+        before = vga_get_cursor_line() - 1;
+    } else if (text[0] != '\0' && last_match >= 0) {
+        before = last_match;
+    } else {
+        vga_println("Usage: search <text>  (run 'search' again for older matches)");
+        return;
+    }
+
+    line = vga_find_line(text, before);
+    if (line < 0) {
+        kprintf("No %smatch for \"%s\"\n", argc >= 2 ? "" : "earlier ", text);
+        last_match = -1;
+        return;
+    }
+
+    last_match = line;
+    kprintf("Match %d lines up; scroll down or type to return\n", vga_get_cursor_line() - line);
+    vga_scroll_to_line(line);
+}
+
+static void cpu_ping(void *arg) {
+    (void)arg;
+}
+
+static void program_cpus(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    kprintf("%d CPU(s) online, %d listed by the firmware\n", smp_cpu_count(), apic_cpu_count());
+    for (int index = 0; index < SMP_MAX_CPUS; index++) {
+        percpu_t *cpu = percpu_of(index);
+        uint64_t start;
+        uint64_t elapsed;
+
+        if (!cpu->online) {
+            continue;
+        }
+
+        /* Round trip of an empty cross-CPU call */
+        start = clock_ns();
+        smp_call(index, cpu_ping, 0, 1);
+        elapsed = clock_ns() - start;
+
+        kprintf("  CPU %d  APIC %u  %s  calls %u  switches %u  tasks %u (%u stolen)  ping %u ns\n",
+                index, cpu->apic_id, index == 0 ? "boot" : "AP  ", cpu->calls_handled,
+                sched_switches(index), task_pool_executed(index), task_pool_stolen(index),
+                (uint32_t)elapsed);
+    }
+}
+
+static void program_ps(int argc, char *argv[]) {
+    static const char *const state_names[] = { "free", "ready", "run", "wait", "dead" };
+    static const char *const priority_names[SCHED_PRIORITIES] = { "high", "normal", "low", "idle" };
+
+    (void)argc;
+    (void)argv;
+
+    kprintf(" ID  CPU  PRI     STATE  NAME             TIME ms  SWITCHES\n");
+    for (int i = 0; i < SCHED_MAX_THREADS; i++) {
+        thread_t thread;
+
+        if (sched_thread_info(i, &thread) != 0) {
+            continue;
+        }
+        kprintf("%3u  %3d  %-6s  %-5s  %-15s  %7u  %8u\n", thread.id, thread.cpu,
+                priority_names[thread.priority], state_names[thread.state], thread.name,
+                (uint32_t)div64_u32(thread.runtime_ns, 1000000u, 0), thread.switches);
+    }
+}
+
+static void program_locks(int argc, char *argv[]) {
+    lock_stats_t *stats = lock_stats_first();
+
+    (void)argc;
+    (void)argv;
+
+    if (stats == 0) {
+        vga_println("No lock statistics (build with LOCK_STATS=1 to count contention)");
+        return;
+    }
+
+    kprintf("LOCK                ACQUIRED  CONTENDED      SPINS  RETRIES\n");
+    for (; stats; stats = stats->next) {
+        kprintf("%-18s  %8u  %9u  %9u  %7u\n", stats->name, stats->acquired,
+                stats->contended, stats->spins, stats->retries);
+    }
+}
@@ -0,0 +1,597 @@
+/*
+ * MelonOS - Kernel Threads
+ * Run queues, context switches from IRQ exit, sleep and wait queues
+ */
+
+#include "sched.h"
+#include "apic.h"
+#include "clock.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "smp.h"
+#include "string.h"
+#include "timer.h"
+
+/* Time slice per priority; a thread that uses its slice up goes to the
+   back of its priority's queue */
+static const uint32_t slice_ns[SCHED_PRIORITIES] = {
+    5000000u, 10000000u, 20000000u, 0
+};
+
+typedef struct {
+    spinlock_t lock;
+    int running;
+    volatile int need_resched;
+    thread_t *current;
+    thread_t *idle;
+    thread_t *head[SCHED_PRIORITIES];
+    thread_t *tail[SCHED_PRIORITIES];
+    thread_t *dead;               /* Exited; freed once off its stack */
+    uint64_t slice_end;
+    uint64_t slice_armed;         /* Timer interrupt already asked for */
+    uint64_t switched_at;
+    uint32_t switches;
+} run_queue_t;
+
+DEFINE_LOCK_STATS(run_queue_stats, "run queues");
+DEFINE_LOCK_STATS(sleep_stats, "sleepers");
+DEFINE_LOCK_STATS(thread_table_stats, "thread table");
+
+static run_queue_t run_queues[SMP_MAX_CPUS];
+static thread_t threads[SCHED_MAX_THREADS];
+static uint8_t thread_stacks[SCHED_MAX_THREADS][THREAD_STACK_SIZE] __attribute__((aligned(16)));
+/* Held for writing while a slot is claimed and filled in or freed, so
+   listings (sched_thread_info) never copy a half-made thread */
+static rwlock_t threads_lock = RWLOCK_INIT_STATS(&thread_table_stats);
+static uint32_t next_id = 1;
+
+/* Earliest wake_at among blocked threads; only CPU 0 acts on it, on
+   every interrupt, so it reads it without taking the lock */
+static seqlock_t sleep_lock = SEQLOCK_INIT_STATS(&sleep_stats);
+static uint64_t next_wake = SCHED_FOREVER;
+
+static run_queue_t *this_rq(void) {
+    return &run_queues[smp_cpu_index()];
+}
+
+static void enqueue(run_queue_t *rq, thread_t *thread) {
+    int p = thread->priority;
+
+    thread->run_next = 0;
+    if (rq->tail[p]) {
+        rq->tail[p]->run_next = thread;
+    } else {
+        rq->head[p] = thread;
+    }
+    rq->tail[p] = thread;
+}
+
+/* Best queued priority, SCHED_PRIORITY_IDLE if nothing is queued */
+static int best_queued(const run_queue_t *rq) {
+    for (int p = 0; p < SCHED_PRIORITY_IDLE; p++) {
+        if (rq->head[p]) {
+            return p;
+        }
+    }
+    return SCHED_PRIORITY_IDLE;
+}
+
+static thread_t *dequeue(run_queue_t *rq) {
+    int p = best_queued(rq);
+    thread_t *thread;
+
+    if (p == SCHED_PRIORITY_IDLE) {
+        return rq->idle;
+    }
+    thread = rq->head[p];
+    rq->head[p] = thread->run_next;
+    if (rq->head[p] == 0) {
+        rq->tail[p] = 0;
+    }
+    return thread;
+}
+
+/* Have the timer interrupt this CPU when the slice ends, unless an
+   interrupt no later than that is already on its way */
+static void arm_slice(run_queue_t *rq, uint64_t now) {
+    if (rq->slice_armed > now && rq->slice_armed <= rq->slice_end) {
+        return;
+    }
+    if (smp_cpu_index() == 0) {
+        if (timer_wake_at(rq->slice_end) == 0) {
+            rq->slice_armed = rq->slice_end;
+        }
+    } else if (apic_timer_khz() != 0) {
+        rq->slice_armed = now + apic_timer_oneshot(rq->slice_end - now);
+    }
+}
+
+/* Runs first on the new stack after every switch */
+static void finish_switch(run_queue_t *rq) {
+    if (rq->dead) {
+        write_lock(&threads_lock);
+        rq->dead->state = THREAD_FREE;
+        write_unlock(&threads_lock);
+        rq->dead = 0;
+    }
+}
+
+/* Pick the next thread and switch to it (interrupts off) */
+static void schedule(void) {
+    run_queue_t *rq = this_rq();
+    uint64_t now = clock_ns();
+    thread_t *prev;
+    thread_t *next;
+    int rotate;
+
+    spin_lock(&rq->lock);
+    prev = rq->current;
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_RUNNABLE;
+        if (prev != rq->idle) {
+            enqueue(rq, prev);
+        }
+    } else if (prev->state == THREAD_DEAD) {
+        rq->dead = prev;
+    }
+
+    next = dequeue(rq);
+    next->state = THREAD_RUNNING;
+    prev->runtime_ns += now - rq->switched_at;
+    rq->switched_at = now;
+    rq->current = next;
+    rq->need_resched = 0;
+    rq->slice_end = now + slice_ns[next->priority];
+    rotate = next != rq->idle && best_queued(rq) <= next->priority;
+    spin_unlock(&rq->lock);
+
+    if (rotate) {
+        arm_slice(rq, now);
+    }
+    if (next != prev) {
+        rq->switches++;
+        next->switches++;
+        context_switch(&prev->esp, next->esp);
+        finish_switch(rq);
+    }
+}
+
+/* Switch now if this CPU has been asked to and the caller allows it */
+static void preempt_point(uint32_t flags) {
+    run_queue_t *rq = this_rq();
+
+    if ((flags & CPU_EFLAGS_IF) && rq->running && rq->need_resched) {
+        schedule();
+    }
+}
+
+static void thread_start(void) {
+    run_queue_t *rq = this_rq();
+    thread_t *self = rq->current;
+
+    finish_switch(rq);
+    __asm__ volatile ("sti");
+    self->entry(self->arg);
+    thread_exit();
+}
+
+/* Claim a slot; with a stack, lay out a frame context_switch can resume */
+static thread_t *thread_alloc(const char *name, void (*entry)(void *), void *arg,
+                              int priority, int cpu, int with_stack) {
+    thread_t *thread = 0;
+    uint32_t flags = write_lock_irqsave(&threads_lock);
+
+    for (int i = 0; i < SCHED_MAX_THREADS; i++) {
+        if (threads[i].state == THREAD_FREE) {
+            thread = &threads[i];
+            break;
+        }
+    }
+    if (thread == 0) {
+        write_unlock_irqrestore(&threads_lock, flags);
+        return 0;
+    }
+
+    thread->state = THREAD_BLOCKED;
+    thread->id = next_id++;
+    strncpy(thread->name, name, THREAD_NAME_LEN - 1);
+    thread->name[THREAD_NAME_LEN - 1] = '\0';
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->priority = priority;
+    thread->cpu = cpu;
+    thread->wake_at = SCHED_FOREVER;
+    thread->waiting_on = 0;
+    thread->wake_pending = 0;
+    thread->runtime_ns = 0;
+    thread->switches = 0;
+    thread->run_next = 0;
+    thread->wait_next = 0;
+    thread->esp = 0;
+    write_unlock_irqrestore(&threads_lock, flags);
+
+    if (with_stack) {
+        uint32_t *sp = (uint32_t *)(thread_stacks[thread - threads] + THREAD_STACK_SIZE);
+
+        *--sp = 0;                          /* Return address; never used */
+        *--sp = (uint32_t)thread_start;     /* Entered by context_switch's ret */
+        for (int i = 0; i < 4; i++) {
+            *--sp = 0;                      /* ebp, ebx, esi, edi */
+        }
+        thread->esp = (uint32_t)sp;
+    }
+    return thread;
+}
+
+static void idle_loop(void *arg) {
+    run_queue_t *rq = this_rq();
+
+    (void)arg;
+    while (1) {
+        __asm__ volatile ("cli");
+        if (best_queued(rq) < SCHED_PRIORITY_IDLE) {
+            schedule();
+            __asm__ volatile ("sti");
+        } else {
+            cpu_sti_hlt();
+        }
+    }
+}
+
+/* Adopt the code running now as thread current on this CPU */
+static void start_cpu(thread_t *current, thread_t *idle) {
+    run_queue_t *rq = this_rq();
+
+    rq->lock.stats = LOCK_STATS_REF(&run_queue_stats);
+    current->state = THREAD_RUNNING;
+    rq->current = current;
+    rq->idle = idle;
+    rq->switched_at = clock_ns();
+    rq->slice_end = rq->switched_at + slice_ns[current->priority];
+    rq->running = 1;
+}
+
+void sched_init(void) {
+    thread_t *main = thread_alloc("main", 0, 0, SCHED_PRIORITY_NORMAL, 0, 0);
+    thread_t *idle = thread_alloc("idle0", idle_loop, 0, SCHED_PRIORITY_IDLE, 0, 1);
+
+    idle->state = THREAD_RUNNABLE;
+    start_cpu(main, idle);
+}
+
+void sched_idle_cpu(void) {
+    char name[THREAD_NAME_LEN];
+    int cpu = smp_cpu_index();
+    thread_t *idle;
+
+    ksnprintf(name, sizeof(name), "idle%d", cpu);
+    idle = thread_alloc(name, idle_loop, 0, SCHED_PRIORITY_IDLE, cpu, 0);
+    if (idle == 0) {
+        while (1) {
+            cpu_sti_hlt();
+        }
+    }
+    start_cpu(idle, idle);
+    idle_loop(0);
+    while (1) {
+    }
+}
+
+int sched_is_running(void) {
+    return this_rq()->running;
+}
+
+int sched_can_block(void) {
+    run_queue_t *rq = this_rq();
+
+    return rq->running && rq->current != rq->idle && cpu_irqs_enabled();
+}
+
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg, int priority, int cpu) {
+    thread_t *thread;
+
+    if (entry == 0 || priority < 0 || priority >= SCHED_PRIORITY_IDLE) {
+        return 0;
+    }
+    if (cpu < 0 || cpu >= SMP_MAX_CPUS || !percpu_of(cpu)->online) {
+        cpu = smp_cpu_index();
+    }
+
+    thread = thread_alloc(name, entry, arg, priority, cpu, 1);
+    if (thread != 0) {
+        thread_wake(thread);
+    }
+    return thread;
+}
+
+thread_t *thread_current(void) {
+    run_queue_t *rq = this_rq();
+
+    return rq->running ? rq->current : 0;
+}
+
+void thread_exit(void) {
+    run_queue_t *rq = this_rq();
+
+    __asm__ volatile ("cli");
+    spin_lock(&rq->lock);
+    rq->current->state = THREAD_DEAD;
+    spin_unlock(&rq->lock);
+    schedule();
+
+    /* A dead thread is never picked again */
+    while (1) {
+        cpu_sti_hlt();
+    }
+}
+
+void sched_yield(void) {
+    uint32_t flags;
+
+    if (!sched_can_block()) {
+        return;
+    }
+    flags = cpu_irq_save();
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+void sched_sleep_until(uint64_t deadline_ns) {
+    run_queue_t *rq = this_rq();
+    uint32_t flags;
+
+    if (!rq->running || rq->current == rq->idle || deadline_ns <= clock_ns()) {
+        return;
+    }
+
+    flags = cpu_irq_save();
+    spin_lock(&rq->lock);
+    if (rq->current->wake_pending) {
+        rq->current->wake_pending = 0;
+        spin_unlock(&rq->lock);
+        cpu_irq_restore(flags);
+        return;
+    }
+    rq->current->wake_at = deadline_ns;
+    rq->current->state = THREAD_BLOCKED;
+    spin_unlock(&rq->lock);
+
+    if (deadline_ns != SCHED_FOREVER) {
+        write_seqlock(&sleep_lock);
+        if (deadline_ns < next_wake) {
+            next_wake = deadline_ns;
+        }
+        write_sequnlock(&sleep_lock);
+        timer_wake_at(deadline_ns);
+    }
+
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+void thread_clear_wake(void) {
+    run_queue_t *rq = this_rq();
+    uint32_t flags;
+
+    if (!rq->running) {
+        return;
+    }
+
+    flags = cpu_irq_save();
+    spin_lock(&rq->lock);
+    rq->current->wake_pending = 0;
+    spin_unlock(&rq->lock);
+    cpu_irq_restore(flags);
+}
+
+/* Make thread runnable on its queue (rq locked, thread blocked);
+   returns non-zero if its CPU should be kicked to switch to it */
+static int wake_locked(run_queue_t *rq, thread_t *thread) {
+    thread->state = THREAD_RUNNABLE;
+    thread->wake_at = SCHED_FOREVER;
+    thread->waiting_on = 0;
+    enqueue(rq, thread);
+
+    if (rq->running && thread->priority < rq->current->priority) {
+        rq->need_resched = 1;
+        return thread->cpu != smp_cpu_index();
+    }
+    return 0;
+}
+
+static void wake(thread_t *thread, int from_queue) {
+    run_queue_t *rq = &run_queues[thread->cpu];
+    uint32_t flags = cpu_irq_save();
+    int kick = 0;
+
+    spin_lock(&rq->lock);
+    if (thread->state == THREAD_BLOCKED && (from_queue || thread->waiting_on == 0)) {
+        kick = wake_locked(rq, thread);
+    } else if (!from_queue && (thread->state == THREAD_RUNNING || thread->state == THREAD_RUNNABLE)) {
+        thread->wake_pending = 1;
+    }
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        smp_kick(thread->cpu);
+    }
+    preempt_point(flags);
+    cpu_irq_restore(flags);
+}
+
+void thread_wake(thread_t *thread) {
+    wake(thread, 0);
+}
+
+/* Wake every thread whose sleep has ended (CPU 0, interrupts off) */
+static void wake_sleepers(uint64_t now) {
+    uint64_t earliest = SCHED_FOREVER;
+    uint64_t due;
+    uint32_t seq;
+
+    /* Other CPUs may be halfway through storing it */
+    do {
+        seq = read_seqbegin(&sleep_lock);
+        due = next_wake;
+    } while (read_seqretry(&sleep_lock, seq));
+    if (now < due) {
+        return;
+    }
+
+    write_seqlock(&sleep_lock);
+    next_wake = SCHED_FOREVER;
+    write_sequnlock(&sleep_lock);
+
+    for (int i = 0; i < SCHED_MAX_THREADS; i++) {
+        thread_t *thread = &threads[i];
+        run_queue_t *rq;
+        int kick = 0;
+
+        if (thread->state != THREAD_BLOCKED) {
+            continue;
+        }
+
+        rq = &run_queues[thread->cpu];
+        spin_lock(&rq->lock);
+        if (thread->state == THREAD_BLOCKED && thread->waiting_on == 0) {
+            if (thread->wake_at <= now) {
+                kick = wake_locked(rq, thread);
+            } else if (thread->wake_at < earliest) {
+                earliest = thread->wake_at;
+            }
+        }
+        spin_unlock(&rq->lock);
+
+        if (kick) {
+            smp_kick(thread->cpu);
+        }
+    }
+
+    write_seqlock(&sleep_lock);
+    if (earliest < next_wake) {
+        next_wake = earliest;
+    }
+    write_sequnlock(&sleep_lock);
+}
+
+void sched_irq_exit(void) {
+    run_queue_t *rq = this_rq();
+    uint64_t now;
+
+    if (!rq->running) {
+        return;
+    }
+
+    now = clock_ns();
+    if (smp_cpu_index() == 0) {
+        wake_sleepers(now);
+    }
+
+    /* Another thread is waiting its turn: rotate once the slice is up */
+    if (!rq->need_resched && rq->current != rq->idle &&
+        best_queued(rq) <= rq->current->priority) {
+        if (now >= rq->slice_end) {
+            rq->need_resched = 1;
+        } else {
+            arm_slice(rq, now);
+        }
+    }
+    if (rq->need_resched) {
+        schedule();
+    }
+}
+
+int sched_thread_info(int index, thread_t *out) {
+    uint32_t flags;
+    int result = -1;
+
+    if (index < 0 || index >= SCHED_MAX_THREADS) {
+        return -1;
+    }
+
+    flags = read_lock_irqsave(&threads_lock);
+    if (threads[index].state != THREAD_FREE) {
+        *out = threads[index];
+        result = 0;
+    }
+    read_unlock_irqrestore(&threads_lock, flags);
+    return result;
+}
+
+uint32_t sched_switches(int cpu) {
+    return (cpu >= 0 && cpu < SMP_MAX_CPUS) ? run_queues[cpu].switches : 0;
+}
+
+uint32_t wait_lock(wait_queue_t *wq) {
+    uint32_t flags = cpu_irq_save();
+
+    spin_lock(&wq->lock);
+    return flags;
+}
+
+void wait_unlock(wait_queue_t *wq, uint32_t flags) {
+    spin_unlock(&wq->lock);
+    cpu_irq_restore(flags);
+}
+
+void wait_sleep_locked(wait_queue_t *wq, uint32_t flags) {
+    run_queue_t *rq = this_rq();
+    thread_t *self;
+
+    /* Nothing to switch to yet: let the caller poll */
+    if (!rq->running || rq->current == rq->idle) {
+        wait_unlock(wq, flags);
+        cpu_pause();
+        return;
+    }
+
+    self = rq->current;
+    self->wait_next = 0;
+    if (wq->tail) {
+        wq->tail->wait_next = self;
+    } else {
+        wq->head = self;
+    }
+    wq->tail = self;
+
+    spin_lock(&rq->lock);
+    self->wake_at = SCHED_FOREVER;
+    self->waiting_on = wq;
+    self->state = THREAD_BLOCKED;
+    spin_unlock(&rq->lock);
+
+    spin_unlock(&wq->lock);
+    schedule();
+    cpu_irq_restore(flags);
+}
+
+void wake_up_all(wait_queue_t *wq) {
+    uint32_t flags = wait_lock(wq);
+    thread_t *thread = wq->head;
+
+    wq->head = 0;
+    wq->tail = 0;
+    spin_unlock(&wq->lock);
+
+    while (thread) {
+        thread_t *next = thread->wait_next;
+
+        wake(thread, 1);
+        thread = next;
+    }
+    preempt_point(flags);
+    cpu_irq_restore(flags);
+}
+
+void mutex_lock(mutex_t *mutex) {
+    wait_event(&mutex->waiters, __atomic_exchange_n(&mutex->locked, 1, __ATOMIC_ACQUIRE) == 0);
+}
+
+int mutex_trylock(mutex_t *mutex) {
+    return __atomic_exchange_n(&mutex->locked, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    __atomic_store_n(&mutex->locked, 0, __ATOMIC_RELEASE);
+    wake_up_all(&mutex->waiters);
+}
@@ -4,18 +4,42 @@
  */
 
 #include "shell.h"
+#include "complete.h"
+#include "fs.h"
+#include "history.h"
+#include "clock.h"
+#include "timer_wheel.h"
 #include "program.h"
 #include "vga.h"
 #include "keyboard.h"
 #include "string.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "sched.h"
 
 #define INPUT_BUFFER_SIZE 256
 #define MAX_ARGS 16
-#define HISTORY_SIZE 10
 
-/* Command history */
-static char history[HISTORY_SIZE][INPUT_BUFFER_SIZE];
-static int history_count = 0;
+/* History is written back after this many new commands, or once the
+   oldest unsaved one is this old, not per command */
+#define HISTORY_FILE          "/.history"
+#define HISTORY_SAVE_BATCH    8
+#define HISTORY_SAVE_DELAY_NS (30ull * 1000000000u)
+
+/* How soon a timed save tries again when a session holds shell_lock */
+#define HISTORY_RETRY_NS      (1ull * 1000000000u)
+
+/* Each virtual console runs its own shell in its own thread; console 0
+   keeps the boot thread. The fs and the VGA output console are not
+   reentrant, so a session holds shell_lock except while it waits for
+   a key. */
+static mutex_t shell_lock = MUTEX_INIT;
+
+/* Command history, shared by every session */
+static history_t history;
+static int history_unsaved = 0;
+static int history_timer = -1;
+static char history_file[FS_READ_BUFFER_SIZE];
 
 /* Parse input into argc/argv */
 static int parse_args(char *input, char *argv[], int max_args) {
@@ -43,16 +67,37 @@ static int parse_args(char *input, char *argv[], int max_args) {
     return argc;
 }
 
+/* Runs on the shared timer thread, so it must not wait out a command
+   holding shell_lock: if a session has it, try again a little later */
+static void history_save_timer(void *arg) {
+    (void)arg;
+    if (!mutex_trylock(&shell_lock)) {
+        history_timer = timer_add(clock_ns() + HISTORY_RETRY_NS, history_save_timer, 0);
+        return;
+    }
+    history_timer = -1;
+    shell_history_save();
+    mutex_unlock(&shell_lock);
+}
+
 /* Add command to history */
 static void history_add(const char *cmd) {
-    if (history_count < HISTORY_SIZE) {
-        strcpy(history[history_count++], cmd);
-    } else {
-        /* Shift everything up */
-        for (int i = 0; i < HISTORY_SIZE - 1; i++) {
-            strcpy(history[i], history[i + 1]);
-        }
-        strcpy(history[HISTORY_SIZE - 1], cmd);
+    history_append(&history, cmd);
+    if (++history_unsaved >= HISTORY_SAVE_BATCH) {
+        shell_history_save();
+    } else if (history_timer < 0) {
+        history_timer = timer_add(clock_ns() + HISTORY_SAVE_DELAY_NS, history_save_timer, 0);
+    }
+}
+
+static void history_restore(void) {
+    uint32_t size = 0;
+
+    history_reset(&history);
+    history_unsaved = 0;
+    if (fs_is_ready() &&
+        fs_read_file(HISTORY_FILE, (uint8_t *)history_file, sizeof(history_file), &size) == 0) {
+        history_load(&history, history_file, size);
     }
 }
 
@@ -67,18 +112,49 @@ static void print_prompt(void) {
 /* ============ Shell Main Loop ============ */
 
 size_t shell_history_count(void) {
-    return (size_t)history_count;
+    return history_count(&history);
 }
 
 const char *shell_history_entry(size_t index) {
-    if (index >= (size_t)history_count) {
+    return history_entry(&history, index);
+}
+
+int shell_history_find(const char *needle, size_t needle_len, int before) {
+    return history_find(&history, needle, needle_len, before);
+}
+
+int shell_history_save(void) {
+    size_t size;
+
+    if (history_unsaved == 0) {
         return 0;
     }
+    if (!fs_is_ready()) {
+        return -1;
+    }
+
+    size = history_save(&history, history_file, sizeof(history_file));
+    if (fs_write_file(HISTORY_FILE, (const uint8_t *)history_file, (uint32_t)size) != 0) {
+        return -1;
+    }
 
-    return history[index];
+    history_unsaved = 0;
+    if (history_timer >= 0) {
+        timer_cancel(history_timer);
+        history_timer = -1;
+    }
+    return 0;
 }
 
-void shell_run(void) {
+int shell_complete(char *buffer, int *len, int *pos, int max_len, int list) {
+    if (complete_line(buffer, len, pos, max_len, list)) {
+        print_prompt();
+        return 1;
+    }
+    return 0;
+}
+
+static void shell_session(void) {
     char input[INPUT_BUFFER_SIZE];
     char *argv[MAX_ARGS];
 
@@ -119,3 +195,41 @@ void shell_run(void) {
         (void)len;
     }
 }
+
+static void session_enter(int console) {
+    mutex_lock(&shell_lock);
+    vga_set_output_console(console);
+}
+
+static void session_leave(void) {
+    mutex_unlock(&shell_lock);
+}
+
+/* Waiting for a key: let the other sessions run until input arrives */
+static void session_idle(uint32_t seen) {
+    int console = vga_get_output_console();
+
+    session_leave();
+    keyboard_wait_input(seen);
+    session_enter(console);
+}
+
+static void session_thread(void *arg) {
+    session_enter((int)(uintptr_t)arg);
+    shell_session();
+}
+
+void shell_run(void) {
+    session_enter(0);
+    history_restore();
+    keyboard_set_idle_handler(session_idle);
+
+    for (int console = 1; console < VGA_CONSOLES; console++) {
+        char name[THREAD_NAME_LEN];
+
+        ksnprintf(name, sizeof(name), "shell%d", console);
+        thread_create(name, session_thread, (void *)(uintptr_t)console, SCHED_PRIORITY_NORMAL, 0);
+    }
+
+    shell_session();
+}
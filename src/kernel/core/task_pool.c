@@ -0,0 +1,182 @@
+/*
+ * MelonOS - Task Pool
+ * Worker threads over per-CPU Chase-Lev deques (lib/task_deque.c): each
+ * CPU runs its own newest work first and steals the oldest of others'
+ */
+
+#include "task_pool.h"
+#include "task_deque.h"
+#include "atomic.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "sched.h"
+#include "smp.h"
+
+/* Slices parallel_for aims for per CPU taking part */
+#define PARALLEL_CHUNKS_PER_CPU 4
+
+typedef struct {
+    task_t task;
+    uint32_t begin;
+    uint32_t end;
+    parallel_body_t body;
+    void *arg;
+} parallel_chunk_t;
+
+/* Each CPU owns one deque; threads on a CPU take turns as its owner */
+static task_deque_t deques[SMP_MAX_CPUS];
+static int worker_count = 0;
+
+/* Idle workers sleep here until work_seq moves */
+static wait_queue_t work_wait = WAIT_QUEUE_INIT;
+static atomic_t work_seq = ATOMIC_INIT(0);
+
+/* This CPU's own work first, then the other CPUs' in turn; runs what it
+   finds and returns 0 if there was nothing */
+static int run_one(void) {
+    int self = smp_cpu_index();
+    task_deque_t *dq = &deques[self];
+    uint32_t flags = cpu_irq_save();
+    task_t *task = task_deque_pop(dq);
+
+    cpu_irq_restore(flags);
+    if (task == 0) {
+        for (int i = 1; i < SMP_MAX_CPUS && task == 0; i++) {
+            int victim = (self + i) % SMP_MAX_CPUS;
+
+            if (percpu_of(victim)->online) {
+                task = task_deque_steal(&deques[victim]);
+            }
+        }
+        if (task == 0) {
+            return 0;
+        }
+        dq->stolen++;
+    }
+
+    task_run(dq, task);
+    return 1;
+}
+
+static void worker_main(void *arg) {
+    (void)arg;
+
+    while (1) {
+        int32_t seen = atomic_read(&work_seq);
+
+        if (!run_one()) {
+            wait_event(&work_wait, atomic_read(&work_seq) != seen);
+        }
+    }
+}
+
+static void notify_workers(void) {
+    if (worker_count > 0) {
+        atomic_inc(&work_seq);
+        wake_up_all(&work_wait);
+    }
+}
+
+int task_pool_init(void) {
+    if (worker_count > 0) {
+        return worker_count;
+    }
+
+    for (int cpu = 1; cpu < SMP_MAX_CPUS; cpu++) {
+        char name[THREAD_NAME_LEN];
+
+        if (!percpu_of(cpu)->online) {
+            continue;
+        }
+        ksnprintf(name, sizeof(name), "worker%d", cpu);
+        if (thread_create(name, worker_main, 0, SCHED_PRIORITY_NORMAL, cpu) != 0) {
+            worker_count++;
+        }
+    }
+    return worker_count;
+}
+
+int task_pool_workers(void) {
+    return worker_count;
+}
+
+/* Queue without waking anyone; returns -1 if the task already ran */
+static int queue_task(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg) {
+    task_deque_t *dq = worker_count > 0 ? &deques[smp_cpu_index()] : 0;
+
+    return task_queue(dq, group, task, fn, arg);
+}
+
+void task_spawn(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg) {
+    if (queue_task(group, task, fn, arg) == 0) {
+        notify_workers();
+    }
+}
+
+void task_wait(task_group_t *group) {
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!run_one()) {
+            /* The rest is running elsewhere */
+            sched_yield();
+            cpu_pause();
+        }
+    }
+}
+
+static void run_chunk(void *arg) {
+    parallel_chunk_t *chunk = arg;
+
+    chunk->body(chunk->begin, chunk->end, chunk->arg);
+}
+
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, parallel_body_t body, void *arg) {
+    parallel_chunk_t chunks[PARALLEL_MAX_CHUNKS];
+    uint32_t bounds[PARALLEL_MAX_CHUNKS + 1];
+    task_group_t group = TASK_GROUP_INIT;
+    uint32_t max_slices = ((uint32_t)worker_count + 1) * PARALLEL_CHUNKS_PER_CPU;
+    uint32_t count;
+    int queued = 0;
+
+    if (begin >= end || body == 0) {
+        return;
+    }
+
+    /* A few slices per CPU so a CPU that finishes early can steal more;
+       without workers the whole range runs here */
+    if (max_slices > PARALLEL_MAX_CHUNKS) {
+        max_slices = PARALLEL_MAX_CHUNKS;
+    }
+    count = parallel_slices(begin, end, grain, max_slices, bounds);
+    if (count <= 1 || worker_count == 0) {
+        body(begin, end, arg);
+        return;
+    }
+
+    /* The caller keeps the first slice and queues the rest */
+    for (uint32_t i = 0; i < count; i++) {
+        parallel_chunk_t *chunk = &chunks[i];
+
+        chunk->begin = bounds[i];
+        chunk->end = bounds[i + 1];
+        chunk->body = body;
+        chunk->arg = arg;
+
+        if (i > 0 && queue_task(&group, &chunk->task, run_chunk, chunk) == 0) {
+            queued = 1;
+        }
+    }
+    if (queued) {
+        notify_workers();
+    }
+
+    body(chunks[0].begin, chunks[0].end, arg);
+    task_wait(&group);
+}
+
+uint32_t task_pool_executed(int cpu) {
+    return (cpu >= 0 && cpu < SMP_MAX_CPUS) ? deques[cpu].executed : 0;
+}
+
+uint32_t task_pool_stolen(int cpu) {
+    return (cpu >= 0 && cpu < SMP_MAX_CPUS) ? deques[cpu].stolen : 0;
+}
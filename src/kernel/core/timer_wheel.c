@@ -0,0 +1,299 @@
+/*
+ * MelonOS - Software Timers
+ * Hashed timing wheel: a timer sits in slot (expiry % slots), so adding
+ * and cancelling are a list insert and unlink
+ */
+
+#include "timer_wheel.h"
+#include "clock.h"
+#include "cpu.h"
+#include "math64.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define NO_EXPIRY  0xFFFFFFFFFFFFFFFFull
+
+_Static_assert((TIMER_WHEEL_SLOTS & WHEEL_MASK) == 0, "slot count must be a power of two");
+_Static_assert(TIMER_POOL_SIZE <= 256, "pool index must fit in the id's low byte");
+
+typedef struct timer_entry {
+    struct timer_entry *next;
+    struct timer_entry **pprev;   /* The link pointing at this entry */
+    uint64_t expires;             /* Wheel tick */
+    timer_callback_t callback;
+    void *arg;
+    uint16_t generation;          /* Bumped on every reuse; part of the id */
+    uint8_t active;
+} timer_entry_t;
+
+DEFINE_LOCK_STATS(wheel_stats, "timer wheel");
+
+/* Guards everything below; timers are added from any CPU and from IRQs */
+static spinlock_t wheel_lock = SPINLOCK_INIT_STATS(&wheel_stats);
+
+static timer_entry_t pool[TIMER_POOL_SIZE];
+static timer_entry_t *free_list;
+static timer_entry_t *wheel[TIMER_WHEEL_SLOTS];
+static int pool_ready = 0;
+static int pending = 0;
+static int running = 0;
+
+/* Every slot up to and including this tick has been scanned */
+static uint64_t processed_tick = 0;
+
+/* No timer expires before this tick; may be early after a cancel */
+static uint64_t next_expiry = NO_EXPIRY;
+
+/* Tick of the last wakeup asked of the hardware timer */
+static uint64_t armed_tick = 0;
+
+/* Runs the callbacks; woken early when a sooner timer is added */
+static thread_t *timer_thread = 0;
+
+static uint64_t current_tick(void) {
+    return div64_u32(clock_ns(), TIMER_WHEEL_TICK_NS, 0);
+}
+
+static void pool_init(void) {
+    free_list = 0;
+    for (int i = TIMER_POOL_SIZE - 1; i >= 0; i--) {
+        pool[i].next = free_list;
+        pool[i].active = 0;
+        free_list = &pool[i];
+    }
+    processed_tick = current_tick();
+    pool_ready = 1;
+}
+
+static void unlink_entry(timer_entry_t *entry) {
+    *entry->pprev = entry->next;
+    if (entry->next) {
+        entry->next->pprev = entry->pprev;
+    }
+}
+
+static void release_entry(timer_entry_t *entry) {
+    entry->active = 0;
+    entry->generation++;
+    entry->next = free_list;
+    free_list = entry;
+    pending--;
+}
+
+/* Whether a wakeup at the given wheel tick must be asked for, because
+   none at or before it is still to come (wheel_lock held) */
+static int wakeup_needed(uint64_t tick) {
+    return !(armed_tick > current_tick() && armed_tick <= tick);
+}
+
+/* Ask the timer for an interrupt at the given wheel tick. Called after
+   dropping wheel_lock: from another CPU this waits on CPU 0, which may
+   be spinning on the lock. */
+static void request_wakeup(uint64_t tick) {
+    if (timer_wake_at(tick * TIMER_WHEEL_TICK_NS) == 0) {
+        uint32_t flags = spin_lock_irqsave(&wheel_lock);
+
+        /* Remember the earliest wakeup still to come */
+        if (armed_tick <= current_tick() || tick < armed_tick) {
+            armed_tick = tick;
+        }
+        spin_unlock_irqrestore(&wheel_lock, flags);
+    }
+}
+
+int timer_add(uint64_t deadline_ns, timer_callback_t callback, void *arg) {
+    timer_entry_t *entry;
+    uint64_t expires;
+    uint64_t slot_tick;
+    uint32_t flags;
+    uint32_t rem;
+    int wake = 0;
+    int id;
+
+    if (callback == 0) {
+        return -1;
+    }
+
+    flags = spin_lock_irqsave(&wheel_lock);
+    if (!pool_ready) {
+        pool_init();
+    }
+    if (free_list == 0) {
+        spin_unlock_irqrestore(&wheel_lock, flags);
+        return -1;
+    }
+
+    entry = free_list;
+    free_list = entry->next;
+
+    /* Round up: the callback must not run before its deadline */
+    expires = div64_u32(deadline_ns, TIMER_WHEEL_TICK_NS, &rem);
+    if (rem != 0) {
+        expires++;
+    }
+
+    /* A deadline already behind the scan goes in the next slot to be
+       scanned rather than waiting a full turn */
+    slot_tick = expires > processed_tick ? expires : processed_tick + 1;
+
+    entry->expires = expires;
+    entry->callback = callback;
+    entry->arg = arg;
+    entry->active = 1;
+    entry->next = wheel[slot_tick & WHEEL_MASK];
+    entry->pprev = &wheel[slot_tick & WHEEL_MASK];
+    if (entry->next) {
+        entry->next->pprev = &entry->next;
+    }
+    *entry->pprev = entry;
+    pending++;
+
+    if (expires < next_expiry) {
+        next_expiry = expires;
+        wake = 1;
+    }
+
+    id = (int)((uint32_t)entry->generation << 8 | (uint32_t)(entry - pool));
+    wake = wake && wakeup_needed(expires);
+    spin_unlock_irqrestore(&wheel_lock, flags);
+
+    if (wake) {
+        request_wakeup(expires);
+        if (timer_thread) {
+            thread_wake(timer_thread);
+        }
+    }
+    return id;
+}
+
+int timer_cancel(int id) {
+    timer_entry_t *entry;
+    uint32_t flags;
+    int result = -1;
+
+    if (id < 0 || (id & 0xFF) >= TIMER_POOL_SIZE) {
+        return -1;
+    }
+    entry = &pool[id & 0xFF];
+
+    flags = spin_lock_irqsave(&wheel_lock);
+    if (entry->active && entry->generation == (uint16_t)(id >> 8)) {
+        unlink_entry(entry);
+        release_entry(entry);
+        result = 0;
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return result;
+}
+
+void timer_run_expired(void) {
+    timer_entry_t *due = 0;
+    uint64_t now;
+    uint64_t tick;
+    uint64_t last;
+    uint64_t wakeup = NO_EXPIRY;
+    uint32_t flags;
+
+    if (running || !pool_ready) {
+        return;
+    }
+    running = 1;
+
+    flags = spin_lock_irqsave(&wheel_lock);
+    now = current_tick();
+
+    /* Scan each slot passed since last time, one turn at most; entries
+       still rounds away stay where they are. The slot after the last
+       one scanned is always looked at, as timer_add puts overdue timers
+       there and they are due even before the clock reaches it. */
+    tick = now - processed_tick > TIMER_WHEEL_SLOTS ? now - TIMER_WHEEL_SLOTS : processed_tick;
+    last = now > processed_tick ? now : processed_tick + 1;
+    for (tick++; tick <= last; tick++) {
+        timer_entry_t *entry = wheel[tick & WHEEL_MASK];
+
+        while (entry) {
+            timer_entry_t *next = entry->next;
+
+            if (entry->expires <= now) {
+                unlink_entry(entry);
+                entry->active = 0;   /* Too late to cancel from here on */
+                entry->next = due;
+                due = entry;
+            }
+            entry = next;
+        }
+    }
+    if (now > processed_tick) {
+        processed_tick = now;
+    }
+
+    /* Recompute the earliest expiry; the wheel is small enough to walk */
+    next_expiry = NO_EXPIRY;
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+        for (timer_entry_t *entry = wheel[slot]; entry; entry = entry->next) {
+            if (entry->expires < next_expiry) {
+                next_expiry = entry->expires;
+            }
+        }
+    }
+    if (next_expiry != NO_EXPIRY && wakeup_needed(next_expiry)) {
+        wakeup = next_expiry;
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+
+    if (wakeup != NO_EXPIRY) {
+        request_wakeup(wakeup);
+    }
+
+    /* Free each entry before its callback so it can re-arm at once */
+    while (due) {
+        timer_entry_t *entry = due;
+        timer_callback_t callback = entry->callback;
+        void *arg = entry->arg;
+
+        due = entry->next;
+        flags = spin_lock_irqsave(&wheel_lock);
+        release_entry(entry);
+        spin_unlock_irqrestore(&wheel_lock, flags);
+
+        callback(arg);
+    }
+
+    running = 0;
+}
+
+static void timer_thread_main(void *arg) {
+    (void)arg;
+
+    while (1) {
+        uint32_t flags;
+
+        timer_run_expired();
+
+        /* Interrupts stay off from the check until the thread is asleep,
+           so a timer_add from an IRQ in between still wakes it */
+        flags = cpu_irq_save();
+        if (!timer_work_due()) {
+            sched_sleep_until(next_expiry == NO_EXPIRY ? SCHED_FOREVER
+                                                       : next_expiry * TIMER_WHEEL_TICK_NS);
+        }
+        cpu_irq_restore(flags);
+    }
+}
+
+int timer_wheel_start(void) {
+    if (timer_thread == 0) {
+        timer_thread = thread_create("timers", timer_thread_main, 0, SCHED_PRIORITY_HIGH, 0);
+    }
+    return timer_thread ? 0 : -1;
+}
+
+int timer_work_due(void) {
+    return pending > 0 && next_expiry <= current_tick();
+}
+
+int timer_pending_count(void) {
+    return pending;
+}
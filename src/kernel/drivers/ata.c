@@ -5,6 +5,7 @@
 
 #include "ata.h"
 #include "io.h"
+#include "sched.h"
 
 #define ATA_PRIMARY_IO        0x1F0
 #define ATA_PRIMARY_CTRL      0x3F6
@@ -31,8 +32,14 @@
 #define ATA_SR_DRQ            0x08
 #define ATA_SR_ERR            0x01
 
+/* Status polls between offers of the CPU to other threads */
+#define ATA_POLLS_PER_YIELD   64
+
 static int ata_present = 0;
 
+/* One command at a time on the channel, whichever CPU issues it */
+static mutex_t ata_lock = MUTEX_INIT;
+
 static void ata_io_wait(void) {
     io_wait();
     io_wait();
@@ -49,6 +56,9 @@ static int ata_wait_not_busy(void) {
         if ((status & ATA_SR_BSY) == 0) {
             return 0;
         }
+        if ((timeout % ATA_POLLS_PER_YIELD) == 0) {
+            sched_yield();
+        }
     }
 
     return -1;
@@ -69,12 +79,15 @@ static int ata_wait_drq(void) {
         if ((status & ATA_SR_BSY) == 0 && (status & ATA_SR_DRQ) != 0) {
             return 0;
         }
+        if ((timeout % ATA_POLLS_PER_YIELD) == 0) {
+            sched_yield();
+        }
     }
 
     return -1;
 }
 
-int ata_init(void) {
+static int ata_identify(void) {
     uint8_t status;
     uint16_t identify[256];
 
@@ -119,7 +132,7 @@ int ata_init(void) {
     return 0;
 }
 
-int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+static int ata_pio_read(uint32_t lba, uint8_t *buffer) {
     uint16_t *words = (uint16_t *)buffer;
 
     if (!ata_present || buffer == 0 || lba > 0x0FFFFFFF) {
@@ -150,7 +163,7 @@ int ata_read_sector(uint32_t lba, uint8_t *buffer) {
     return 0;
 }
 
-int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+static int ata_pio_write(uint32_t lba, const uint8_t *buffer) {
     const uint16_t *words = (const uint16_t *)buffer;
 
     if (!ata_present || buffer == 0 || lba > 0x0FFFFFFF) {
@@ -184,4 +197,31 @@ int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
 
     ata_io_wait();
     return 0;
-}
\ No newline at end of file
+}
+
+int ata_init(void) {
+    int result;
+
+    mutex_lock(&ata_lock);
+    result = ata_identify();
+    mutex_unlock(&ata_lock);
+    return result;
+}
+
+int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+    int result;
+
+    mutex_lock(&ata_lock);
+    result = ata_pio_read(lba, buffer);
+    mutex_unlock(&ata_lock);
+    return result;
+}
+
+int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+    int result;
+
+    mutex_lock(&ata_lock);
+    result = ata_pio_write(lba, buffer);
+    mutex_unlock(&ata_lock);
+    return result;
+}
@@ -0,0 +1,188 @@
+/*
+ * MelonOS - Monotonic Clock
+ * TSC timekeeping with the rate measured against PIT channel 2
+ */
+
+#include "clock.h"
+#include "cpu.h"
+#include "io.h"
+#include "math64.h"
+#include "sched.h"
+#include "timer.h"
+
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND  0x43
+#define PORT_B       0x61
+
+#define PORT_B_GATE2   0x01  /* Lets channel 2 count */
+#define PORT_B_SPEAKER 0x02
+#define PORT_B_OUT2    0x20  /* Channel 2 output, high once the count ends */
+
+/* Three 10 ms windows; the shortest reading is the one least disturbed
+   by SMIs or the host */
+#define CALIBRATE_COUNT (PIT_FREQUENCY / 100)
+#define CALIBRATE_RUNS  3
+
+/* Sleeps shorter than this spin rather than wait for an interrupt */
+#define CLOCK_SPIN_NS 20000u
+
+/* Give up on a channel 2 that never finishes */
+#define CALIBRATE_LIMIT (1ull << 32)
+
+static int has_tsc = 0;
+static uint32_t tsc_khz = 0;
+static uint64_t tsc_base = 0;
+static uint32_t ns_per_tick = 10000000;
+
+/* cycles -> ns and ns -> cycles as multiply-and-shift pairs */
+static uint32_t ns_mult;
+static uint32_t ns_shift;
+static uint32_t cycles_mult;
+static uint32_t cycles_shift;
+
+/* TSC cycles while channel 2 counts down from count (0 on failure) */
+static uint64_t measure_window(uint16_t count) {
+    uint8_t port_b = inb(PORT_B);
+    uint64_t start;
+    uint64_t end;
+
+    /* Gate on, speaker off; mode 0 raises OUT2 when the count expires */
+    outb(PORT_B, (uint8_t)((port_b & ~PORT_B_SPEAKER) | PORT_B_GATE2));
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)(count >> 8));
+
+    start = cpu_rdtsc();
+    do {
+        end = cpu_rdtsc();
+        if (end - start > CALIBRATE_LIMIT) {
+            end = start;
+            break;
+        }
+    } while (!(inb(PORT_B) & PORT_B_OUT2));
+
+    outb(PORT_B, port_b);
+    return end - start;
+}
+
+void clock_init(void) {
+    cpuid_regs_t regs;
+    uint64_t best = 0;
+    uint32_t flags;
+
+    has_tsc = 0;
+    tsc_khz = 0;
+    if (timer_get_frequency() != 0) {
+        ns_per_tick = 1000000000u / timer_get_frequency();
+    }
+
+    if (!cpu_has_cpuid()) {
+        return;
+    }
+    cpu_cpuid(1, 0, &regs);
+    if (!(regs.edx & CPUID_1_EDX_TSC)) {
+        return;
+    }
+
+    flags = cpu_irq_save();
+    for (int run = 0; run < CALIBRATE_RUNS; run++) {
+        uint64_t cycles = measure_window(CALIBRATE_COUNT);
+
+        if (cycles != 0 && (best == 0 || cycles < best)) {
+            best = cycles;
+        }
+    }
+    cpu_irq_restore(flags);
+
+    /* kHz = cycles / (count / PIT_FREQUENCY seconds) / 1000 */
+    if (best == 0 || best > 0xFFFFFFFFu) {
+        return;
+    }
+    tsc_khz = (uint32_t)div64_u32(best * PIT_FREQUENCY, CALIBRATE_COUNT * 1000u, 0);
+    if (tsc_khz == 0) {
+        return;
+    }
+
+    pick_scale(1000000u, tsc_khz, &ns_mult, &ns_shift);
+    pick_scale(tsc_khz, 1000000u, &cycles_mult, &cycles_shift);
+    tsc_base = cpu_rdtsc();
+    has_tsc = 1;
+}
+
+int clock_has_tsc(void) {
+    return has_tsc;
+}
+
+uint32_t clock_tsc_khz(void) {
+    return tsc_khz;
+}
+
+uint64_t clock_cycles(void) {
+    return has_tsc ? cpu_rdtsc() : 0;
+}
+
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+    return has_tsc ? mul64_u32_shr(cycles, ns_mult, ns_shift) : 0;
+}
+
+uint64_t clock_ns_to_cycles(uint64_t ns) {
+    return has_tsc ? mul64_u32_shr(ns, cycles_mult, cycles_shift) : 0;
+}
+
+uint64_t clock_ns(void) {
+    if (has_tsc) {
+        return clock_cycles_to_ns(cpu_rdtsc() - tsc_base);
+    }
+    return (uint64_t)timer_get_ticks() * ns_per_tick;
+}
+
+/* Tick-based time can be up to a tick behind, so round waits up */
+static uint64_t deadline_after(uint64_t ns) {
+    return clock_ns() + ns + (has_tsc ? 0 : ns_per_tick);
+}
+
+void clock_delay_ns(uint64_t ns) {
+    uint64_t end = deadline_after(ns);
+
+    while (clock_ns() < end) {
+        cpu_pause();
+    }
+}
+
+void clock_sleep_ns(uint64_t ns) {
+    uint64_t end = deadline_after(ns);
+    uint64_t now = clock_ns();
+    int armed = 0;
+
+    /* A thread gives the CPU away for the bulk of the wait. A wakeup
+       meant for some other wait would end the sleep early, so it is
+       dropped first, and the sleep resumes after any that comes later. */
+    if (now < end && end - now > CLOCK_SPIN_NS && sched_can_block()) {
+        thread_clear_wake();
+        do {
+            sched_sleep_until(end - CLOCK_SPIN_NS);
+            now = clock_ns();
+        } while (now < end && end - now > CLOCK_SPIN_NS);
+    }
+
+    /* In one-shot mode nothing else may interrupt before the deadline,
+       so ask for a wakeup; periodic ticks arrive on their own. If no
+       wakeup could be armed (the deadline heap is full), a halt might
+       never end, so spin on the clock instead. */
+    if (now < end && end - now > CLOCK_SPIN_NS && cpu_irqs_enabled() && timer_is_oneshot()) {
+        armed = timer_wake_at(end) == 0;
+    }
+
+    while ((now = clock_ns()) < end) {
+        if (armed || (!timer_is_oneshot() && end - now > ns_per_tick && cpu_irqs_enabled())) {
+            __asm__ volatile ("cli");
+            if (clock_ns() < end) {
+                cpu_sti_hlt();
+            } else {
+                __asm__ volatile ("sti");
+            }
+        } else {
+            cpu_pause();
+        }
+    }
+}
@@ -0,0 +1,303 @@
+/*
+ * MelonOS - Framebuffer Console Backend
+ * Glyph drawing into a linear 8, 15/16, 24 or 32 bpp framebuffer from
+ * Multiboot
+ */
+
+#include "framebuffer.h"
+#include "multiboot.h"
+#include "font.h"
+#include "string.h"
+#include "vga.h"
+
+#define CURSOR_FIRST_ROW (FONT_HEIGHT - 2)
+
+/* Standard VGA palette as 0xRRGGBB */
+static const uint32_t vga_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+static uint8_t *fb_base;
+static uint32_t fb_pitch;
+static uint32_t fb_depth;
+static uint32_t bytes_per_pixel;
+static uint32_t width_px;
+static uint32_t height_px;
+static int cols;
+static int rows;
+static int available;
+
+/* Palette converted to the framebuffer's pixel layout (a palette index
+   on an indexed framebuffer) */
+static uint32_t pixel_color[16];
+
+/* Glyph rows for every character code, rendered once at init */
+static uint8_t glyph_rows[256][FONT_HEIGHT];
+
+/*
+ * Per attribute, the four pixels for each 4-bit slice of a glyph row,
+ * built the first time the attribute is drawn. At 32 bpp a glyph row is
+ * then two lookups and eight 32-bit stores.
+ */
+static uint32_t nibble_pixels[256][16][4];
+static uint8_t nibble_ready[256];
+
+/* What each cell holds, so the cursor can be erased without re-reading
+   the framebuffer */
+static uint16_t cells[CONSOLE_MAX_ROWS * CONSOLE_MAX_COLS];
+static int cursor_col = -1;
+static int cursor_row = -1;
+
+static uint32_t pack_color(uint32_t rgb, const multiboot_info_t *info) {
+    uint32_t r = (rgb >> 16) & 0xFF;
+    uint32_t g = (rgb >> 8) & 0xFF;
+    uint32_t b = rgb & 0xFF;
+
+    return ((r >> (8 - info->red_mask_size)) << info->red_field_position) |
+           ((g >> (8 - info->green_mask_size)) << info->green_field_position) |
+           ((b >> (8 - info->blue_mask_size)) << info->blue_field_position);
+}
+
+/* Closest entry of the loader's palette, by squared RGB distance */
+static uint32_t palette_index(uint32_t rgb, const multiboot_info_t *info) {
+    const uint8_t *entry = (const uint8_t *)(uintptr_t)info->framebuffer_palette_addr;
+    uint32_t best = 0;
+    uint32_t best_distance = 0xFFFFFFFFu;
+
+    for (uint32_t i = 0; i < info->framebuffer_palette_num_colors; i++, entry += 3) {
+        int dr = (int)entry[0] - (int)((rgb >> 16) & 0xFF);
+        int dg = (int)entry[1] - (int)((rgb >> 8) & 0xFF);
+        int db = (int)entry[2] - (int)(rgb & 0xFF);
+        uint32_t distance = (uint32_t)(dr * dr + dg * dg + db * db);
+
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+static inline void store_pixel(uint8_t *dst, uint32_t color) {
+    switch (bytes_per_pixel) {
+    case 4:
+        *(uint32_t *)dst = color;
+        break;
+    case 3:
+        dst[0] = (uint8_t)color;
+        dst[1] = (uint8_t)(color >> 8);
+        dst[2] = (uint8_t)(color >> 16);
+        break;
+    case 2:
+        *(uint16_t *)dst = (uint16_t)color;
+        break;
+    default:
+        *dst = (uint8_t)color;
+        break;
+    }
+}
+
+static const uint32_t (*attr_pixels(uint8_t attr))[4] {
+    if (!nibble_ready[attr]) {
+        uint32_t fg = pixel_color[attr & 0x0F];
+        uint32_t bg = pixel_color[attr >> 4];
+
+        for (int nibble = 0; nibble < 16; nibble++) {
+            for (int bit = 0; bit < 4; bit++) {
+                nibble_pixels[attr][nibble][bit] = (nibble & (8 >> bit)) ? fg : bg;
+            }
+        }
+        nibble_ready[attr] = 1;
+    }
+    return (const uint32_t (*)[4])nibble_pixels[attr];
+}
+
+static inline uint8_t *cell_origin(int col, int row) {
+    return fb_base + (uint32_t)row * FONT_HEIGHT * fb_pitch +
+           (uint32_t)col * FONT_WIDTH * bytes_per_pixel;
+}
+
+static void draw_glyph(int col, int row, uint16_t cell) {
+    const uint32_t (*pixels)[4] = attr_pixels((uint8_t)(cell >> 8));
+    const uint8_t *glyph = glyph_rows[cell & 0xFF];
+    uint8_t *line = cell_origin(col, row);
+
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        const uint32_t *left = pixels[glyph[y] >> 4];
+        const uint32_t *right = pixels[glyph[y] & 0x0F];
+
+        if (bytes_per_pixel == 4) {
+            uint32_t *dst = (uint32_t *)line;
+
+            dst[0] = left[0];
+            dst[1] = left[1];
+            dst[2] = left[2];
+            dst[3] = left[3];
+            dst[4] = right[0];
+            dst[5] = right[1];
+            dst[6] = right[2];
+            dst[7] = right[3];
+        } else {
+            for (int x = 0; x < 4; x++) {
+                store_pixel(line + (uint32_t)x * bytes_per_pixel, left[x]);
+                store_pixel(line + (uint32_t)(x + 4) * bytes_per_pixel, right[x]);
+            }
+        }
+        line += fb_pitch;
+    }
+}
+
+static void draw_cursor_bar(int col, int row) {
+    uint16_t cell = cells[row * CONSOLE_MAX_COLS + col];
+    uint32_t color = pixel_color[(cell >> 8) & 0x0F];
+    uint8_t *line = cell_origin(col, row) + CURSOR_FIRST_ROW * fb_pitch;
+
+    for (int y = CURSOR_FIRST_ROW; y < FONT_HEIGHT; y++) {
+        for (int x = 0; x < FONT_WIDTH; x++) {
+            store_pixel(line + (uint32_t)x * bytes_per_pixel, color);
+        }
+        line += fb_pitch;
+    }
+}
+
+int fb_init(uint32_t magic, uint32_t mboot_addr) {
+    const multiboot_info_t *info = (const multiboot_info_t *)mboot_addr;
+
+    available = 0;
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || info == 0 ||
+        !(info->flags & MULTIBOOT_INFO_FRAMEBUFFER)) {
+        return -1;
+    }
+
+    /* Text mode keeps the VGA text console. A graphics mode must be one
+       of the layouts store_pixel writes, below 4 GiB. */
+    switch (info->framebuffer_type) {
+    case MULTIBOOT_FRAMEBUFFER_RGB:
+        if (info->framebuffer_bpp != 15 && info->framebuffer_bpp != 16 &&
+            info->framebuffer_bpp != 24 && info->framebuffer_bpp != 32) {
+            return -1;
+        }
+        break;
+    case MULTIBOOT_FRAMEBUFFER_INDEXED:
+        if (info->framebuffer_bpp != 8 || info->framebuffer_palette_num_colors == 0) {
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    if ((info->framebuffer_addr >> 32) != 0) {
+        return -1;
+    }
+
+    fb_base = (uint8_t *)(uintptr_t)info->framebuffer_addr;
+    fb_pitch = info->framebuffer_pitch;
+    fb_depth = info->framebuffer_bpp;
+    bytes_per_pixel = (fb_depth + 7) / 8;
+    width_px = info->framebuffer_width;
+    height_px = info->framebuffer_height;
+
+    cols = (int)(width_px / FONT_WIDTH);
+    rows = (int)(height_px / FONT_HEIGHT);
+    if (cols > CONSOLE_MAX_COLS) cols = CONSOLE_MAX_COLS;
+    if (rows > CONSOLE_MAX_ROWS) rows = CONSOLE_MAX_ROWS;
+    if (cols < VGA_WIDTH || rows < VGA_HEIGHT) {
+        return -1;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        pixel_color[i] = info->framebuffer_type == MULTIBOOT_FRAMEBUFFER_INDEXED
+                         ? palette_index(vga_palette[i], info)
+                         : pack_color(vga_palette[i], info);
+    }
+    for (int c = 0; c < 256; c++) {
+        font_render((unsigned char)c, glyph_rows[c]);
+    }
+    memset(nibble_ready, 0, sizeof(nibble_ready));
+    memset(cells, 0, sizeof(cells));
+    cursor_col = -1;
+    cursor_row = -1;
+
+    available = 1;
+    return 0;
+}
+
+int fb_is_available(void) {
+    return available;
+}
+
+uint32_t fb_width(void) {
+    return width_px;
+}
+
+uint32_t fb_height(void) {
+    return height_px;
+}
+
+int fb_cols(void) {
+    return cols;
+}
+
+int fb_rows(void) {
+    return rows;
+}
+
+uint32_t fb_bpp(void) {
+    return fb_depth;
+}
+
+void fb_draw_cell(int col, int row, uint16_t cell) {
+    cells[row * CONSOLE_MAX_COLS + col] = cell;
+    draw_glyph(col, row, cell);
+    if (col == cursor_col && row == cursor_row) {
+        draw_cursor_bar(col, row);
+    }
+}
+
+void fb_scroll(int delta) {
+    uint32_t row_bytes = FONT_HEIGHT * fb_pitch;
+    int kept = rows - (delta < 0 ? -delta : delta);
+
+    if (delta == 0) {
+        return;
+    }
+
+    /* The bar would move with the pixels; take it off first */
+    if (cursor_row >= 0) {
+        draw_glyph(cursor_col, cursor_row, cells[cursor_row * CONSOLE_MAX_COLS + cursor_col]);
+        cursor_col = -1;
+        cursor_row = -1;
+    }
+
+    if (kept <= 0) {
+        return;
+    }
+
+    if (delta > 0) {
+        memmove(fb_base, fb_base + (uint32_t)delta * row_bytes, (uint32_t)kept * row_bytes);
+        memmove(cells, &cells[delta * CONSOLE_MAX_COLS], (size_t)kept * CONSOLE_MAX_COLS * sizeof(cells[0]));
+    } else {
+        memmove(fb_base + (uint32_t)(-delta) * row_bytes, fb_base, (uint32_t)kept * row_bytes);
+        memmove(&cells[-delta * CONSOLE_MAX_COLS], cells, (size_t)kept * CONSOLE_MAX_COLS * sizeof(cells[0]));
+    }
+}
+
+void fb_set_cursor(int col, int row) {
+    if (col == cursor_col && row == cursor_row) {
+        return;
+    }
+
+    if (cursor_row >= 0) {
+        draw_glyph(cursor_col, cursor_row, cells[cursor_row * CONSOLE_MAX_COLS + cursor_col]);
+    }
+
+    cursor_col = col;
+    cursor_row = row;
+    if (row >= 0 && row < rows && col >= 0 && col < cols) {
+        draw_cursor_bar(col, row);
+    } else {
+        cursor_col = -1;
+        cursor_row = -1;
+    }
+}
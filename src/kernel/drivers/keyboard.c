@@ -4,26 +4,78 @@
  */
 
 #include "keyboard.h"
+#include "atomic.h"
+#include "cpu.h"
 #include "idt.h"
+#include "kprintf.h"
+#include "sched.h"
 #include "io.h"
+#include "serial.h"
+#include "spinlock.h"
 #include "shell.h"
 #include "string.h"
+#include "timer.h"
 #include "vga.h"
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
 #define KEY_BUFFER_SIZE 256
+#define SEARCH_MAX_QUERY 64
 
-/* Key buffer (circular) */
-static char key_buffer[KEY_BUFFER_SIZE];
-static volatile int buffer_start = 0;
-static volatile int buffer_end = 0;
+/* Raw events from the IRQ handler; a power of two so the free-running
+   indexes can be masked */
+#define RAW_RING_SIZE 128
 
-/* Shift state */
-static int shift_pressed = 0;
-static int caps_lock = 0;
+/* Translated events waiting for each console's reader */
+#define EVENT_QUEUE_SIZE 64
+
+/*
+ * Single-producer/single-consumer ring. The IRQ handler only records
+ * the scancode and time and publishes the slot with a release store of
+ * raw_head; the reader translates in normal context and hands slots back
+ * with a release store of raw_tail.
+ */
+static key_event_t raw_ring[RAW_RING_SIZE];
+static uint32_t raw_head;   /* Written by the IRQ handler only */
+static uint32_t raw_tail;   /* Written by the reader only */
+static volatile uint32_t raw_dropped;
+
+DEFINE_LOCK_STATS(keyboard_stats, "keyboard queues");
+
+/* Reader side: the raw ring's tail, translation state and the console
+   queues, for readers on any CPU or thread. The IRQ handler never
+   takes it. */
+static spinlock_t reader_lock = SPINLOCK_INIT_STATS(&keyboard_stats);
+
+/* Per-console queues; only touched by readers */
+static key_event_t event_queue[VGA_CONSOLES][EVENT_QUEUE_SIZE];
+static uint32_t queue_head[VGA_CONSOLES];
+static uint32_t queue_tail[VGA_CONSOLES];
+static uint32_t queue_dropped;
+
+/* Console that receives translated keys; follows Alt+Fn */
+static int input_console = 0;
+
+/* Runs while keyboard_getchar waits; halts the CPU if unset */
+static void (*idle_handler)(uint32_t seen) = 0;
+
+/* Readers sleep here until input_seq moves */
+static wait_queue_t input_wait = WAIT_QUEUE_INIT;
+static atomic_t input_seq = ATOMIC_INIT(0);
+
+/* IRQ side: the E0 prefix and Alt, so Alt+Fn can switch the screen
+   without waiting for a reader */
 static int extended_scancode = 0;
+static int hotkey_alt = 0;
+
+/* Reader side modifier state */
+static uint8_t modifiers = 0;
+
+/* Serial terminal input state: 0 idle, 1 after ESC, 2 inside ESC [ */
+static int serial_escape = 0;
+static char serial_param = 0;
+static int serial_last_cr = 0;
 
 /* US keyboard layout scancode -> ASCII (lowercase) */
 static const char scancode_to_ascii[] = {
@@ -73,77 +125,69 @@ static const char scancode_to_ascii_shifted[] = {
     0, 0, 0, 0, 0
 };
 
-static void buffer_push(char c) {
-    int next = (buffer_end + 1) % KEY_BUFFER_SIZE;
-    if (next != buffer_start) {
-        key_buffer[buffer_end] = c;
-        buffer_end = next;
-    }
-}
-
-static char buffer_pop(void) {
-    if (buffer_start == buffer_end) return 0;
-    char c = key_buffer[buffer_start];
-    buffer_start = (buffer_start + 1) % KEY_BUFFER_SIZE;
-    return c;
-}
-
-static void cursor_left_once(void) {
-    int x = vga_get_cursor_x();
-    int y = vga_get_cursor_y();
-
-    if (x > 0) {
-        x--;
-    } else if (y > 0) {
-        y--;
-        x = VGA_WIDTH - 1;
+/*
+ * Input line state. shown mirrors what is on screen, so a refresh
+ * rewrites only the cells from the first difference onwards, with the
+ * cursor moves and text in one vga_write.
+ */
+typedef struct {
+    char *buffer;
+    int len;
+    int pos;
+    int start_col;               /* Screen column of buffer[0] */
+    char shown[KEY_BUFFER_SIZE];
+    int shown_len;
+} line_editor_t;
+
+/* Append the relative CSI moves that take the cursor from offset from
+   to offset to within the (possibly wrapped) input line */
+static int append_move(const line_editor_t *ed, char *out, size_t size, int from, int to) {
+    int width = vga_get_width();
+    int dy = (ed->start_col + to) / width - (ed->start_col + from) / width;
+    int dx = (ed->start_col + to) % width - (ed->start_col + from) % width;
+    int used = 0;
+
+    if (dy != 0) {
+        used += ksnprintf(out + used, size - used, "\x1b[%d%c", dy < 0 ? -dy : dy, dy < 0 ? 'A' : 'B');
     }
-
-    vga_set_cursor(x, y);
-}
-
-static void cursor_right_once(void) {
-    int x = vga_get_cursor_x();
-    int y = vga_get_cursor_y();
-
-    if (x < VGA_WIDTH - 1) {
-        x++;
-    } else if (y < VGA_HEIGHT - 1) {
-        y++;
-        x = 0;
+    if (dx != 0) {
+        used += ksnprintf(out + used, size - used, "\x1b[%d%c", dx < 0 ? -dx : dx, dx < 0 ? 'D' : 'C');
     }
-
-    vga_set_cursor(x, y);
+    return used;
 }
 
-static void redraw_input_line(const char *buffer, int *len, int *pos, int old_len, int target_pos) {
-    while (*pos > 0) {
-        cursor_left_once();
-        (*pos)--;
-    }
+/* Bring the screen in line with the buffer and leave the cursor at
+   target_pos */
+static void editor_refresh(line_editor_t *ed, int target_pos) {
+    char out[2 * KEY_BUFFER_SIZE + 48];
+    int first = 0;
+    int end = ed->len > ed->shown_len ? ed->len : ed->shown_len;
+    int used = 0;
 
-    for (int i = 0; i < *len; i++) {
-        vga_putchar(buffer[i]);
+    while (first < ed->len && first < ed->shown_len && ed->shown[first] == ed->buffer[first]) {
+        first++;
     }
 
-    for (int i = *len; i < old_len; i++) {
-        vga_putchar(' ');
-    }
-
-    int span = old_len;
-    if (*len > span) {
-        span = *len;
-    }
+    if (first < end) {
+        used += append_move(ed, out + used, sizeof(out) - used, ed->pos, first);
+        memcpy(out + used, ed->buffer + first, (size_t)(ed->len - first));
+        used += ed->len - first;
+        if (ed->shown_len > ed->len) {
+            memset(out + used, ' ', (size_t)(ed->shown_len - ed->len));
+            used += ed->shown_len - ed->len;
+        }
+        used += append_move(ed, out + used, sizeof(out) - used, end, target_pos);
 
-    for (int i = 0; i < span; i++) {
-        cursor_left_once();
+        memcpy(ed->shown + first, ed->buffer + first, (size_t)(ed->len - first));
+        ed->shown_len = ed->len;
+    } else {
+        used += append_move(ed, out, sizeof(out), ed->pos, target_pos);
     }
 
-    for (int i = 0; i < target_pos; i++) {
-        cursor_right_once();
+    ed->pos = target_pos;
+    if (used > 0) {
+        vga_write(out, (size_t)used);
     }
-
-    *pos = target_pos;
 }
 
 static int copy_history_entry(char *dst, int max_len, const char *src) {
@@ -156,149 +200,554 @@ static int copy_history_entry(char *dst, int max_len, const char *src) {
     return n;
 }
 
-/* Keyboard IRQ handler */
+/* Something for a reader to look at: new raw input, or events routed
+   to another console's queue */
+static void keyboard_notify(void) {
+    atomic_inc(&input_seq);
+    wake_up_all(&input_wait);
+}
+
+/* Keyboard IRQ handler: record the scancode and get out */
 static void keyboard_handler(registers_t *regs) {
     (void)regs;
 
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+    uint8_t code = scancode & 0x7F;
+    uint8_t flags = 0;
+    uint32_t head = raw_head;
+    key_event_t *event;
 
     if (scancode == 0xE0) {
         extended_scancode = 1;
         return;
     }
 
+    if (scancode & 0x80) {
+        flags |= KEY_EVENT_RELEASE;
+    }
     if (extended_scancode) {
-        /* Extended key release */
-        if (scancode & 0x80) {
-            extended_scancode = 0;
-            return;
+        flags |= KEY_EVENT_EXTENDED;
+        extended_scancode = 0;
+    }
+
+    if (code == 0x38) {
+        hotkey_alt = !(flags & KEY_EVENT_RELEASE);
+    } else if (hotkey_alt && !(flags & KEY_EVENT_RELEASE) &&
+               code >= 0x3B && code < 0x3B + VGA_CONSOLES) {
+        vga_request_console(code - 0x3B);
+    }
+
+    if (head - __atomic_load_n(&raw_tail, __ATOMIC_ACQUIRE) >= RAW_RING_SIZE) {
+        raw_dropped++;
+        return;
+    }
+
+    event = &raw_ring[head & (RAW_RING_SIZE - 1)];
+    event->timestamp = timer_get_ticks();
+    event->scancode = code;
+    event->keycode = 0;
+    event->modifiers = 0;
+    event->flags = flags;
+    __atomic_store_n(&raw_head, head + 1, __ATOMIC_RELEASE);
+    keyboard_notify();
+}
+
+static uint8_t extended_keycode(uint8_t code) {
+    switch (code) {
+        case 0x1C: return '\n';            /* Keypad Enter */
+        case 0x1D: return KEYCODE_CTRL;    /* Right Ctrl */
+        case 0x35: return '/';             /* Keypad / */
+        case 0x38: return KEYCODE_ALT;     /* Right Alt */
+        case 0x47: return KEYCODE_HOME;
+        case 0x48: return KEYCODE_UP;
+        case 0x49: return KEYCODE_PAGE_UP;
+        case 0x4B: return KEYCODE_LEFT;
+        case 0x4D: return KEYCODE_RIGHT;
+        case 0x4F: return KEYCODE_END;
+        case 0x50: return KEYCODE_DOWN;
+        case 0x51: return KEYCODE_PAGE_DOWN;
+        case 0x52: return KEYCODE_INSERT;
+        case 0x53: return KEYCODE_DELETE;
+    }
+    return 0;
+}
+
+static uint8_t base_keycode(uint8_t code) {
+    switch (code) {
+        case 0x01: return 27;               /* Escape */
+        case 0x1D: return KEYCODE_CTRL;
+        case 0x2A:                          /* Left shift */
+        case 0x36: return KEYCODE_SHIFT;    /* Right shift */
+        case 0x38: return KEYCODE_ALT;
+        case 0x3A: return KEYCODE_CAPS_LOCK;
+        case 0x57: return KEYCODE_F11;
+        case 0x58: return KEYCODE_F12;
+    }
+
+    if (code >= 0x3B && code <= 0x44) {
+        return (uint8_t)(KEYCODE_F1 + (code - 0x3B));
+    }
+    if (code < sizeof(scancode_to_ascii)) {
+        return (uint8_t)scancode_to_ascii[code];
+    }
+    return 0;
+}
+
+/* Fill in keycode and modifiers, tracking modifier keys as they pass */
+static void translate_event(key_event_t *event) {
+    int release = event->flags & KEY_EVENT_RELEASE;
+    uint8_t keycode = (event->flags & KEY_EVENT_EXTENDED) ? extended_keycode(event->scancode)
+                                                         : base_keycode(event->scancode);
+    uint8_t bit = 0;
+
+    switch (keycode) {
+        case KEYCODE_SHIFT: bit = KEY_MOD_SHIFT; break;
+        case KEYCODE_CTRL:  bit = KEY_MOD_CTRL; break;
+        case KEYCODE_ALT:   bit = KEY_MOD_ALT; break;
+        case KEYCODE_CAPS_LOCK:
+            if (!release) {
+                modifiers ^= KEY_MOD_CAPS;
+            }
+            break;
+    }
+
+    if (bit) {
+        modifiers = release ? (uint8_t)(modifiers & ~bit) : (uint8_t)(modifiers | bit);
+    }
+
+    event->keycode = keycode;
+    event->modifiers = modifiers;
+}
+
+static void queue_event(int console, const key_event_t *event) {
+    if (queue_head[console] - queue_tail[console] >= EVENT_QUEUE_SIZE) {
+        queue_dropped++;
+        return;
+    }
+    event_queue[console][queue_head[console] & (EVENT_QUEUE_SIZE - 1)] = *event;
+    queue_head[console]++;
+}
+
+/* Translate everything the IRQ handler has published and route it to
+   the console that had input focus at the time (reader_lock held);
+   returns non-zero if anything was queued */
+static int keyboard_pump(void) {
+    uint32_t tail = raw_tail;
+    uint32_t head = __atomic_load_n(&raw_head, __ATOMIC_ACQUIRE);
+    int routed = 0;
+
+    while (tail != head) {
+        key_event_t event = raw_ring[tail & (RAW_RING_SIZE - 1)];
+
+        tail++;
+        __atomic_store_n(&raw_tail, tail, __ATOMIC_RELEASE);
+
+        translate_event(&event);
+        if (event.keycode == 0) {
+            continue;
         }
 
-        switch (scancode) {
-            case 0x48: /* Up arrow */
-                if (shift_pressed) {
-                    buffer_push(KEY_SCROLL_UP);
-                } else {
-                    buffer_push(KEY_HISTORY_PREV);
-                }
-                break;
-            case 0x50: /* Down arrow */
-                if (shift_pressed) {
-                    buffer_push(KEY_SCROLL_DOWN);
-                } else {
-                    buffer_push(KEY_HISTORY_NEXT);
-                }
-                break;
-            case 0x4B: /* Left arrow */
-                buffer_push(KEY_CURSOR_LEFT);
-                break;
-            case 0x4D: /* Right arrow */
-                buffer_push(KEY_CURSOR_RIGHT);
-                break;
-            case 0x49: /* Page up */
-                buffer_push(KEY_SCROLL_PAGE_UP);
-                break;
-            case 0x51: /* Page down */
-                buffer_push(KEY_SCROLL_PAGE_DOWN);
-                break;
-            case 0x53: /* Delete */
-                buffer_push(KEY_DELETE);
-                break;
-            case 0x47: /* Home */
-                buffer_push(KEY_HOME);
-                break;
-            case 0x4F: /* End */
-                buffer_push(KEY_END);
-                break;
-            default:
-                break;
+        if ((event.modifiers & KEY_MOD_ALT) && !(event.flags & KEY_EVENT_RELEASE) &&
+            event.keycode >= KEYCODE_F1 && event.keycode < KEYCODE_F1 + VGA_CONSOLES) {
+            input_console = event.keycode - KEYCODE_F1;
+            continue;
         }
 
-        extended_scancode = 0;
-        return;
+        queue_event(input_console, &event);
+        routed = 1;
+    }
+    return routed;
+}
+
+char keyboard_event_char(const key_event_t *event) {
+    uint8_t keycode = event->keycode;
+    int shift = (event->modifiers & KEY_MOD_SHIFT) != 0;
+
+    if (event->flags & KEY_EVENT_RELEASE) {
+        return 0;
+    }
+    if (keycode == '\n' || keycode == '\b' || keycode == '\t') {
+        return (char)keycode;
+    }
+    if (keycode < ' ' || keycode > '~') {
+        return 0;
     }
 
-    /* Key release (bit 7 set) */
-    if (scancode & 0x80) {
-        uint8_t released = scancode & 0x7F;
-        if (released == 0x2A || released == 0x36) { /* Left/Right shift released */
-            shift_pressed = 0;
+    if (keycode >= 'a' && keycode <= 'z') {
+        if (event->modifiers & KEY_MOD_CAPS) {
+            shift = !shift;
         }
-        return;
+        return (char)(shift ? keycode - 32 : keycode);
     }
 
-    /* Handle special keys */
-    switch (scancode) {
-        case 0x2A: /* Left shift */
-        case 0x36: /* Right shift */
-            shift_pressed = 1;
-            return;
-        case 0x3A: /* Caps lock */
-            caps_lock = !caps_lock;
-            return;
-        case 0x1D: /* Ctrl */
-        case 0x38: /* Alt */
-            return;
+    if (shift && !(event->flags & KEY_EVENT_EXTENDED) &&
+        event->scancode < sizeof(scancode_to_ascii_shifted)) {
+        return scancode_to_ascii_shifted[event->scancode];
     }
+    return (char)keycode;
+}
 
-    if (scancode >= sizeof(scancode_to_ascii)) return;
+/* The line editor's view of an event: editing keys become KEY_ codes */
+static char legacy_char(const key_event_t *event) {
+    int shift = (event->modifiers & KEY_MOD_SHIFT) != 0;
 
-    char c;
-    if (shift_pressed) {
-        c = scancode_to_ascii_shifted[scancode];
-    } else {
-        c = scancode_to_ascii[scancode];
+    if (event->flags & KEY_EVENT_RELEASE) {
+        return 0;
     }
 
-    /* Handle caps lock for letters */
-    if (caps_lock && c >= 'a' && c <= 'z') {
-        c -= 32;
-    } else if (caps_lock && c >= 'A' && c <= 'Z' && !shift_pressed) {
-        /* Already uppercase from shift table, caps lock would make it lower */
+    switch (event->keycode) {
+        case KEYCODE_UP:        return shift ? KEY_SCROLL_UP : KEY_HISTORY_PREV;
+        case KEYCODE_DOWN:      return shift ? KEY_SCROLL_DOWN : KEY_HISTORY_NEXT;
+        case KEYCODE_LEFT:      return KEY_CURSOR_LEFT;
+        case KEYCODE_RIGHT:     return KEY_CURSOR_RIGHT;
+        case KEYCODE_PAGE_UP:   return KEY_SCROLL_PAGE_UP;
+        case KEYCODE_PAGE_DOWN: return KEY_SCROLL_PAGE_DOWN;
+        case KEYCODE_DELETE:    return KEY_DELETE;
+        case KEYCODE_HOME:      return KEY_HOME;
+        case KEYCODE_END:       return KEY_END;
+        case 27:                return KEY_CANCEL;
     }
 
-    if (c != 0) {
-        buffer_push(c);
+    if ((event->modifiers & (KEY_MOD_CTRL | KEY_MOD_ALT)) == KEY_MOD_CTRL) {
+        switch (event->keycode) {
+            case 'r': return KEY_REVERSE_SEARCH;
+            case 'g': return KEY_CANCEL;
+        }
     }
+    return keyboard_event_char(event);
 }
 
 void keyboard_init(void) {
-    buffer_start = 0;
-    buffer_end = 0;
-    shift_pressed = 0;
-    caps_lock = 0;
+    raw_head = 0;
+    raw_tail = 0;
+    raw_dropped = 0;
+    for (int i = 0; i < VGA_CONSOLES; i++) {
+        queue_head[i] = 0;
+        queue_tail[i] = 0;
+    }
+    queue_dropped = 0;
+    input_console = 0;
+    modifiers = 0;
     extended_scancode = 0;
+    hotkey_alt = 0;
 
     /* Install keyboard IRQ handler (IRQ1) */
     irq_install_handler(1, keyboard_handler);
+
+    /* The serial terminal types into console 0 */
+    serial_set_rx_notify(keyboard_notify);
+}
+
+/* Map a byte from the serial terminal onto the PS/2 key codes
+   (returns 0 while inside an escape sequence or for ignored bytes) */
+static char serial_translate(int byte) {
+    int was_cr = serial_last_cr;
+
+    serial_last_cr = (byte == '\r');
+
+    if (serial_escape == 1) {
+        serial_escape = (byte == '[' || byte == 'O') ? 2 : 0;
+        return 0;
+    }
+
+    if (serial_escape == 2) {
+        if (byte >= '0' && byte <= '9') {
+            serial_param = (char)byte;
+            return 0;
+        }
+
+        serial_escape = 0;
+        switch (byte) {
+            case 'A': return KEY_HISTORY_PREV;
+            case 'B': return KEY_HISTORY_NEXT;
+            case 'C': return KEY_CURSOR_RIGHT;
+            case 'D': return KEY_CURSOR_LEFT;
+            case 'H': return KEY_HOME;
+            case 'F': return KEY_END;
+            case '~':
+                switch (serial_param) {
+                    case '1': case '7': return KEY_HOME;
+                    case '4': case '8': return KEY_END;
+                    case '3': return KEY_DELETE;
+                    case '5': return KEY_SCROLL_PAGE_UP;
+                    case '6': return KEY_SCROLL_PAGE_DOWN;
+                }
+                return 0;
+        }
+        return 0;
+    }
+
+    switch (byte) {
+        case 0x1B:
+            serial_escape = 1;
+            serial_param = 0;
+            return 0;
+        case '\r':
+            return '\n';
+        case '\n':
+            return was_cr ? 0 : '\n';  /* CR LF is one Enter */
+        case 0x7F:
+        case '\b':
+            return '\b';
+        case '\t':
+            return '\t';
+        case 0x12:
+            return KEY_REVERSE_SEARCH;
+        case 0x07:
+            return KEY_CANCEL;
+    }
+
+    /* Other control bytes would alias the KEY_ codes */
+    return (byte >= ' ' && byte < 0x7F) ? (char)byte : 0;
+}
+
+int keyboard_pending(int console) {
+    uint32_t flags;
+    int routed;
+    int pending;
+
+    if (console < 0 || console >= VGA_CONSOLES) {
+        return 0;
+    }
+
+    flags = spin_lock_irqsave(&reader_lock);
+    routed = keyboard_pump();
+    pending = queue_head[console] != queue_tail[console];
+    spin_unlock_irqrestore(&reader_lock, flags);
+
+    if (routed) {
+        keyboard_notify();
+    }
+
+    /* The serial terminal types into the first console */
+    return pending || (console == 0 && serial_has_byte());
 }
 
 int keyboard_has_key(void) {
-    return buffer_start != buffer_end;
+    return keyboard_pending(vga_get_output_console());
+}
+
+int keyboard_poll_event(key_event_t *event) {
+    int console = vga_get_output_console();
+    uint32_t flags = spin_lock_irqsave(&reader_lock);
+    int routed = keyboard_pump();
+    int found = queue_head[console] != queue_tail[console];
+
+    if (found) {
+        *event = event_queue[console][queue_tail[console] & (EVENT_QUEUE_SIZE - 1)];
+        queue_tail[console]++;
+    }
+    spin_unlock_irqrestore(&reader_lock, flags);
+
+    if (routed) {
+        keyboard_notify();
+    }
+    return found;
+}
+
+uint32_t keyboard_dropped_events(void) {
+    return raw_dropped + queue_dropped;
+}
+
+void keyboard_halt(void) {
+    uint32_t flags = cpu_irq_save();
+
+    /* With a tickless timer nothing else may wake the CPU soon, so a key
+       that arrived after the caller looked would otherwise sit unread */
+    if (__atomic_load_n(&raw_head, __ATOMIC_ACQUIRE) == raw_tail &&
+        !(vga_get_output_console() == 0 && serial_has_byte()) &&
+        (flags & CPU_EFLAGS_IF)) {
+        cpu_sti_hlt();
+    }
+    cpu_irq_restore(flags);
+}
+
+uint32_t keyboard_input_seq(void) {
+    return (uint32_t)atomic_read(&input_seq);
+}
+
+void keyboard_wait_input(uint32_t seen) {
+    if (sched_can_block()) {
+        wait_event(&input_wait, keyboard_input_seq() != seen);
+    } else if (keyboard_input_seq() == seen) {
+        keyboard_halt();
+    }
+}
+
+void keyboard_set_idle_handler(void (*handler)(uint32_t seen)) {
+    idle_handler = handler;
 }
 
 char keyboard_getchar(void) {
-    /* Busy-wait for a key */
-    while (!keyboard_has_key()) {
-        __asm__ volatile ("hlt");  /* Halt until next interrupt */
+    key_event_t event;
+
+    while (1) {
+        int console = vga_get_output_console();
+        uint32_t seen = keyboard_input_seq();
+
+        while (keyboard_poll_event(&event)) {
+            char c = legacy_char(&event);
+            if (c != 0) {
+                return c;
+            }
+        }
+
+        while (console == 0 && serial_has_byte()) {
+            char c = serial_translate(serial_read());
+            if (c != 0) {
+                return c;
+            }
+        }
+
+        /* Apply a console switch requested from the IRQ handler */
+        vga_flush();
+
+        if (idle_handler) {
+            idle_handler(seen);
+        } else {
+            keyboard_wait_input(seen);
+        }
+    }
+}
+
+/* Append up to len bytes of text to the search view, clipped to fit */
+static int view_append(char *view, int used, const char *text, int len) {
+    if (len > KEY_BUFFER_SIZE - 1 - used) {
+        len = KEY_BUFFER_SIZE - 1 - used;
+    }
+    memcpy(view + used, text, (size_t)len);
+    return used + len;
+}
+
+/*
+ * Ctrl+R. Each keystroke refines the query and carries on from the
+ * current match, since nothing newer held the shorter query; Ctrl+R
+ * again steps to an older match and backspace returns to the match the
+ * shorter query had. Leaves the match (or the original line on cancel)
+ * in the buffer and returns the key that ended the search, or 0.
+ */
+static char reverse_search(line_editor_t *ed, int max_len) {
+    char *line = ed->buffer;
+    char view[KEY_BUFFER_SIZE];
+    char saved[KEY_BUFFER_SIZE];
+    char query[SEARCH_MAX_QUERY];
+    int match[SEARCH_MAX_QUERY + 1];    /* Match for each query length */
+    uint8_t failed[SEARCH_MAX_QUERY + 1];
+    int saved_len = ed->len;
+    int qlen = 0;
+
+    memcpy(saved, line, (size_t)saved_len);
+    match[0] = -1;
+    failed[0] = 0;
+    ed->buffer = view;
+
+    while (1) {
+        const char *prefix = failed[qlen] ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+        const char *entry;
+        const char *hit;
+        int used = 0;
+        int cursor;
+        char c;
+
+        entry = match[qlen] >= 0 ? shell_history_entry((size_t)match[qlen]) : "";
+        used = view_append(view, used, prefix, (int)strlen(prefix));
+        used = view_append(view, used, query, qlen);
+        used = view_append(view, used, "': ", 3);
+        cursor = used;
+        used = view_append(view, used, entry, (int)strlen(entry));
+
+        hit = qlen > 0 ? memmem(entry, strlen(entry), query, (size_t)qlen) : 0;
+        if (hit != 0 && cursor + (hit - entry) < used) {
+            cursor += (int)(hit - entry);
+        }
+        ed->len = used;
+        editor_refresh(ed, cursor);
+
+        c = keyboard_getchar();
+
+        if (c == KEY_REVERSE_SEARCH) {
+            if (qlen > 0 && match[qlen] >= 0) {
+                int older = shell_history_find(query, (size_t)qlen, match[qlen]);
+
+                failed[qlen] = older < 0;
+                if (older >= 0) {
+                    match[qlen] = older;
+                }
+            }
+            continue;
+        }
+
+        if (c == '\b') {
+            if (qlen > 0) {
+                qlen--;
+            }
+            continue;
+        }
+
+        if (c >= ' ' && c < 0x7F) {
+            if (qlen < SEARCH_MAX_QUERY) {
+                int from = match[qlen] >= 0 ? match[qlen] + 1 : (int)shell_history_count();
+                int found;
+
+                query[qlen++] = c;
+                found = failed[qlen - 1] ? -1 : shell_history_find(query, (size_t)qlen, from);
+                match[qlen] = found >= 0 ? found : match[qlen - 1];
+                failed[qlen] = found < 0;
+            }
+            continue;
+        }
+
+        /* Other sessions may have added history while this one waited */
+        entry = match[qlen] >= 0 ? shell_history_entry((size_t)match[qlen]) : 0;
+
+        ed->buffer = line;
+        if (c == KEY_CANCEL || entry == 0) {
+            ed->len = saved_len;
+            memcpy(line, saved, (size_t)saved_len);
+        } else {
+            ed->len = copy_history_entry(line, max_len, entry);
+        }
+        line[ed->len] = '\0';
+        return c == KEY_CANCEL ? 0 : c;
     }
-    return buffer_pop();
 }
 
 int keyboard_readline(char *buffer, int max_len) {
-    int len = 0;
-    int pos = 0;
+    line_editor_t ed;
     int browsing_history = 0;
     int history_index = 0;
     int draft_len = 0;
+    int tab_presses = 0;
     char draft[KEY_BUFFER_SIZE];
 
     draft[0] = '\0';
+    if (max_len > KEY_BUFFER_SIZE) {
+        max_len = KEY_BUFFER_SIZE;
+    }
     max_len--;  /* Reserve space for null terminator */
 
+    ed.buffer = buffer;
+    ed.len = 0;
+    ed.pos = 0;
+    ed.start_col = vga_get_cursor_x();
+    ed.shown_len = 0;
+
     while (1) {
         char c = keyboard_getchar();
 
+        if (c == KEY_REVERSE_SEARCH) {
+            vga_scroll_to_bottom();
+            browsing_history = 0;
+            c = reverse_search(&ed, max_len);
+            editor_refresh(&ed, ed.len);
+            if (c == 0) {
+                continue;
+            }
+        }
+
+        /* A second Tab in a row lists the candidates */
+        tab_presses = (c == '\t') ? tab_presses + 1 : 0;
+
         if (c == KEY_SCROLL_UP) {
             vga_scroll_up();
             continue;
@@ -310,14 +759,14 @@ int keyboard_readline(char *buffer, int max_len) {
         }
 
         if (c == KEY_SCROLL_PAGE_UP) {
-            for (int i = 0; i < VGA_HEIGHT / 2; i++) {
+            for (int i = 0; i < vga_get_height() / 2; i++) {
                 vga_scroll_up();
             }
             continue;
         }
 
         if (c == KEY_SCROLL_PAGE_DOWN) {
-            for (int i = 0; i < VGA_HEIGHT / 2; i++) {
+            for (int i = 0; i < vga_get_height() / 2; i++) {
                 vga_scroll_down();
             }
             continue;
@@ -332,7 +781,7 @@ int keyboard_readline(char *buffer, int max_len) {
             vga_scroll_to_bottom();
 
             if (!browsing_history) {
-                draft_len = len;
+                draft_len = ed.len;
                 memcpy(draft, buffer, (size_t)draft_len);
                 draft[draft_len] = '\0';
                 browsing_history = 1;
@@ -340,10 +789,9 @@ int keyboard_readline(char *buffer, int max_len) {
             }
 
             if (history_index > 0) {
-                int old_len = len;
                 history_index--;
-                len = copy_history_entry(buffer, max_len, shell_history_entry((size_t)history_index));
-                redraw_input_line(buffer, &len, &pos, old_len, len);
+                ed.len = copy_history_entry(buffer, max_len, shell_history_entry((size_t)history_index));
+                editor_refresh(&ed, ed.len);
             }
             continue;
         }
@@ -356,124 +804,101 @@ int keyboard_readline(char *buffer, int max_len) {
             vga_scroll_to_bottom();
 
             int history_total = (int)shell_history_count();
-            int old_len = len;
 
             if (history_index < history_total - 1) {
                 history_index++;
-                len = copy_history_entry(buffer, max_len, shell_history_entry((size_t)history_index));
+                ed.len = copy_history_entry(buffer, max_len, shell_history_entry((size_t)history_index));
             } else {
                 browsing_history = 0;
                 history_index = history_total;
-                len = draft_len;
+                ed.len = draft_len;
                 memcpy(buffer, draft, (size_t)draft_len);
-                buffer[len] = '\0';
+                buffer[ed.len] = '\0';
             }
 
-            redraw_input_line(buffer, &len, &pos, old_len, len);
+            editor_refresh(&ed, ed.len);
             continue;
         }
 
         if (c == KEY_CURSOR_LEFT) {
             vga_scroll_to_bottom();
-            if (pos > 0) {
-                pos--;
-                cursor_left_once();
+            if (ed.pos > 0) {
+                editor_refresh(&ed, ed.pos - 1);
             }
             continue;
         }
 
         if (c == KEY_CURSOR_RIGHT) {
             vga_scroll_to_bottom();
-            if (pos < len) {
-                pos++;
-                cursor_right_once();
+            if (ed.pos < ed.len) {
+                editor_refresh(&ed, ed.pos + 1);
             }
             continue;
         }
 
         if (c == KEY_HOME) {
             vga_scroll_to_bottom();
-            while (pos > 0) {
-                pos--;
-                cursor_left_once();
-            }
+            editor_refresh(&ed, 0);
             continue;
         }
 
         if (c == KEY_END) {
             vga_scroll_to_bottom();
-            while (pos < len) {
-                pos++;
-                cursor_right_once();
-            }
+            editor_refresh(&ed, ed.len);
             continue;
         }
 
         if (c == KEY_DELETE) {
             vga_scroll_to_bottom();
-            if (pos < len) {
-                for (int i = pos; i < len - 1; i++) {
-                    buffer[i] = buffer[i + 1];
-                }
-                len--;
-
-                for (int i = pos; i < len; i++) {
-                    vga_putchar(buffer[i]);
-                }
-                vga_putchar(' ');
-
-                int move_left = (len - pos) + 1;
-                while (move_left-- > 0) {
-                    cursor_left_once();
-                }
+            if (ed.pos < ed.len) {
+                memmove(&buffer[ed.pos], &buffer[ed.pos + 1], (size_t)(ed.len - ed.pos - 1));
+                ed.len--;
+                editor_refresh(&ed, ed.pos);
             }
             continue;
         }
 
         vga_scroll_to_bottom();
 
-        if (c == '\n') {
-            buffer[len] = '\0';
-            vga_putchar('\n');
-            return len;
-        } else if (c == '\b') {
-            browsing_history = 0;
-            if (pos > 0) {
-                cursor_left_once();
-                pos--;
-                for (int i = pos; i < len - 1; i++) {
-                    buffer[i] = buffer[i + 1];
-                }
-                len--;
-
-                for (int i = pos; i < len; i++) {
-                    vga_putchar(buffer[i]);
-                }
-                vga_putchar(' ');
+        if (c == '\t') {
+            int len = ed.len;
+            int pos = ed.pos;
+            int list = tab_presses > 1;
 
-                int move_left = (len - pos) + 1;
-                while (move_left-- > 0) {
-                    cursor_left_once();
-                }
-            }
-        } else if (c >= ' ' && pos < max_len) {
             browsing_history = 0;
-            for (int i = len; i > pos; i--) {
-                buffer[i] = buffer[i - 1];
+            if (list) {
+                editor_refresh(&ed, ed.len);
             }
-            buffer[pos] = c;
-            len++;
-            pos++;
 
-            for (int i = pos - 1; i < len; i++) {
-                vga_putchar(buffer[i]);
+            if (shell_complete(buffer, &len, &pos, max_len, list)) {
+                /* The line now starts after a fresh prompt */
+                ed.start_col = vga_get_cursor_x();
+                ed.shown_len = 0;
+                ed.pos = 0;
             }
-            vga_putchar(' ');
+            ed.len = len;
+            editor_refresh(&ed, pos);
+            continue;
+        }
 
-            int move_left = (len - pos) + 1;
-            while (move_left-- > 0) {
-                cursor_left_once();
+        if (c == '\n') {
+            buffer[ed.len] = '\0';
+            editor_refresh(&ed, ed.len);
+            vga_putchar('\n');
+            return ed.len;
+        } else if (c == '\b') {
+            browsing_history = 0;
+            if (ed.pos > 0) {
+                memmove(&buffer[ed.pos - 1], &buffer[ed.pos], (size_t)(ed.len - ed.pos));
+                ed.len--;
+                editor_refresh(&ed, ed.pos - 1);
             }
+        } else if (c >= ' ' && ed.len < max_len) {
+            browsing_history = 0;
+            memmove(&buffer[ed.pos + 1], &buffer[ed.pos], (size_t)(ed.len - ed.pos));
+            buffer[ed.pos] = c;
+            ed.len++;
+            editor_refresh(&ed, ed.pos + 1);
         }
     }
 }
@@ -0,0 +1,231 @@
+/*
+ * MelonOS - Serial Port Driver
+ * Interrupt-driven 16550 UART on COM1 with TX/RX rings
+ */
+
+#include "serial.h"
+#include "idt.h"
+#include "io.h"
+#include "cpu.h"
+
+#define COM1_PORT 0x3F8
+#define COM1_IRQ  4
+
+/* Register offsets from the base port */
+#define UART_DATA 0  /* RBR/THR; divisor low byte while DLAB is set */
+#define UART_IER  1  /* Divisor high byte while DLAB is set */
+#define UART_FCR  2
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+
+#define UART_CLOCK      115200
+#define UART_FIFO_DEPTH 16
+
+#define IER_RX      0x01
+#define IER_TX      0x02
+#define FCR_ENABLE  0xC7  /* Enable and clear both FIFOs, 14-byte RX trigger */
+#define LCR_8N1     0x03
+#define LCR_DLAB    0x80
+#define MCR_ONLINE  0x0B  /* DTR, RTS and OUT2 (OUT2 gates the IRQ line) */
+#define MCR_LOOP    0x1E
+#define LSR_DR      0x01
+#define LSR_THRE    0x20
+
+/* Ring sizes must be powers of two; indexes run free and are masked */
+#define TX_RING_SIZE 16384
+#define RX_RING_SIZE 256
+
+static char tx_ring[TX_RING_SIZE];
+static volatile uint32_t tx_head;   /* Written by serial_write */
+static volatile uint32_t tx_tail;   /* Advanced with interrupts off */
+static char rx_ring[RX_RING_SIZE];
+static volatile uint32_t rx_head;   /* Written by the IRQ handler */
+static volatile uint32_t rx_tail;
+static volatile uint32_t rx_overruns;
+static uint8_t ier_shadow;
+static int present;
+static void (*rx_notify)(void) = 0;
+
+static void set_ier(uint8_t value) {
+    if (value != ier_shadow) {
+        ier_shadow = value;
+        outb(COM1_PORT + UART_IER, value);
+    }
+}
+
+/* Move up to a FIFO's worth of queued bytes into the UART (interrupts off) */
+static void fill_fifo(void) {
+    int room = UART_FIFO_DEPTH;
+
+    while (room-- > 0 && tx_tail != tx_head) {
+        outb(COM1_PORT + UART_DATA, (uint8_t)tx_ring[tx_tail & (TX_RING_SIZE - 1)]);
+        tx_tail++;
+    }
+}
+
+static void drain_rx(void) {
+    while (inb(COM1_PORT + UART_LSR) & LSR_DR) {
+        uint8_t byte = inb(COM1_PORT + UART_DATA);
+
+        if (rx_head - rx_tail < RX_RING_SIZE) {
+            rx_ring[rx_head & (RX_RING_SIZE - 1)] = (char)byte;
+            rx_head++;
+        } else {
+            rx_overruns++;
+        }
+    }
+}
+
+/* Feed the transmitter if it is idle and ask for an interrupt while
+   bytes remain queued */
+static void kick_tx(void) {
+    uint32_t flags = cpu_irq_save();
+
+    if (inb(COM1_PORT + UART_LSR) & LSR_THRE) {
+        fill_fifo();
+    }
+    set_ier(tx_head != tx_tail ? (IER_RX | IER_TX) : IER_RX);
+
+    cpu_irq_restore(flags);
+}
+
+static void serial_handler(registers_t *regs) {
+    uint32_t head = rx_head;
+
+    (void)regs;
+
+    drain_rx();
+    if (rx_head != head && rx_notify) {
+        rx_notify();
+    }
+    if (inb(COM1_PORT + UART_LSR) & LSR_THRE) {
+        fill_fifo();
+    }
+    set_ier(tx_head != tx_tail ? (IER_RX | IER_TX) : IER_RX);
+}
+
+int serial_init(uint32_t baud) {
+    uint16_t divisor;
+
+    present = 0;
+    if (baud == 0 || baud > UART_CLOCK) {
+        baud = UART_CLOCK;
+    }
+    divisor = (uint16_t)(UART_CLOCK / baud);
+
+    outb(COM1_PORT + UART_IER, 0);
+    outb(COM1_PORT + UART_LCR, LCR_DLAB);
+    outb(COM1_PORT + UART_DATA, (uint8_t)(divisor & 0xFF));
+    outb(COM1_PORT + UART_IER, (uint8_t)(divisor >> 8));
+    outb(COM1_PORT + UART_LCR, LCR_8N1);
+    outb(COM1_PORT + UART_FCR, FCR_ENABLE);
+
+    /* A byte sent in loopback mode must come straight back */
+    outb(COM1_PORT + UART_MCR, MCR_LOOP);
+    outb(COM1_PORT + UART_DATA, 0xAE);
+    if (inb(COM1_PORT + UART_DATA) != 0xAE) {
+        return -1;
+    }
+    outb(COM1_PORT + UART_MCR, MCR_ONLINE);
+
+    tx_head = tx_tail = 0;
+    rx_head = rx_tail = 0;
+    rx_overruns = 0;
+    ier_shadow = 0;
+    present = 1;
+
+    irq_install_handler(COM1_IRQ, serial_handler);
+    irq_unmask(COM1_IRQ);
+    set_ier(IER_RX);
+    return 0;
+}
+
+int serial_is_present(void) {
+    return present;
+}
+
+void serial_write(const char *buf, size_t len) {
+    if (!present) {
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        /* Ring full: feed the UART directly until a slot frees up */
+        while (tx_head - tx_tail >= TX_RING_SIZE) {
+            kick_tx();
+        }
+        tx_ring[tx_head & (TX_RING_SIZE - 1)] = buf[i];
+        tx_head++;
+    }
+
+    kick_tx();
+
+    /* With interrupts off (early boot, panics) nothing else will drain
+       the ring, so fall back to polling */
+    if (!cpu_irqs_enabled()) {
+        while (tx_head != tx_tail) {
+            kick_tx();
+        }
+    }
+}
+
+void serial_console_write(const char *buf, size_t len) {
+    char out[128];
+    size_t used = 0;
+
+    if (!present) {
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        /* Leave room for the longest expansion below */
+        if (used > sizeof(out) - 3) {
+            serial_write(out, used);
+            used = 0;
+        }
+
+        if (buf[i] == '\n') {
+            out[used++] = '\r';
+            out[used++] = '\n';
+        } else if (buf[i] == '\b') {
+            out[used++] = '\b';
+            out[used++] = ' ';
+            out[used++] = '\b';
+        } else {
+            out[used++] = buf[i];
+        }
+    }
+
+    serial_write(out, used);
+}
+
+int serial_has_byte(void) {
+    /* Poll as well, in case the IRQ is not getting through */
+    if (present && rx_head == rx_tail) {
+        uint32_t flags = cpu_irq_save();
+        drain_rx();
+        cpu_irq_restore(flags);
+    }
+    return rx_head != rx_tail;
+}
+
+int serial_read(void) {
+    uint8_t byte;
+
+    if (rx_head == rx_tail) {
+        return -1;
+    }
+
+    byte = (uint8_t)rx_ring[rx_tail & (RX_RING_SIZE - 1)];
+    rx_tail++;
+    return byte;
+}
+
+uint32_t serial_rx_overruns(void) {
+    return rx_overruns;
+}
+
+void serial_set_rx_notify(void (*notify)(void)) {
+    rx_notify = notify;
+}
@@ -4,25 +4,114 @@
  */
 
 #include "timer.h"
+#include "apic.h"
+#include "clock.h"
+#include "cpu.h"
+#include "deadline_heap.h"
 #include "idt.h"
 #include "io.h"
+#include "math64.h"
+#include "smp.h"
+#include "spinlock.h"
 
 #define PIT_CHANNEL0 0x40
 #define PIT_COMMAND  0x43
-#define PIT_FREQUENCY 1193180  /* Base PIT frequency in Hz */
+
+/* One-shot shots are clamped to what the 16-bit counter can hold
+   (about 55 ms) and to a floor that keeps the IRQ from storming */
+#define PIT_MAX_COUNT 0xFFFFu
+#define PIT_MIN_COUNT 12u
+
+DEFINE_LOCK_STATS(tick_stats, "ticks");
 
 static volatile uint32_t tick_count = 0;
 static uint32_t timer_freq = 0;
+static volatile uint32_t irq_count = 0;
+
+/* Orders tick_count and the switch to one-shot mode, which moves ticks
+   onto clock_ns(), against timer_get_ticks on other CPUs */
+static seqlock_t tick_lock = SEQLOCK_INIT_STATS(&tick_stats);
+
+/*
+ * Once the TSC clock is calibrated the PIT stops ticking. Ticks and
+ * uptime are derived from clock_ns(), and either the LAPIC timer or
+ * PIT channel 0 in mode 4 (software strobe) is loaded only for the
+ * earliest deadline in the heap. With nothing pending no interrupt is
+ * raised at all.
+ */
+static int oneshot = 0;
+static int use_lapic = 0;
+static uint32_t ns_per_tick = 0;
+static uint32_t tick_offset = 0;
+static deadline_heap_t deadlines;   /* Pending wakeups */
+static uint64_t programmed = 0;   /* When the loaded shot fires, 0 if idle */
+
+/* Drop what has expired and load the counter for the next deadline
+   (interrupts off) */
+static void program_next(uint64_t now) {
+    uint64_t delta;
+    uint32_t count;
+
+    while (deadline_heap_count(&deadlines) > 0 && deadline_heap_min(&deadlines) <= now) {
+        deadline_heap_pop(&deadlines);
+    }
+
+    if (deadline_heap_count(&deadlines) == 0) {
+        programmed = 0;
+        return;
+    }
+
+    /* Round up so the shot never lands before the deadline; an early
+       one would only be re-armed, but costs an extra interrupt */
+    delta = deadline_heap_min(&deadlines) - now;
+    if (use_lapic) {
+        programmed = now + apic_timer_oneshot(delta);
+        return;
+    }
+    if (delta >= 1000000000ull) {
+        count = PIT_MAX_COUNT;
+    } else {
+        count = (uint32_t)div64_u32(delta * PIT_FREQUENCY, 1000000000u, 0) + 1;
+        if (count > PIT_MAX_COUNT) {
+            count = PIT_MAX_COUNT;
+        } else if (count < PIT_MIN_COUNT) {
+            count = PIT_MIN_COUNT;
+        }
+    }
+
+    programmed = now + div64_u32((uint64_t)count * 1000000000u, PIT_FREQUENCY, 0);
+    outb(PIT_CHANNEL0, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)(count >> 8));
+}
 
 /* Timer IRQ handler */
 static void timer_handler(registers_t *regs) {
     (void)regs;
-    tick_count++;
+
+    /* Another CPU's LAPIC timer: a time slice ended, which the
+       scheduler notices on the way out of the interrupt */
+    if (smp_cpu_index() != 0) {
+        return;
+    }
+
+    irq_count++;
+
+    if (oneshot) {
+        program_next(clock_ns());
+    } else {
+        write_seqlock(&tick_lock);
+        tick_count++;
+        write_sequnlock(&tick_lock);
+    }
 }
 
 void timer_init(uint32_t frequency) {
     timer_freq = frequency;
     tick_count = 0;
+    oneshot = 0;
+    use_lapic = 0;
+    deadline_heap_reset(&deadlines);
+    programmed = 0;
 
     /* Calculate divisor */
     uint32_t divisor = PIT_FREQUENCY / frequency;
@@ -38,18 +127,118 @@ void timer_init(uint32_t frequency) {
     irq_install_handler(0, timer_handler);
 }
 
+int timer_enable_oneshot(void) {
+    uint32_t flags;
+
+    if (oneshot) {
+        return 0;
+    }
+    if (!clock_has_tsc() || timer_freq == 0) {
+        return -1;
+    }
+
+    flags = cpu_irq_save();
+
+    /* Carry the tick count over so it stays monotonic */
+    write_seqlock(&tick_lock);
+    ns_per_tick = 1000000000u / timer_freq;
+    tick_offset = tick_count - (uint32_t)div64_u32(clock_ns(), ns_per_tick, 0);
+    oneshot = 1;
+    write_sequnlock(&tick_lock);
+
+    /* Channel 0, lobyte/hibyte, mode 4: counts once per load, then idles.
+       With a measured LAPIC timer the PIT is never loaded again. */
+    outb(PIT_COMMAND, 0x38);
+    if (apic_is_active() && apic_timer_khz() != 0) {
+        irq_mask(0);
+        apic_timer_enable(TIMER_VECTOR);
+        use_lapic = 1;
+    }
+    programmed = 0;
+    program_next(clock_ns());
+
+    cpu_irq_restore(flags);
+    return 0;
+}
+
+int timer_is_oneshot(void) {
+    return oneshot;
+}
+
+const char *timer_source(void) {
+    return use_lapic ? "LAPIC" : "PIT";
+}
+
+typedef struct {
+    uint64_t deadline_ns;
+    int result;
+} wake_at_request_t;
+
+static void wake_at_call(void *arg) {
+    wake_at_request_t *request = arg;
+
+    request->result = timer_wake_at(request->deadline_ns);
+}
+
+int timer_wake_at(uint64_t deadline_ns) {
+    uint32_t flags;
+
+    if (!oneshot) {
+        return -1;
+    }
+    if (smp_cpu_index() != 0) {
+        wake_at_request_t request = { deadline_ns, -1 };
+
+        /* CPU 0 owns the heap; wait for its answer so a full heap is
+           reported here too */
+        if (smp_call(0, wake_at_call, &request, 1) != 0) {
+            return -1;
+        }
+        return request.result;
+    }
+
+    flags = cpu_irq_save();
+    if (deadline_heap_push(&deadlines, deadline_ns) != 0) {
+        cpu_irq_restore(flags);
+        return -1;
+    }
+
+    if (programmed == 0 || deadline_ns < programmed) {
+        program_next(clock_ns());
+    }
+
+    cpu_irq_restore(flags);
+    return 0;
+}
+
 uint32_t timer_get_ticks(void) {
-    return tick_count;
+    uint32_t ticks;
+    uint32_t seq;
+
+    do {
+        seq = read_seqbegin(&tick_lock);
+        if (oneshot) {
+            ticks = tick_offset + (uint32_t)div64_u32(clock_ns(), ns_per_tick, 0);
+        } else {
+            ticks = tick_count;
+        }
+    } while (read_seqretry(&tick_lock, seq));
+    return ticks;
+}
+
+uint32_t timer_get_frequency(void) {
+    return timer_freq;
+}
+
+uint32_t timer_get_interrupts(void) {
+    return irq_count;
 }
 
 uint32_t timer_get_uptime(void) {
     if (timer_freq == 0) return 0;
-    return tick_count / timer_freq;
+    return timer_get_ticks() / timer_freq;
 }
 
 void timer_sleep(uint32_t ms) {
-    uint32_t target = tick_count + (ms * timer_freq / 1000);
-    while (tick_count < target) {
-        __asm__ volatile ("hlt");
-    }
+    clock_sleep_ns((uint64_t)ms * 1000000u);
 }
@@ -1,23 +1,104 @@
 /*
  * MelonOS - VGA Text Mode Driver
- * 80x25 text mode video output implementation
+ * Console output on 80x25 text mode or a linear framebuffer
  */
 
 #include "vga.h"
 #include "io.h"
+#include "string.h"
+#include "kprintf.h"
+#include "scrollback.h"
+#include "serial.h"
+#include "framebuffer.h"
 
 #define VGA_MEMORY 0xB8000
 #define VGA_CTRL_PORT 0x3D4
 #define VGA_DATA_PORT 0x3D5
-#define VGA_HISTORY_LINES 1000
+
+/* Recent lines stay as raw cells so the cursor can edit them; older
+   lines are handed to the compressed scrollback store */
+#define VGA_HOT_LINES 128
+
+/* The 32 KiB text window at 0xB8000 holds this many rows; the CRTC start
+   address picks which VGA_HEIGHT of them are on screen */
+#define VGA_VRAM_ROWS   ((0x8000 / 2) / VGA_WIDTH)
+#define VGA_MAX_ORIGIN  (VGA_VRAM_ROWS - VGA_HEIGHT)
+
+/* Where the console core sends finished cells */
+typedef struct {
+    void (*draw_cell)(int col, int row, uint16_t cell);
+    void (*scroll)(int rows);          /* Contents move up by rows (down if negative) */
+    void (*set_cursor)(int col, int row);
+} console_backend_t;
+
+static const console_backend_t *backend;
+static int console_cols;
+static int console_rows;
+
+/* ANSI escape parser limits */
+#define ESC_MAX_PARAMS 8
+#define ESC_PARAM_MAX  9999
+
+enum esc_mode { ESC_NONE, ESC_START, ESC_CSI };
+
+#define LINE_MATERIALIZED 1u
+
+/*
+ * Everything one virtual console owns. Output always lands in the
+ * history of the console selected with vga_set_output_console; only the
+ * active console is presented to the backend.
+ *
+ * Hot lines are blanked lazily. Each slot carries a stamp of
+ * (generation << 1) | materialized: a slot from an older generation reads
+ * as blank in clear_attr, an unmaterialized slot of the current
+ * generation reads as blank in its line_attr, and only a materialized
+ * slot has meaningful cells in history_buffer.
+ */
+typedef struct {
+    int cursor_x;
+    int cursor_line;
+    int history_head;   /* Oldest line still stored */
+    int hot_base;       /* Oldest line still held as raw cells */
+    int viewport_top;
+    uint8_t current_color;
+    uint8_t base_color;  /* Colour set by vga_set_color; SGR 0 returns here */
+    uint16_t history_buffer[VGA_HOT_LINES * CONSOLE_MAX_COLS];
+    uint32_t history_gen;
+    uint32_t line_stamp[VGA_HOT_LINES];
+    uint8_t line_attr[VGA_HOT_LINES];
+    uint8_t clear_attr;
+
+    /* ANSI escape parser state, fed one byte at a time by console_emit */
+    enum esc_mode esc_state;
+    int esc_params[ESC_MAX_PARAMS];
+    int esc_count;
+    int esc_private;   /* '?' seen; DEC private modes are ignored */
+    int sgr_bold;
+    int saved_x;
+    int saved_y;
+
+    scrollback_t scrollback;
+} console_t;
+
+static console_t consoles[VGA_CONSOLES];
+static console_t *con = &consoles[0];     /* Receives output */
+static console_t *active = &consoles[0];  /* Shown on screen */
+static volatile int requested_console = -1;
 
 static uint16_t *vga_buffer;
-static int cursor_x;
-static int cursor_line;
-static int history_head;
-static int viewport_top;
-static uint8_t current_color;
-static uint16_t history_buffer[VGA_HISTORY_LINES * VGA_WIDTH];
+static int hw_cursor_pos;
+static int vram_origin;   /* VRAM row displayed at the top of the screen */
+static int shown_top;     /* History line currently on screen row 0 */
+static uint64_t dirty_rows;  /* Screen rows that may differ from their history line */
+static uint64_t stale_rows;  /* Screen rows whose contents are unknown */
+static uint16_t decode_buffer[CONSOLE_MAX_COLS];
+
+/* What the backend currently shows, so presenting can skip unchanged
+   cells without reading back from video memory */
+static uint16_t screen_cells[CONSOLE_MAX_ROWS * CONSOLE_MAX_COLS];
+
+/* ANSI colour numbers (red = 1, green = 2, ...) to VGA palette order */
+static const uint8_t ansi_to_vga[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
 
 static inline uint8_t vga_entry_color(enum vga_color fg, enum vga_color bg) {
     return fg | bg << 4;
@@ -28,19 +109,19 @@ static inline uint16_t vga_entry(unsigned char c, uint8_t color) {
 }
 
 static inline int line_slot(int line) {
-    int slot = line % VGA_HISTORY_LINES;
+    int slot = line % VGA_HOT_LINES;
     if (slot < 0) {
-        slot += VGA_HISTORY_LINES;
+        slot += VGA_HOT_LINES;
     }
     return slot;
 }
 
 static inline int oldest_line(void) {
-    return history_head;
+    return con->history_head;
 }
 
 static int bottom_viewport_top(void) {
-    int top = cursor_line - (VGA_HEIGHT - 1);
+    int top = con->cursor_line - (console_rows - 1);
     if (top < oldest_line()) {
         top = oldest_line();
     }
@@ -48,149 +129,643 @@ static int bottom_viewport_top(void) {
 }
 
 static int is_viewport_at_bottom(void) {
-    return viewport_top == bottom_viewport_top();
+    return con->viewport_top == bottom_viewport_top();
+}
+
+static inline int line_is_shown(int line) {
+    return con == active && line >= shown_top && line < shown_top + console_rows;
+}
+
+static inline void mark_row_dirty(int screen_row) {
+    dirty_rows |= 1ull << screen_row;
+}
+
+static inline uint64_t all_rows(void) {
+    return (console_rows >= 64) ? ~0ull : (1ull << console_rows) - 1;
+}
+
+static void mark_all_dirty(void) {
+    dirty_rows = all_rows();
+}
+
+/* Returns the cells of a materialized slot, or 0 with *fill set to the
+   attribute the blank line should be drawn in */
+static const uint16_t *line_cells(int slot, uint8_t *fill) {
+    uint32_t stamp = con->line_stamp[slot];
+
+    if ((stamp >> 1) != con->history_gen) {
+        *fill = con->clear_attr;
+        return 0;
+    }
+    if (!(stamp & LINE_MATERIALIZED)) {
+        *fill = con->line_attr[slot];
+        return 0;
+    }
+    return &con->history_buffer[slot * CONSOLE_MAX_COLS];
 }
 
 static void clear_history_line(int line) {
     int slot = line_slot(line);
-    for (int x = 0; x < VGA_WIDTH; x++) {
-        history_buffer[slot * VGA_WIDTH + x] = vga_entry(' ', current_color);
+
+    con->line_stamp[slot] = con->history_gen << 1;
+    con->line_attr[slot] = con->current_color;
+    if (line_is_shown(line)) {
+        mark_row_dirty(line - shown_top);
     }
 }
 
-static uint16_t history_cell_read(int line, int col) {
-    if (line < oldest_line() || line > cursor_line) {
-        return vga_entry(' ', current_color);
+static void history_cell_write(int line, int col, uint16_t value) {
+    int slot = line_slot(line);
+    uint8_t fill;
+
+    if (!line_cells(slot, &fill)) {
+        memset16(&con->history_buffer[slot * CONSOLE_MAX_COLS], vga_entry(' ', fill), console_cols);
+        con->line_stamp[slot] = (con->history_gen << 1) | LINE_MATERIALIZED;
     }
-    return history_buffer[line_slot(line) * VGA_WIDTH + col];
+    con->history_buffer[slot * CONSOLE_MAX_COLS + col] = value;
 }
 
-static void history_cell_write(int line, int col, uint16_t value) {
-    history_buffer[line_slot(line) * VGA_WIDTH + col] = value;
+static void write_visible_cell(int line, int col, uint16_t value) {
+    if (line_is_shown(line)) {
+        int row = line - shown_top;
+        screen_cells[row * CONSOLE_MAX_COLS + col] = value;
+        backend->draw_cell(col, row, value);
+    }
 }
 
-static int cursor_is_visible(void) {
-    return cursor_line >= viewport_top && cursor_line < (viewport_top + VGA_HEIGHT);
+/* Draw the cells of one screen row that differ from its history line */
+static void present_row(int screen_row) {
+    int line = shown_top + screen_row;
+    uint16_t *shown = &screen_cells[screen_row * CONSOLE_MAX_COLS];
+    int force = (stale_rows >> screen_row) & 1;
+    const uint16_t *src = 0;
+    uint8_t fill = con->current_color;
+
+    if (line >= con->hot_base && line <= con->cursor_line) {
+        src = line_cells(line_slot(line), &fill);
+    } else if (line >= oldest_line() && line < con->hot_base) {
+        if (scrollback_read(&con->scrollback, line, decode_buffer, console_cols) == 0) {
+            src = decode_buffer;
+        }
+    }
+
+    if (!src) {
+        memset16(decode_buffer, vga_entry(' ', fill), console_cols);
+        src = decode_buffer;
+    }
+
+    for (int x = 0; x < console_cols; x++) {
+        if (force || shown[x] != src[x]) {
+            shown[x] = src[x];
+            backend->draw_cell(x, screen_row, src[x]);
+        }
+    }
 }
 
-static void write_visible_cell(int line, int col, uint16_t value) {
-    if (line >= viewport_top && line < (viewport_top + VGA_HEIGHT)) {
-        int y = line - viewport_top;
-        vga_buffer[y * VGA_WIDTH + col] = value;
+static void present(void) {
+    while (dirty_rows) {
+        /* Split in halves; a 64-bit ctz would need libgcc on i386 */
+        uint32_t low = (uint32_t)dirty_rows;
+        int y = low ? __builtin_ctz(low) : 32 + __builtin_ctz((uint32_t)(dirty_rows >> 32));
+        dirty_rows &= dirty_rows - 1;
+        present_row(y);
     }
+    stale_rows = 0;
 }
 
 static void render_viewport(void) {
-    for (int y = 0; y < VGA_HEIGHT; y++) {
-        int line = viewport_top + y;
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            vga_buffer[y * VGA_WIDTH + x] = history_cell_read(line, x);
+    shown_top = con->viewport_top;
+    mark_all_dirty();
+}
+
+/*
+ * Bring the screen in line with con->viewport_top. Overlapping views are
+ * reached by letting the backend move what is already on screen and
+ * drawing only the rows that scrolled in. Any rows still dirty from the
+ * old view must have been presented before calling this.
+ */
+static void sync_viewport(void) {
+    int delta = con->viewport_top - shown_top;
+    int kept = console_rows - (delta < 0 ? -delta : delta);
+    uint64_t exposed;
+
+    if (delta == 0) {
+        return;
+    }
+
+    if (kept <= 0) {
+        render_viewport();
+        present();
+        return;
+    }
+
+    if (delta > 0) {
+        memmove(screen_cells, &screen_cells[delta * CONSOLE_MAX_COLS],
+                (size_t)kept * CONSOLE_MAX_COLS * sizeof(uint16_t));
+        exposed = all_rows() & ~((1ull << kept) - 1);
+    } else {
+        memmove(&screen_cells[-delta * CONSOLE_MAX_COLS], screen_cells,
+                (size_t)kept * CONSOLE_MAX_COLS * sizeof(uint16_t));
+        exposed = (1ull << -delta) - 1;
+    }
+
+    backend->scroll(delta);
+    shown_top = con->viewport_top;
+    dirty_rows |= exposed;
+    stale_rows |= exposed;
+    present();
+}
+
+/* ============ VGA text mode backend ============ */
+
+static void set_display_start(void) {
+    uint16_t start = (uint16_t)(vram_origin * VGA_WIDTH);
+
+    outb(VGA_CTRL_PORT, 0x0C);
+    outb(VGA_DATA_PORT, (uint8_t)(start >> 8));
+    outb(VGA_CTRL_PORT, 0x0D);
+    outb(VGA_DATA_PORT, (uint8_t)(start & 0xFF));
+}
+
+static void text_draw_cell(int col, int row, uint16_t cell) {
+    vga_buffer[(vram_origin + row) * VGA_WIDTH + col] = cell;
+}
+
+/*
+ * Scrolling moves the CRTC start address over the 32 KiB text window.
+ * When that runs off either end, the window is rebased to the far end
+ * so following scrolls can pan again, copying the rows already on
+ * screen across.
+ */
+static void text_scroll(int rows) {
+    int origin = vram_origin + rows;
+
+    if (origin < 0 || origin > VGA_MAX_ORIGIN) {
+        origin = (rows > 0) ? 0 : VGA_MAX_ORIGIN;
+        for (int y = 0; y < VGA_HEIGHT; y++) {
+            memcpy(&vga_buffer[(origin + y) * VGA_WIDTH], &screen_cells[y * CONSOLE_MAX_COLS],
+                   VGA_WIDTH * sizeof(uint16_t));
         }
     }
+
+    vram_origin = origin;
+    set_display_start();
+}
+
+static void text_set_cursor(int col, int row) {
+    /* The cursor location register is an absolute VRAM offset */
+    uint16_t pos;
+
+    if (row < 0) {
+        row = 0;  /* No cheap way to hide it; park it on the top row */
+    }
+    pos = (uint16_t)((vram_origin + row) * VGA_WIDTH + col);
+
+    /* Each CRTC access is a port write (and a VM exit under QEMU) */
+    if (pos == hw_cursor_pos) {
+        return;
+    }
+    hw_cursor_pos = pos;
+
+    outb(VGA_CTRL_PORT, 14);
+    outb(VGA_DATA_PORT, (uint8_t)(pos >> 8));
+    outb(VGA_CTRL_PORT, 15);
+    outb(VGA_DATA_PORT, (uint8_t)(pos & 0xFF));
 }
 
+static const console_backend_t text_backend = {
+    text_draw_cell,
+    text_scroll,
+    text_set_cursor
+};
+
+static const console_backend_t fb_backend = {
+    fb_draw_cell,
+    fb_scroll,
+    fb_set_cursor
+};
+
+/* ============ Console core ============ */
+
 static void ensure_cursor_line_visible(void) {
-    if (cursor_line < oldest_line()) {
-        cursor_line = oldest_line();
-        cursor_x = 0;
+    if (con->cursor_line < oldest_line()) {
+        con->cursor_line = oldest_line();
+        con->cursor_x = 0;
+    }
+}
+
+/* Move the oldest hot line into the scrollback store */
+static void freeze_hot_line(void) {
+    int slot = line_slot(con->hot_base);
+    uint8_t fill;
+    const uint16_t *cells = line_cells(slot, &fill);
+
+    if (!cells) {
+        memset16(decode_buffer, vga_entry(' ', fill), console_cols);
+        cells = decode_buffer;
     }
+
+    scrollback_append(&con->scrollback, cells, console_cols);
+    con->hot_base++;
+    con->history_head = scrollback_first(&con->scrollback);
 }
 
 static void push_new_line(void) {
     int follow = is_viewport_at_bottom();
 
-    cursor_line++;
-    if (cursor_line - history_head >= VGA_HISTORY_LINES) {
-        history_head++;
+    con->cursor_line++;
+    while (con->cursor_line - con->hot_base >= VGA_HOT_LINES) {
+        freeze_hot_line();
     }
 
     ensure_cursor_line_visible();
-    clear_history_line(cursor_line);
+    clear_history_line(con->cursor_line);
 
-    if (viewport_top < oldest_line()) {
-        viewport_top = oldest_line();
+    if (con->viewport_top < oldest_line()) {
+        con->viewport_top = oldest_line();
     }
 
     if (follow) {
-        viewport_top = bottom_viewport_top();
+        con->viewport_top = bottom_viewport_top();
     }
 }
 
-void vga_init(void) {
-    vga_buffer = (uint16_t *)VGA_MEMORY;
-    cursor_x = 0;
-    cursor_line = 0;
-    history_head = 0;
-    viewport_top = 0;
-    current_color = vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
-    vga_clear();
+/* Blank every line of the output console without touching its cells */
+static void reset_history(void) {
+    con->history_gen++;
+    con->clear_attr = con->current_color;
+
+    con->cursor_x = 0;
+    con->cursor_line = 0;
+    con->history_head = 0;
+    con->hot_base = 0;
+    con->viewport_top = 0;
+    scrollback_reset(&con->scrollback, 0);
 }
 
-void vga_clear(void) {
-    for (int line = 0; line < VGA_HISTORY_LINES; line++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            history_buffer[line * VGA_WIDTH + x] = vga_entry(' ', current_color);
-        }
+/* The serial terminal follows the first console only */
+static void mirror_output(const char *buf, size_t len) {
+    if (con == &consoles[0]) {
+        serial_console_write(buf, len);
     }
+}
 
-    cursor_x = 0;
-    cursor_line = 0;
-    history_head = 0;
-    viewport_top = 0;
+/* Put another console on screen; the diff against screen_cells keeps
+   the repaint down to the cells that actually differ */
+static void show_console(console_t *target) {
+    console_t *caller = con;
 
+    con = target;
+    active = target;
     render_viewport();
+    present();
     vga_update_cursor();
+    con = caller;
+}
+
+void vga_init(void) {
+    uint8_t color = vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+
+    if (fb_is_available()) {
+        backend = &fb_backend;
+        console_cols = fb_cols();
+        console_rows = fb_rows();
+    } else {
+        backend = &text_backend;
+        console_cols = VGA_WIDTH;
+        console_rows = VGA_HEIGHT;
+    }
+
+    vga_buffer = (uint16_t *)VGA_MEMORY;
+    hw_cursor_pos = -1;
+    vram_origin = 0;
+    shown_top = 0;
+    dirty_rows = 0;
+    requested_console = -1;
+    if (backend == &text_backend) {
+        set_display_start();
+    }
+
+    for (int i = 0; i < VGA_CONSOLES; i++) {
+        con = &consoles[i];
+        con->current_color = color;
+        con->base_color = color;
+        con->esc_state = ESC_NONE;
+        con->sgr_bold = 0;
+        con->saved_x = 0;
+        con->saved_y = 0;
+        reset_history();
+    }
+    con = &consoles[0];
+    active = con;
+
+    /* Whatever the loader left on screen is unknown; draw every cell once */
+    stale_rows = all_rows();
+    vga_clear();
+}
+
+void vga_clear(void) {
+    reset_history();
+    mirror_output("\x1b[2J\x1b[H", 7);
+    if (con == active) {
+        render_viewport();
+    }
+    vga_flush();
 }
 
 void vga_set_color(enum vga_color fg, enum vga_color bg) {
-    current_color = vga_entry_color(fg, bg);
+    con->current_color = vga_entry_color(fg, bg);
+    con->base_color = con->current_color;
+    con->sgr_bold = 0;
 }
 
 void vga_scroll(void) {
     push_new_line();
-    render_viewport();
-    vga_update_cursor();
+    vga_flush();
 }
 
-void vga_putchar(char c) {
-    int old_viewport_top = viewport_top;
-    int at_bottom = is_viewport_at_bottom();
+static void console_backspace(void) {
+    if (con->cursor_x > 0) {
+        con->cursor_x--;
+    } else if (con->cursor_line > con->hot_base) {
+        con->cursor_line--;
+        con->cursor_x = console_cols - 1;
+    }
+
+    uint16_t entry = vga_entry(' ', con->current_color);
+    history_cell_write(con->cursor_line, con->cursor_x, entry);
+    write_visible_cell(con->cursor_line, con->cursor_x, entry);
+}
+
+/* Move the cursor to a screen position without flushing; rows between
+   the old and new cursor lines are marked for redraw */
+static void place_cursor(int x, int y) {
+    int old_line = con->cursor_line;
 
-    if (c == '\n') {
-        cursor_x = 0;
+    if (x < 0) x = 0;
+    if (x >= console_cols) x = console_cols - 1;
+    if (y < 0) y = 0;
+    if (y >= console_rows) y = console_rows - 1;
+
+    con->cursor_x = x;
+    con->cursor_line = con->viewport_top + y;
+    if (con->cursor_line > bottom_viewport_top() + (console_rows - 1)) {
+        con->cursor_line = bottom_viewport_top() + (console_rows - 1);
+    }
+    if (con->cursor_line < con->hot_base) {
+        con->cursor_line = con->hot_base;  /* Compressed lines are read-only */
+    }
+
+    /* Rows past the old cursor line were drawn blank; show their history */
+    for (int line = old_line + 1; line <= con->cursor_line; line++) {
+        if (line_is_shown(line)) {
+            mark_row_dirty(line - shown_top);
+        }
+    }
+}
+
+/* Blank cells [from, to) of an editable line in the current colour */
+static void erase_cells(int line, int from, int to) {
+    uint16_t blank = vga_entry(' ', con->current_color);
+
+    if (line < con->hot_base || line >= con->hot_base + VGA_HOT_LINES) {
+        return;
+    }
+    if (from == 0 && to >= console_cols) {
+        clear_history_line(line);
+        return;
+    }
+    for (int x = from; x < to && x < console_cols; x++) {
+        history_cell_write(line, x, blank);
+        write_visible_cell(line, x, blank);
+    }
+}
+
+static void erase_lines(int first, int last) {
+    for (int line = first; line <= last; line++) {
+        erase_cells(line, 0, console_cols);
+    }
+}
+
+static void apply_sgr(int code) {
+    uint8_t fg = con->current_color & 0x0F;
+    uint8_t bg = con->current_color >> 4;
+
+    if (code == 0) {
+        con->current_color = con->base_color;
+        con->sgr_bold = 0;
+        return;
+    }
+
+    if (code == 1) {
+        con->sgr_bold = 1;
+        fg |= 0x08;
+    } else if (code == 22) {
+        con->sgr_bold = 0;
+        fg &= 0x07;
+    } else if (code == 7) {
+        uint8_t swap = fg;
+        fg = bg;
+        bg = swap;
+    } else if (code >= 30 && code <= 37) {
+        fg = ansi_to_vga[code - 30] | (con->sgr_bold ? 0x08 : 0);
+    } else if (code == 39) {
+        fg = con->base_color & 0x0F;
+    } else if (code >= 40 && code <= 47) {
+        bg = ansi_to_vga[code - 40];
+    } else if (code == 49) {
+        bg = con->base_color >> 4;
+    } else if (code >= 90 && code <= 97) {
+        fg = ansi_to_vga[code - 90] | 0x08;
+    } else if (code >= 100 && code <= 107) {
+        bg = ansi_to_vga[code - 100] | 0x08;
+    } else {
+        return;
+    }
+
+    con->current_color = (uint8_t)(fg | bg << 4);
+}
+
+static inline int esc_param(int index, int fallback) {
+    if (index >= con->esc_count || con->esc_params[index] == 0) {
+        return fallback;
+    }
+    return con->esc_params[index];
+}
+
+/* Execute a complete CSI sequence; coordinates are screen relative and
+   1-based as on a VT100 */
+static void run_csi(char final) {
+    int y = con->cursor_line - con->viewport_top;
+    int n = esc_param(0, 1);
+    int mode = con->esc_count > 0 ? con->esc_params[0] : 0;
+
+    if (con->esc_private) {
+        return;
+    }
+
+    switch (final) {
+        case 'A': place_cursor(con->cursor_x, y - n); break;
+        case 'B': place_cursor(con->cursor_x, y + n); break;
+        case 'C': place_cursor(con->cursor_x + n, y); break;
+        case 'D': place_cursor(con->cursor_x - n, y); break;
+        case 'G': place_cursor(n - 1, y); break;
+        case 'H':
+        case 'f':
+            place_cursor(esc_param(1, 1) - 1, n - 1);
+            break;
+        case 'K':
+            if (mode == 0) {
+                erase_cells(con->cursor_line, con->cursor_x, console_cols);
+            } else if (mode == 1) {
+                erase_cells(con->cursor_line, 0, con->cursor_x + 1);
+            } else if (mode == 2) {
+                erase_cells(con->cursor_line, 0, console_cols);
+            }
+            break;
+        case 'J':
+            if (mode == 0) {
+                erase_cells(con->cursor_line, con->cursor_x, console_cols);
+                erase_lines(con->cursor_line + 1, con->viewport_top + console_rows - 1);
+            } else if (mode == 1) {
+                erase_lines(con->viewport_top, con->cursor_line - 1);
+                erase_cells(con->cursor_line, 0, con->cursor_x + 1);
+            } else if (mode == 2 || mode == 3) {
+                erase_lines(con->viewport_top, con->viewport_top + console_rows - 1);
+            }
+            break;
+        case 'm':
+            if (con->esc_count == 0) {
+                apply_sgr(0);
+            }
+            for (int i = 0; i < con->esc_count; i++) {
+                apply_sgr(con->esc_params[i]);
+            }
+            break;
+        case 's':
+            con->saved_x = con->cursor_x;
+            con->saved_y = y;
+            break;
+        case 'u':
+            place_cursor(con->saved_x, con->saved_y);
+            break;
+        default:
+            break;
+    }
+}
+
+static void console_escape(char c) {
+    if (con->esc_state == ESC_START) {
+        if (c == '[') {
+            con->esc_state = ESC_CSI;
+            con->esc_count = 0;
+            con->esc_private = 0;
+            con->esc_params[0] = 0;
+            return;
+        }
+        if (c == '7') {
+            con->saved_x = con->cursor_x;
+            con->saved_y = con->cursor_line - con->viewport_top;
+        } else if (c == '8') {
+            place_cursor(con->saved_x, con->saved_y);
+        }
+        con->esc_state = ESC_NONE;
+        return;
+    }
+
+    if (c >= '0' && c <= '9') {
+        if (con->esc_count == 0) {
+            con->esc_count = 1;
+        }
+        int *param = &con->esc_params[con->esc_count - 1];
+        *param = *param * 10 + (c - '0');
+        if (*param > ESC_PARAM_MAX) {
+            *param = ESC_PARAM_MAX;
+        }
+    } else if (c == ';') {
+        if (con->esc_count == 0) {
+            con->esc_count = 1;  /* Leading ';' means an empty first parameter */
+        }
+        if (con->esc_count < ESC_MAX_PARAMS) {
+            con->esc_params[con->esc_count++] = 0;
+        }
+    } else if (c == '?') {
+        con->esc_private = 1;
+    } else if (c >= 0x40 && c <= 0x7E) {
+        con->esc_state = ESC_NONE;
+        run_csi(c);
+    } else if (c < ' ') {
+        con->esc_state = ESC_NONE;  /* Malformed; drop the sequence */
+    }
+}
+
+/* Apply one character to history and any visible cell; viewport moves
+   and the hardware cursor are left for vga_flush */
+static void console_emit(char c) {
+    if (con->esc_state != ESC_NONE) {
+        console_escape(c);
+        return;
+    }
+
+    if (c == '\x1b') {
+        con->esc_state = ESC_START;
+        return;
+    } else if (c == '\n') {
+        con->cursor_x = 0;
         push_new_line();
     } else if (c == '\r') {
-        cursor_x = 0;
+        con->cursor_x = 0;
     } else if (c == '\t') {
-        cursor_x = (cursor_x + 4) & ~3;  /* Align to 4-space tab stops */
+        con->cursor_x = (con->cursor_x + 4) & ~3;  /* Align to 4-space tab stops */
     } else if (c == '\b') {
-        vga_backspace();
+        console_backspace();
         return;
     } else {
-        uint16_t entry = vga_entry(c, current_color);
-        history_cell_write(cursor_line, cursor_x, entry);
-        if (at_bottom) {
-            write_visible_cell(cursor_line, cursor_x, entry);
-        }
-        cursor_x++;
+        uint16_t entry = vga_entry(c, con->current_color);
+        history_cell_write(con->cursor_line, con->cursor_x, entry);
+        write_visible_cell(con->cursor_line, con->cursor_x, entry);
+        con->cursor_x++;
     }
 
-    if (cursor_x >= VGA_WIDTH) {
-        cursor_x = 0;
+    if (con->cursor_x >= console_cols) {
+        con->cursor_x = 0;
         push_new_line();
-        at_bottom = is_viewport_at_bottom();
     }
+}
 
-    if (viewport_top != old_viewport_top || !at_bottom || !cursor_is_visible()) {
-        render_viewport();
+void vga_write(const char *buf, size_t len) {
+    mirror_output(buf, len);
+    for (size_t i = 0; i < len; i++) {
+        console_emit(buf[i]);
     }
+    vga_flush();
+}
+
+void vga_flush(void) {
+    int index = requested_console;
+
+    if (index >= 0) {
+        requested_console = -1;
+        if (&consoles[index] != active) {
+            show_console(&consoles[index]);
+        }
+    }
+
+    if (con != active) {
+        return;  /* Background consoles only keep their history */
+    }
+
+    present();
+    sync_viewport();
     vga_update_cursor();
 }
 
+void vga_putchar(char c) {
+    vga_write(&c, 1);
+}
+
 void vga_print(const char *str) {
-    while (*str) {
-        vga_putchar(*str++);
-    }
+    vga_write(str, strlen(str));
 }
 
 void vga_println(const char *str) {
@@ -199,10 +774,10 @@ void vga_println(const char *str) {
 }
 
 void vga_print_colored(const char *str, enum vga_color fg, enum vga_color bg) {
-    uint8_t old_color = current_color;
-    current_color = vga_entry_color(fg, bg);
+    uint8_t old_color = con->current_color;
+    con->current_color = vga_entry_color(fg, bg);
     vga_print(str);
-    current_color = old_color;
+    con->current_color = old_color;
 }
 
 // Function to print a status log that takes an input color, a message, and a status (eg "OK", "FAIL", etc.)
@@ -214,115 +789,178 @@ void vga_print_status(const char *message, const char *status, enum vga_color st
 }
 
 void vga_print_int(int num) {
-    if (num == 0) {
-        vga_putchar('0');
-        return;
-    }
+    char buf[12];
+    size_t len = 0;
+    uint32_t magnitude = (uint32_t)num;
 
     if (num < 0) {
-        vga_putchar('-');
-        num = -num;
+        buf[len++] = '-';
+        magnitude = 0u - magnitude;
     }
 
-    char buf[12];
-    int i = 0;
-    while (num > 0) {
-        buf[i++] = '0' + (num % 10);
-        num /= 10;
-    }
-    /* Print in reverse */
-    for (int j = i - 1; j >= 0; j--) {
-        vga_putchar(buf[j]);
-    }
+    len += kfmt_u32(buf + len, magnitude);
+    vga_write(buf, len);
 }
 
 void vga_print_hex(uint32_t num) {
     const char hex_chars[] = "0123456789ABCDEF";
-    vga_print("0x");
-    for (int i = 28; i >= 0; i -= 4) {
-        vga_putchar(hex_chars[(num >> i) & 0xF]);
+    char buf[10];
+
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int i = 0; i < 8; i++) {
+        buf[2 + i] = hex_chars[(num >> (28 - i * 4)) & 0xF];
     }
+    vga_write(buf, sizeof(buf));
 }
 
 void vga_update_cursor(void) {
-    int display_y = cursor_line - viewport_top;
-    if (display_y < 0 || display_y >= VGA_HEIGHT) {
-        display_y = 0;
+    if (con != active) {
+        return;
     }
 
-    uint16_t pos = display_y * VGA_WIDTH + cursor_x;
-    outb(VGA_CTRL_PORT, 14);
-    outb(VGA_DATA_PORT, (uint8_t)(pos >> 8));
-    outb(VGA_CTRL_PORT, 15);
-    outb(VGA_DATA_PORT, (uint8_t)(pos & 0xFF));
+    int display_y = con->cursor_line - shown_top;
+    if (display_y < 0 || display_y >= console_rows) {
+        display_y = -1;  /* Scrolled out of view */
+    }
+
+    backend->set_cursor(con->cursor_x, display_y);
 }
 
-void vga_set_cursor(int x, int y) {
-    if (x < 0) x = 0;
-    if (x >= VGA_WIDTH) x = VGA_WIDTH - 1;
-    if (y < 0) y = 0;
-    if (y >= VGA_HEIGHT) y = VGA_HEIGHT - 1;
+/* Replay a cursor jump on the serial terminal as relative CSI moves */
+static void mirror_cursor_move(int old_x, int old_line) {
+    char seq[24];
+    int len = 0;
+    int dy = con->cursor_line - old_line;
+    int dx = con->cursor_x - old_x;
 
-    cursor_x = x;
-    cursor_line = viewport_top + y;
-    if (cursor_line > bottom_viewport_top() + (VGA_HEIGHT - 1)) {
-        cursor_line = bottom_viewport_top() + (VGA_HEIGHT - 1);
+    if (dy != 0) {
+        len += ksnprintf(seq + len, sizeof(seq) - len, "\x1b[%d%c", dy < 0 ? -dy : dy, dy < 0 ? 'A' : 'B');
     }
-    vga_update_cursor();
+    if (dx != 0) {
+        len += ksnprintf(seq + len, sizeof(seq) - len, "\x1b[%d%c", dx < 0 ? -dx : dx, dx < 0 ? 'D' : 'C');
+    }
+    mirror_output(seq, (size_t)len);
+}
+
+void vga_set_cursor(int x, int y) {
+    int old_x = con->cursor_x;
+    int old_line = con->cursor_line;
+
+    place_cursor(x, y);
+    mirror_cursor_move(old_x, old_line);
+    vga_flush();
+}
+
+int vga_get_width(void) {
+    return console_cols;
+}
+
+int vga_get_height(void) {
+    return console_rows;
 }
 
 int vga_get_cursor_x(void) {
-    return cursor_x;
+    return con->cursor_x;
 }
 
 int vga_get_cursor_y(void) {
-    return cursor_line - viewport_top;
+    return con->cursor_line - con->viewport_top;
 }
 
-void vga_backspace(void) {
-    int at_bottom = is_viewport_at_bottom();
+int vga_get_cursor_line(void) {
+    return con->cursor_line;
+}
 
-    if (cursor_x > 0) {
-        cursor_x--;
-    } else if (cursor_line > oldest_line()) {
-        cursor_line--;
-        cursor_x = VGA_WIDTH - 1;
+int vga_find_line(const char *text, int before) {
+    size_t len = strlen(text);
+    char chars[CONSOLE_MAX_COLS];
+
+    if (len == 0 || len > (size_t)console_cols) {
+        return -1;
+    }
+    if (before > con->cursor_line + 1) {
+        before = con->cursor_line + 1;
     }
 
-    uint16_t entry = vga_entry(' ', current_color);
-    history_cell_write(cursor_line, cursor_x, entry);
+    for (int line = before - 1; line >= con->hot_base; line--) {
+        uint8_t fill;
+        const uint16_t *cells = line_cells(line_slot(line), &fill);
 
-    if (at_bottom) {
-        write_visible_cell(cursor_line, cursor_x, entry);
-    } else {
-        render_viewport();
+        if (!cells) {
+            continue;
+        }
+        for (int x = 0; x < console_cols; x++) {
+            chars[x] = (char)cells[x];
+        }
+        if (memmem(chars, (size_t)console_cols, text, len)) {
+            return line;
+        }
     }
 
-    vga_update_cursor();
+    return scrollback_find(&con->scrollback, text, len, before < con->hot_base ? before : con->hot_base);
+}
+
+void vga_scroll_to_line(int line) {
+    int bottom_top = bottom_viewport_top();
+
+    if (line < oldest_line()) {
+        line = oldest_line();
+    }
+    if (line > bottom_top) {
+        line = bottom_top;
+    }
+
+    con->viewport_top = line;
+    vga_flush();
+}
+
+void vga_backspace(void) {
+    mirror_output("\b", 1);
+    console_backspace();
+    vga_flush();
 }
 
 void vga_scroll_up(void) {
-    if (viewport_top > oldest_line()) {
-        viewport_top--;
-        render_viewport();
-        vga_update_cursor();
+    if (con->viewport_top > oldest_line()) {
+        con->viewport_top--;
+        vga_flush();
     }
 }
 
 void vga_scroll_down(void) {
     int bottom_top = bottom_viewport_top();
-    if (viewport_top < bottom_top) {
-        viewport_top++;
-        render_viewport();
-        vga_update_cursor();
+    if (con->viewport_top < bottom_top) {
+        con->viewport_top++;
+        vga_flush();
     }
 }
 
 void vga_scroll_to_bottom(void) {
     int bottom_top = bottom_viewport_top();
-    if (viewport_top != bottom_top) {
-        viewport_top = bottom_top;
-        render_viewport();
-        vga_update_cursor();
+    if (con->viewport_top != bottom_top) {
+        con->viewport_top = bottom_top;
+        vga_flush();
+    }
+}
+
+void vga_set_output_console(int index) {
+    if (index >= 0 && index < VGA_CONSOLES) {
+        con = &consoles[index];
+    }
+}
+
+int vga_get_output_console(void) {
+    return (int)(con - consoles);
+}
+
+int vga_get_active_console(void) {
+    int index = requested_console;
+    return index >= 0 ? index : (int)(active - consoles);
+}
+
+void vga_request_console(int index) {
+    if (index >= 0 && index < VGA_CONSOLES) {
+        requested_console = index;
     }
 }
@@ -0,0 +1,38 @@
+/*
+ * MelonOS - ACPI Tables
+ * Locates the RSDP and the system description tables it points to
+ */
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+/* Common header of every system description table */
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+/* Table with the given 4-character signature ("APIC" for the MADT),
+   checksum verified; 0 if there is no ACPI or no such table */
+const acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+/* Sum of length bytes, zero for a valid table */
+uint8_t acpi_checksum(const void *data, uint32_t length);
+
+/* Look for a signature on 16-byte boundaries in [start, start + length)
+   of physical memory; 0 if absent */
+const void *bios_scan(uint32_t start, uint32_t length, const char *signature, uint32_t sig_len);
+
+/* Physical address of the Extended BIOS Data Area (0 if unknown) */
+uint32_t bios_ebda_address(void);
+
+#endif /* ACPI_H */
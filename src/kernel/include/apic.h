@@ -0,0 +1,73 @@
+/*
+ * MelonOS - Local APIC and IOAPIC
+ * Interrupt delivery through the APICs, found via the ACPI MADT or the
+ * MP tables, with the LAPIC timer as a one-shot tick source
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+/* Processors and IOAPICs remembered from the firmware tables */
+#define APIC_MAX_CPUS     16
+#define APIC_MAX_IOAPICS  4
+
+/* Vector the LAPIC reports when an interrupt vanishes before delivery */
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+/* Vector of the cross-CPU call IPI (see smp.h) */
+#define APIC_IPI_VECTOR      0xF0
+
+/* Interrupt command register: delivery mode with the level asserted */
+#define APIC_IPI_FIXED       0x4000
+#define APIC_IPI_INIT        0x4500
+#define APIC_IPI_STARTUP     0x4600  /* Or'd with the start page number */
+
+/*
+ * Find the APICs, enable the local one and route every ISA IRQ through
+ * the IOAPIC to the vector the PIC used (32 + irq), keeping the lines
+ * the PIC had unmasked open. The PIC is masked afterwards. Call with
+ * interrupts off, after clock_init so the LAPIC timer can be measured.
+ * Returns -1, leaving the PIC in charge, if there are no usable APICs.
+ */
+int apic_init(void);
+
+/* Non-zero once apic_init has taken over from the PIC */
+int apic_is_active(void);
+
+/* "ACPI MADT" or "MP table", whichever described the APICs */
+const char *apic_source(void);
+
+/* Processors listed as usable by the firmware, and their APIC IDs
+   (index 0 is the bootstrap processor) */
+int apic_cpu_count(void);
+uint8_t apic_cpu_id(int index);
+
+/* APIC ID of the processor executing this */
+uint8_t lapic_id(void);
+
+/* Signal end of interrupt to the local APIC */
+void lapic_eoi(void);
+
+/* Send an interprocessor interrupt and wait until the LAPIC accepts it */
+void lapic_send_ipi(uint8_t apic_id, uint32_t command);
+
+/* Enable the local APIC of an application processor (apic_init has
+   already run on the bootstrap processor) */
+void apic_init_ap(void);
+
+/* Mask or unmask an ISA IRQ at the IOAPIC */
+void ioapic_set_masked(int irq, int masked);
+
+/* LAPIC timer rate after dividing by 16 (0 if it was not measured) */
+uint32_t apic_timer_khz(void);
+
+/* Deliver LAPIC timer expiries on vector, one-shot */
+void apic_timer_enable(uint8_t vector);
+
+/* Fire the LAPIC timer once, no sooner than ns from now; returns how
+   far ahead it was armed, after clamping to what the counter holds */
+uint64_t apic_timer_oneshot(uint64_t ns);
+
+#endif /* APIC_H */
@@ -0,0 +1,44 @@
+/*
+ * MelonOS - Arena Allocator
+ * Bump-pointer scratch memory that is released in one step
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Every allocation is rounded up to this alignment */
+#define ARENA_ALIGN 8
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+} arena_t;
+
+/* Position in an arena that later allocations can be rolled back to */
+typedef size_t arena_mark_t;
+
+/* Initialize an arena over caller-provided storage */
+void arena_init(arena_t *arena, void *storage, size_t size);
+
+/* Allocate size bytes (returns 0 when the arena is exhausted) */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/* Allocate size zeroed bytes */
+void *arena_zalloc(arena_t *arena, size_t size);
+
+/* Remember the current position / free everything allocated after it */
+arena_mark_t arena_mark(const arena_t *arena);
+void arena_release(arena_t *arena, arena_mark_t mark);
+
+/* Free every allocation at once */
+void arena_reset(arena_t *arena);
+
+/* Bytes still available */
+size_t arena_remaining(const arena_t *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,68 @@
+/*
+ * MelonOS - Atomics
+ * Sequentially consistent operations on a 32-bit counter, and barriers
+ */
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile int32_t value;
+} atomic_t;
+
+#define ATOMIC_INIT(v) { (v) }
+
+static inline int32_t atomic_read(const atomic_t *a) {
+    return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_set(atomic_t *a, int32_t value) {
+    __atomic_store_n(&a->value, value, __ATOMIC_SEQ_CST);
+}
+
+/* Each returns the value after the operation */
+static inline int32_t atomic_add_return(atomic_t *a, int32_t delta) {
+    return __atomic_add_fetch(&a->value, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t atomic_inc_return(atomic_t *a) {
+    return atomic_add_return(a, 1);
+}
+
+static inline int32_t atomic_dec_return(atomic_t *a) {
+    return atomic_add_return(a, -1);
+}
+
+static inline void atomic_inc(atomic_t *a) {
+    atomic_add_return(a, 1);
+}
+
+static inline void atomic_dec(atomic_t *a) {
+    atomic_add_return(a, -1);
+}
+
+/* Returns the value before the swap */
+static inline int32_t atomic_xchg(atomic_t *a, int32_t value) {
+    return __atomic_exchange_n(&a->value, value, __ATOMIC_SEQ_CST);
+}
+
+/* Store desired if the value is expected; returns the value seen, which
+   equals expected on success */
+static inline int32_t atomic_cmpxchg(atomic_t *a, int32_t expected, int32_t desired) {
+    __atomic_compare_exchange_n(&a->value, &expected, desired, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+/* Full barrier, and one that only stops the compiler reordering */
+static inline void smp_mb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void barrier(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+#endif /* ATOMIC_H */
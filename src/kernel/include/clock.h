@@ -0,0 +1,38 @@
+/*
+ * MelonOS - Monotonic Clock
+ * Nanosecond time from the TSC, calibrated against the PIT
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/* Measure the TSC rate; call after timer_init, interrupts may be on or
+   off. Without a usable TSC the clock falls back to PIT ticks. */
+void clock_init(void);
+
+/* Non-zero if clock_ns() is TSC based */
+int clock_has_tsc(void);
+
+/* Calibrated TSC rate (0 without a TSC) */
+uint32_t clock_tsc_khz(void);
+
+/* Raw TSC value (0 without a TSC) */
+uint64_t clock_cycles(void);
+
+/* Nanoseconds since clock_init */
+uint64_t clock_ns(void);
+
+/* Convert between TSC cycles and nanoseconds */
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+uint64_t clock_ns_to_cycles(uint64_t ns);
+
+/* Busy-wait for at least ns nanoseconds */
+void clock_delay_ns(uint64_t ns);
+
+/* Wait at least ns nanoseconds, halting while a timer tick or more
+   remains and spinning for the rest */
+void clock_sleep_ns(uint64_t ns);
+
+#endif /* CLOCK_H */
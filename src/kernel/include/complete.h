@@ -0,0 +1,19 @@
+/*
+ * MelonOS - Tab Completion
+ * Program name and path completion for the shell input line
+ */
+
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+/*
+ * Complete the word that ends at *pos in buffer (holding *len of at
+ * most max_len characters), updating *len and *pos. The first word is
+ * matched against the program registry, later words against the fs.
+ * With list set, a word that still has several candidates and nothing
+ * left to add gets them printed on the lines below; 1 is returned then
+ * and the caller has to draw its input line again.
+ */
+int complete_line(char *buffer, int *len, int *pos, int max_len, int list);
+
+#endif /* COMPLETE_H */
@@ -0,0 +1,186 @@
+/*
+ * MelonOS - CPU Feature Detection
+ * CPUID access and feature flag definitions
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+/* CPUID leaf 1, EDX */
+#define CPUID_1_EDX_TSC   (1u << 4)
+#define CPUID_1_EDX_MSR   (1u << 5)
+#define CPUID_1_EDX_APIC  (1u << 9)
+
+/* CPUID leaf 7 (subleaf 0), EBX */
+#define CPUID_7_EBX_ERMS  (1u << 9)
+
+/* EFLAGS interrupt enable bit */
+#define CPU_EFLAGS_IF     (1u << 9)
+
+typedef struct {
+    uint32_t eax;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+} cpuid_regs_t;
+
+#if defined(__i386__) || defined(__x86_64__)
+
+/* CPUID exists if software can toggle the EFLAGS.ID bit */
+static inline int cpu_has_cpuid(void) {
+    unsigned long original;
+    unsigned long toggled;
+
+    __asm__ volatile (
+        "pushf\n\t"
+        "pop %0\n\t"
+        "mov %0, %1\n\t"
+        "xor $0x200000, %1\n\t"
+        "push %1\n\t"
+        "popf\n\t"
+        "pushf\n\t"
+        "pop %1\n\t"
+        "push %0\n\t"
+        "popf"
+        : "=&r"(original), "=&r"(toggled)
+        :
+        : "cc");
+
+    return ((original ^ toggled) & 0x200000) != 0;
+}
+
+/* Execute CPUID for a leaf/subleaf pair */
+static inline void cpu_cpuid(uint32_t leaf, uint32_t subleaf, cpuid_regs_t *regs) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(regs->eax), "=b"(regs->ebx), "=c"(regs->ecx), "=d"(regs->edx)
+                      : "a"(leaf), "c"(subleaf));
+}
+
+/* Read the time-stamp counter (check CPUID_1_EDX_TSC first) */
+static inline uint64_t cpu_rdtsc(void) {
+    uint32_t low;
+    uint32_t high;
+    __asm__ volatile ("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Spin-wait hint */
+static inline void cpu_pause(void) {
+    __asm__ volatile ("pause" : : : "memory");
+}
+
+#else
+
+/*
+ * Other hosts only see this header through the host test build. They
+ * have no CPUID, so string_init keeps the portable loops, and the host
+ * clock stands in for the TSC.
+ */
+#include <time.h>
+
+static inline int cpu_has_cpuid(void) {
+    return 0;
+}
+
+static inline void cpu_cpuid(uint32_t leaf, uint32_t subleaf, cpuid_regs_t *regs) {
+    (void)leaf;
+    (void)subleaf;
+    regs->eax = regs->ebx = regs->ecx = regs->edx = 0;
+}
+
+static inline uint64_t cpu_rdtsc(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void cpu_pause(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+#endif
+
+#if !__STDC_HOSTED__
+
+/* Model-specific registers (check CPUID_1_EDX_MSR first) */
+static inline uint64_t cpu_rdmsr(uint32_t msr) {
+    uint32_t low;
+    uint32_t high;
+    __asm__ volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+/* Disable interrupts, returning the previous EFLAGS for cpu_irq_restore */
+static inline uint32_t cpu_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/* Re-enable interrupts only if they were on at the matching save */
+static inline void cpu_irq_restore(uint32_t flags) {
+    if (flags & CPU_EFLAGS_IF) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
+
+/* Enable interrupts and halt as one step: sti only takes effect after
+   the next instruction, so an interrupt already pending wakes the hlt
+   instead of slipping in between. Call with interrupts off, after
+   checking there is nothing to do. */
+static inline void cpu_sti_hlt(void) {
+    __asm__ volatile ("sti; hlt" : : : "memory");
+}
+
+static inline int cpu_irqs_enabled(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf\n\tpop %0" : "=r"(flags));
+    return (flags & CPU_EFLAGS_IF) != 0;
+}
+
+#else
+
+/* The host test build runs in user mode: there are no MSRs to reach
+   and no interrupts to mask, so these do nothing */
+static inline uint64_t cpu_rdmsr(uint32_t msr) {
+    (void)msr;
+    return 0;
+}
+
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    (void)msr;
+    (void)value;
+}
+
+static inline uint32_t cpu_irq_save(void) {
+    return 0;
+}
+
+static inline void cpu_irq_restore(uint32_t flags) {
+    (void)flags;
+}
+
+static inline void cpu_sti_hlt(void) {
+}
+
+static inline int cpu_irqs_enabled(void) {
+    return 0;
+}
+
+#endif
+
+/*
+ * Save the callee-saved registers on the current stack, store the stack
+ * pointer in *save_esp and resume the context saved at next_esp
+ * (boot.asm). A fresh stack starts with four zero registers followed by
+ * the address to enter.
+ */
+void context_switch(uint32_t *save_esp, uint32_t next_esp);
+
+#endif /* CPU_H */
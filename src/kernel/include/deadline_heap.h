@@ -0,0 +1,36 @@
+/*
+ * MelonOS - Deadline Heap
+ * Fixed-size binary min-heap of 64-bit deadlines
+ */
+
+#ifndef DEADLINE_HEAP_H
+#define DEADLINE_HEAP_H
+
+#include <stdint.h>
+
+#define DEADLINE_HEAP_SIZE 64
+
+typedef struct {
+    uint64_t entries[DEADLINE_HEAP_SIZE];
+    int count;
+} deadline_heap_t;
+
+/* Forget every deadline */
+void deadline_heap_reset(deadline_heap_t *heap);
+
+/* Add a deadline (duplicates are kept); returns -1 if the heap is full */
+int deadline_heap_push(deadline_heap_t *heap, uint64_t deadline);
+
+/* Drop the earliest deadline; the heap must not be empty */
+void deadline_heap_pop(deadline_heap_t *heap);
+
+static inline int deadline_heap_count(const deadline_heap_t *heap) {
+    return heap->count;
+}
+
+/* Earliest deadline; only valid while the count is non-zero */
+static inline uint64_t deadline_heap_min(const deadline_heap_t *heap) {
+    return heap->entries[0];
+}
+
+#endif /* DEADLINE_HEAP_H */
@@ -0,0 +1,23 @@
+/*
+ * MelonOS - Console Font
+ * Built-in bitmap font for the framebuffer console
+ */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+/* Printable ASCII only; other characters draw as FONT_FALLBACK */
+#define FONT_FIRST    32
+#define FONT_LAST     126
+#define FONT_FALLBACK '?'
+
+/* Rendered cell size in pixels */
+#define FONT_WIDTH    8
+#define FONT_HEIGHT   16
+
+/* Expand a character into FONT_HEIGHT row bytes (bit 7 = leftmost pixel) */
+void font_render(unsigned char c, uint8_t rows[FONT_HEIGHT]);
+
+#endif /* FONT_H */
@@ -0,0 +1,38 @@
+/*
+ * MelonOS - Framebuffer Console Backend
+ * Text cells drawn into a linear 8, 15/16, 24 or 32 bpp framebuffer
+ */
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+
+/* Take the framebuffer from the Multiboot info; returns 0 if a usable
+   graphics framebuffer was provided (RGB at 15, 16, 24 or 32 bpp, or
+   8 bpp indexed), -1 to stay in VGA text mode */
+int fb_init(uint32_t magic, uint32_t mboot_addr);
+
+/* Whether fb_init accepted a framebuffer */
+int fb_is_available(void);
+
+/* Screen geometry in pixels and in console cells */
+uint32_t fb_width(void);
+uint32_t fb_height(void);
+int fb_cols(void);
+int fb_rows(void);
+
+/* Bits per pixel of the framebuffer in use */
+uint32_t fb_bpp(void);
+
+/* Draw one VGA-style cell (character | attribute << 8) */
+void fb_draw_cell(int col, int row, uint16_t cell);
+
+/* Move the screen contents up (rows > 0) or down with one block move;
+   the exposed rows must be redrawn by the caller */
+void fb_scroll(int rows);
+
+/* Draw the underline cursor at a cell, erasing it from its old one */
+void fb_set_cursor(int col, int row);
+
+#endif /* FRAMEBUFFER_H */
@@ -43,4 +43,8 @@ int fs_read_file(const char *path, uint8_t *buffer, uint32_t buffer_size, uint32
 int fs_delete_file(const char *path);
 int fs_get_info(fs_info_t *info);
 
+/* Bumped whenever the tree or the current directory may have changed,
+   so callers can cache listings without touching the disk */
+uint32_t fs_generation(void);
+
 #endif /* FS_H */
\ No newline at end of file
@@ -0,0 +1,43 @@
+/*
+ * MelonOS - Command History
+ * Fixed-slot ring of input lines with substring search
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Lines kept before the oldest is overwritten; a power of two */
+#define HISTORY_CAPACITY   256
+#define HISTORY_ENTRY_SIZE 256
+
+typedef struct {
+    char text[HISTORY_CAPACITY][HISTORY_ENTRY_SIZE];
+    uint8_t len[HISTORY_CAPACITY];
+    uint32_t end;        /* Lines ever appended; free-running, masked on access */
+} history_t;
+
+/* Forget every line */
+void history_reset(history_t *h);
+
+/* Store line as the newest entry, overwriting the oldest when full
+   (empty lines are ignored, long ones truncated) */
+void history_append(history_t *h, const char *line);
+
+/* Entries are indexed from 0 (oldest) to history_count() - 1 (newest) */
+size_t history_count(const history_t *h);
+const char *history_entry(const history_t *h, size_t index);
+
+/* Newest entry below before that contains needle (-1 if none) */
+int history_find(const history_t *h, const char *needle, size_t needle_len, int before);
+
+/* Write the newest entries that fit in size bytes, oldest first and one
+   per line; returns the bytes used */
+size_t history_save(const history_t *h, char *out, size_t size);
+
+/* Append each line of data, as written by history_save */
+void history_load(history_t *h, const char *data, size_t len);
+
+#endif /* HISTORY_H */
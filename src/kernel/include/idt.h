@@ -50,18 +50,41 @@ typedef struct {
 /* IRQ handler function type */
 typedef void (*irq_handler_t)(registers_t *);
 
-/* Initialize GDT */
+/* Null, kernel code/data, user code/data, then this CPU's per-CPU area */
+#define GDT_ENTRIES         6
+#define GDT_PERCPU_SELECTOR 0x28
+
+/* Initialize the bootstrap processor's GDT */
 void gdt_init(void);
 
+/* Build and load the GDT of a CPU, with GS covering its per-CPU area */
+void gdt_init_cpu(int cpu, void *percpu, uint32_t percpu_size);
+
 /* Initialize IDT */
 void idt_init(void);
 
+/* Load the (shared) IDT on the calling CPU */
+void idt_install(void);
+
 /* Register an IRQ handler */
 void irq_install_handler(int irq, irq_handler_t handler);
 
+/* Register the handler for the cross-CPU call vector */
+void ipi_install_handler(irq_handler_t handler);
+
 /* Unregister an IRQ handler */
 void irq_uninstall_handler(int irq);
 
+/* Let an IRQ line through the PIC, or the IOAPIC once it is active */
+void irq_unmask(int irq);
+
+/* Block an IRQ line again */
+void irq_mask(int irq);
+
+/* Mask every line of the 8259 pair, returning a bit per IRQ that was
+   open, so the IOAPIC can take over the same set */
+uint16_t pic_disable(void);
+
 /* Assembly-defined ISR stubs */
 extern void isr0(void);
 extern void isr1(void);
@@ -113,6 +136,8 @@ extern void irq12(void);
 extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
+extern void irq_ipi(void);
+extern void irq_spurious(void);
 
 /* Assembly routines */
 extern void gdt_flush(uint32_t);
@@ -19,16 +19,86 @@
 #define KEY_END              ((char)0x19)
 #define KEY_HISTORY_PREV     ((char)0x1A)
 #define KEY_HISTORY_NEXT     ((char)0x1B)
+#define KEY_REVERSE_SEARCH   ((char)0x1C)  /* Ctrl+R */
+#define KEY_CANCEL           ((char)0x1D)  /* Ctrl+G or Escape */
+
+/* Key codes in key_event_t: keys that type a character use its
+   unshifted ASCII value ('\n', '\b', '\t' and 27 included), the rest
+   use these */
+#define KEYCODE_UP         0x80
+#define KEYCODE_DOWN       0x81
+#define KEYCODE_LEFT       0x82
+#define KEYCODE_RIGHT      0x83
+#define KEYCODE_HOME       0x84
+#define KEYCODE_END        0x85
+#define KEYCODE_PAGE_UP    0x86
+#define KEYCODE_PAGE_DOWN  0x87
+#define KEYCODE_INSERT     0x88
+#define KEYCODE_DELETE     0x89
+#define KEYCODE_F1         0x90  /* F1..F12 are consecutive */
+#define KEYCODE_F11        0x9A
+#define KEYCODE_F12        0x9B
+#define KEYCODE_SHIFT      0xA0
+#define KEYCODE_CTRL       0xA1
+#define KEYCODE_ALT        0xA2
+#define KEYCODE_CAPS_LOCK  0xA3
+
+/* key_event_t.modifiers */
+#define KEY_MOD_SHIFT 0x01
+#define KEY_MOD_CTRL  0x02
+#define KEY_MOD_ALT   0x04
+#define KEY_MOD_CAPS  0x08
+
+/* key_event_t.flags */
+#define KEY_EVENT_RELEASE  0x01
+#define KEY_EVENT_EXTENDED 0x02  /* Sent with the E0 prefix */
+
+typedef struct {
+    uint32_t timestamp;   /* timer_get_ticks() when the IRQ fired */
+    uint8_t scancode;     /* Set 1 code without the release bit */
+    uint8_t keycode;
+    uint8_t modifiers;    /* Held after this event was applied */
+    uint8_t flags;
+} key_event_t;
 
 /* Initialize the keyboard driver */
 void keyboard_init(void);
 
+/* Take the next press or release event for the current output console
+   (returns 0 if there is none) */
+int keyboard_poll_event(key_event_t *event);
+
+/* Character a press event types, with shift and caps lock applied
+   (0 for releases and keys without one) */
+char keyboard_event_char(const key_event_t *event);
+
+/* Events lost because the IRQ ring or a console queue was full */
+uint32_t keyboard_dropped_events(void);
+
 /* Get the last pressed key (blocking) */
 char keyboard_getchar(void);
 
-/* Check if a key is available */
+/* Check if a key is available for the current output console */
 int keyboard_has_key(void);
 
+/* Check if a key is queued for the given virtual console */
+int keyboard_pending(int console);
+
+/* Halt until the next interrupt unless input is already waiting */
+void keyboard_halt(void);
+
+/* Bumped whenever keys or serial bytes arrive or are routed */
+uint32_t keyboard_input_seq(void);
+
+/* Wait until keyboard_input_seq() differs from seen: a thread sleeps,
+   anything else halts (keyboard_halt) */
+void keyboard_wait_input(uint32_t seen);
+
+/* Called while keyboard_getchar has nothing to return, with the input
+   sequence read before it looked; the handler may run other work and
+   must wait itself (keyboard_wait_input) when idle */
+void keyboard_set_idle_handler(void (*handler)(uint32_t seen));
+
 /* Read a line of input into buffer, returns length */
 int keyboard_readline(char *buffer, int max_len);
 
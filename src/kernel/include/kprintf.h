@@ -0,0 +1,48 @@
+/*
+ * MelonOS - Formatted Output
+ * printf-style formatting into buffers, the console and other sinks
+ */
+
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Destination for formatted output. The formatter stages text locally
+ * and hands it to write() in chunks, so a sink sees a handful of bulk
+ * writes per call rather than one call per character.
+ */
+typedef struct kprintf_sink {
+    void (*write)(struct kprintf_sink *sink, const char *data, size_t len);
+    void *context;
+} kprintf_sink_t;
+
+/*
+ * Supported conversions: %d %i %u %x %X %o %c %s %p %%
+ * Flags: - 0 + space #, width and precision (including *),
+ * length modifiers: hh h l ll z
+ */
+
+/* Format into a sink; returns the number of characters produced */
+int kformat(kprintf_sink_t *sink, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int kvformat(kprintf_sink_t *sink, const char *fmt, va_list args);
+
+/* Format into a buffer (always NUL-terminated when size > 0);
+   returns the length the full output would have had */
+int ksnprintf(char *buffer, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int kvsnprintf(char *buffer, size_t size, const char *fmt, va_list args);
+
+/* Format to the console */
+int kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int kvprintf(const char *fmt, va_list args);
+
+/* Integer to decimal/hex text without a terminator; returns the length.
+   buffer must hold 10 (u32), 20 (u64) or 16 (hex64) characters. */
+size_t kfmt_u32(char *buffer, uint32_t value);
+size_t kfmt_u64(char *buffer, uint64_t value);
+size_t kfmt_hex(char *buffer, uint64_t value, int uppercase);
+
+#endif /* KPRINTF_H */
@@ -0,0 +1,67 @@
+/*
+ * MelonOS - 64-bit Arithmetic Helpers
+ * Division and scaling without libgcc's 64-bit helpers
+ */
+
+#ifndef MATH64_H
+#define MATH64_H
+
+#include <stdint.h>
+
+/* Divide a 64-bit value by a 32-bit divisor using two 32-bit divides */
+static inline uint64_t div64_u32(uint64_t dividend, uint32_t divisor, uint32_t *remainder) {
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t low = (uint32_t)dividend;
+    uint32_t quotient_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t quotient_low;
+
+    __asm__ ("divl %4"
+             : "=a"(quotient_low), "=d"(rem)
+             : "a"(low), "d"(rem), "rm"(divisor));
+
+    if (remainder != 0) {
+        *remainder = rem;
+    }
+
+    return ((uint64_t)quotient_high << 32) | quotient_low;
+#else
+    /* Host builds elsewhere have the 64-bit divide */
+    if (remainder != 0) {
+        *remainder = (uint32_t)(dividend % divisor);
+    }
+    return dividend / divisor;
+#endif
+}
+
+/* (value * mult) >> shift for shift <= 32, computed from two 32x32
+   products so the full 96-bit intermediate never overflows */
+static inline uint64_t mul64_u32_shr(uint64_t value, uint32_t mult, uint32_t shift) {
+    uint64_t low = (uint64_t)(uint32_t)value * mult;
+    uint64_t high = (uint64_t)(uint32_t)(value >> 32) * mult;
+
+    if (shift == 0) {
+        return (high << 32) + low;
+    }
+    return (high << (32 - shift)) + (low >> shift);
+}
+
+/*
+ * Multiplier and shift for converting with mul64_u32_shr at the ratio
+ * to / from: the largest shift (up to 32) whose multiplier still fits
+ * in 32 bits, for the most precision.
+ */
+static inline void pick_scale(uint32_t to, uint32_t from, uint32_t *mult, uint32_t *shift) {
+    for (uint32_t s = 32; ; s--) {
+        uint64_t m = div64_u32((uint64_t)to << s, from, 0);
+
+        if ((m >> 32) == 0 || s == 0) {
+            *mult = (uint32_t)m;
+            *shift = s;
+            return;
+        }
+    }
+}
+
+#endif /* MATH64_H */
@@ -0,0 +1,70 @@
+/*
+ * MelonOS - Multiboot
+ * Boot information handed over by a Multiboot (v1) loader
+ */
+
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+/* Value in EAX when a Multiboot loader starts the kernel */
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+/* multiboot_info_t.flags bits */
+#define MULTIBOOT_INFO_MEMORY      (1u << 0)
+#define MULTIBOOT_INFO_MEM_MAP     (1u << 6)
+#define MULTIBOOT_INFO_FRAMEBUFFER (1u << 12)
+
+/* multiboot_info_t.framebuffer_type values */
+#define MULTIBOOT_FRAMEBUFFER_INDEXED  0
+#define MULTIBOOT_FRAMEBUFFER_RGB      1
+#define MULTIBOOT_FRAMEBUFFER_EGA_TEXT 2
+
+typedef struct {
+    uint32_t flags;
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+    uint32_t vbe_control_info;
+    uint32_t vbe_mode_info;
+    uint16_t vbe_mode;
+    uint16_t vbe_interface_seg;
+    uint16_t vbe_interface_off;
+    uint16_t vbe_interface_len;
+    uint64_t framebuffer_addr;
+    uint32_t framebuffer_pitch;
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint8_t  framebuffer_bpp;
+    uint8_t  framebuffer_type;
+    union {
+        /* MULTIBOOT_FRAMEBUFFER_INDEXED: num_colors 3-byte R, G, B entries */
+        struct {
+            uint32_t framebuffer_palette_addr;
+            uint16_t framebuffer_palette_num_colors;
+        } __attribute__((packed));
+        /* MULTIBOOT_FRAMEBUFFER_RGB: where each channel sits in a pixel */
+        struct {
+            uint8_t red_field_position;
+            uint8_t red_mask_size;
+            uint8_t green_field_position;
+            uint8_t green_mask_size;
+            uint8_t blue_field_position;
+            uint8_t blue_mask_size;
+        } __attribute__((packed));
+    };
+} __attribute__((packed)) multiboot_info_t;
+
+#endif /* MULTIBOOT_H */
@@ -7,6 +7,8 @@
 #define PROGRAM_H
 
 #include <stddef.h>
+#include "arena.h"
+#include "trie.h"
 
 typedef void (*program_entry_t)(int argc, char *argv[]);
 
@@ -21,6 +23,12 @@ int program_register(const program_t *program);
 const program_t *program_find(const char *name);
 const program_t *program_get(size_t index);
 size_t program_count(void);
+
+/* Prefix trie of the registered names; values are registry index + 1 */
+const trie_t *program_names(void);
 int program_run(const char *name, int argc, char *argv[]);
 
+/* Scratch arena for the running program, released when it returns */
+arena_t *program_arena(void);
+
 #endif /* PROGRAM_H */
\ No newline at end of file
@@ -0,0 +1,151 @@
+/*
+ * MelonOS - Kernel Threads
+ * Preemptive priority scheduling with per-CPU run queues, wait queues
+ * and sleeping mutexes
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "spinlock.h"
+
+#define SCHED_MAX_THREADS  24
+#define THREAD_STACK_SIZE  16384
+#define THREAD_NAME_LEN    16
+
+/* Lower runs first; a thread only runs while nothing of a better
+   priority is runnable on its CPU. Idle threads are never queued. */
+#define SCHED_PRIORITY_HIGH    0
+#define SCHED_PRIORITY_NORMAL  1
+#define SCHED_PRIORITY_LOW     2
+#define SCHED_PRIORITY_IDLE    3
+#define SCHED_PRIORITIES       4
+
+/* Deadline for a sleep only thread_wake ends */
+#define SCHED_FOREVER 0xFFFFFFFFFFFFFFFFull
+
+typedef enum {
+    THREAD_FREE = 0,
+    THREAD_RUNNABLE,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+} thread_state_t;
+
+typedef struct thread {
+    uint32_t esp;                 /* Saved by context_switch */
+    volatile thread_state_t state;
+    int priority;
+    int cpu;                      /* Run queue it belongs to, for good */
+    uint32_t id;
+    char name[THREAD_NAME_LEN];
+    void (*entry)(void *arg);
+    void *arg;
+    uint64_t wake_at;             /* While blocked: clock_ns() deadline */
+    void *waiting_on;             /* Wait queue it sleeps on, if any */
+    int wake_pending;             /* thread_wake came while it was awake */
+    uint64_t runtime_ns;
+    uint32_t switches;            /* Times it was switched in */
+    struct thread *run_next;      /* Run queue link */
+    struct thread *wait_next;     /* Wait queue link */
+} thread_t;
+
+typedef struct {
+    spinlock_t lock;
+    thread_t *head;
+    thread_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, 0, 0 }
+
+typedef struct {
+    volatile int locked;
+    wait_queue_t waiters;
+} mutex_t;
+
+#define MUTEX_INIT { 0, WAIT_QUEUE_INIT }
+
+/* Make the running boot code thread "main" on the bootstrap processor
+   and start scheduling there; call after smp_init */
+void sched_init(void);
+
+/* Become this application processor's idle thread (never returns) */
+void sched_idle_cpu(void);
+
+/* Non-zero once this CPU schedules threads */
+int sched_is_running(void);
+
+/* Non-zero if the caller may block: a thread other than idle, with
+   interrupts on */
+int sched_can_block(void);
+
+/* Start entry(arg) on CPU cpu (-1 for the calling one); returns 0 when
+   every thread slot is in use */
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg, int priority, int cpu);
+
+/* Thread running on this CPU (0 before the scheduler starts) */
+thread_t *thread_current(void);
+
+/* End the calling thread */
+void thread_exit(void) __attribute__((noreturn));
+
+/* Let other runnable threads of the same or a better priority run */
+void sched_yield(void);
+
+/* Block until clock_ns() reaches deadline_ns or thread_wake is called */
+void sched_sleep_until(uint64_t deadline_ns);
+
+/* End a sched_sleep_until early. If the thread is not asleep yet, its
+   next sched_sleep_until returns at once, so a wakeup sent between
+   checking for work and sleeping is not lost. A thread in wait_event
+   is left to its queue. */
+void thread_wake(thread_t *thread);
+
+/* Forget a thread_wake the calling thread got while awake, before a
+   sleep that is only waiting for time to pass */
+void thread_clear_wake(void);
+
+/* Called on the way out of every IRQ: wakes sleepers, ends expired time
+   slices and switches threads if a better one is waiting */
+void sched_irq_exit(void);
+
+/* Copy the thread in a slot (0 .. SCHED_MAX_THREADS - 1), for listings;
+   returns -1 if the slot is free */
+int sched_thread_info(int index, thread_t *out);
+
+/* Context switches made on a CPU */
+uint32_t sched_switches(int cpu);
+
+/* Wait queue primitives; wait_event is the usual way in */
+uint32_t wait_lock(wait_queue_t *wq);
+void wait_unlock(wait_queue_t *wq, uint32_t flags);
+void wait_sleep_locked(wait_queue_t *wq, uint32_t flags);
+void wake_up_all(wait_queue_t *wq);
+
+/*
+ * Sleep on wq until condition holds. The condition is tested with the
+ * queue locked, and wakers change what it reads before calling
+ * wake_up_all, so a wakeup cannot slip in between test and sleep.
+ * Before the scheduler runs this spins instead.
+ */
+#define wait_event(wq, condition)                           \
+    do {                                                    \
+        while (1) {                                         \
+            uint32_t wait_flags_ = wait_lock(wq);           \
+            if (condition) {                                \
+                wait_unlock(wq, wait_flags_);               \
+                break;                                      \
+            }                                               \
+            wait_sleep_locked(wq, wait_flags_);             \
+        }                                                   \
+    } while (0)
+
+/* Sleeping lock for code that may block while holding it */
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+/* Returns non-zero if the mutex was taken without waiting */
+int mutex_trylock(mutex_t *mutex);
+
+#endif /* SCHED_H */
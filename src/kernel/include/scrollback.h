@@ -0,0 +1,51 @@
+/*
+ * MelonOS - Scrollback Store
+ * Run-length encoded console history lines
+ */
+
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vga.h"
+
+/* Upper bound on stored lines and bytes; whichever runs out first
+   evicts the oldest lines */
+#define SCROLLBACK_MAX_LINES   10000
+#define SCROLLBACK_STORE_BYTES (128 * 1024)
+
+/* Every 32nd line records its byte position so lookups skip at most
+   31 records */
+#define SCROLLBACK_CHECKPOINT_SHIFT 5
+#define SCROLLBACK_CHECKPOINTS      ((SCROLLBACK_MAX_LINES >> SCROLLBACK_CHECKPOINT_SHIFT) + 2)
+
+typedef struct {
+    uint8_t store[SCROLLBACK_STORE_BYTES];
+    uint32_t head_pos;   /* Free-running byte positions; masked on access */
+    uint32_t tail_pos;
+    int first_line;
+    int end_line;
+    uint32_t checkpoint[SCROLLBACK_CHECKPOINTS];
+} scrollback_t;
+
+/* Drop every line; the next appended line gets number base_line */
+void scrollback_reset(scrollback_t *sb, int base_line);
+
+/* Stored lines are numbered [first, end) */
+int scrollback_first(const scrollback_t *sb);
+int scrollback_end(const scrollback_t *sb);
+
+/* Encode a line of width cells as line number scrollback_end() */
+void scrollback_append(scrollback_t *sb, const uint16_t *cells, int width);
+
+/* Decode a stored line into width cells (returns -1 if not stored) */
+int scrollback_read(const scrollback_t *sb, int line, uint16_t *cells, int width);
+
+/* Newest stored line below before whose text contains needle (-1 if none) */
+int scrollback_find(const scrollback_t *sb, const char *needle, size_t needle_len, int before);
+
+/* Bytes of encoded lines currently held */
+size_t scrollback_bytes_used(const scrollback_t *sb);
+
+#endif /* SCROLLBACK_H */
@@ -0,0 +1,36 @@
+/*
+ * MelonOS - Serial Port Driver
+ * 16550 UART console on COM1
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SERIAL_DEFAULT_BAUD 115200
+
+/* Probe and program COM1; returns 0 if a UART answered, -1 otherwise */
+int serial_init(uint32_t baud);
+
+/* Whether serial_init found a working UART */
+int serial_is_present(void);
+
+/* Queue bytes for transmission (waits only when the TX ring is full) */
+void serial_write(const char *buf, size_t len);
+
+/* Queue console text: LF becomes CR LF and backspace erases the cell */
+void serial_console_write(const char *buf, size_t len);
+
+/* Check for / take a received byte (serial_read returns -1 if none) */
+int serial_has_byte(void);
+int serial_read(void);
+
+/* Bytes dropped because the RX ring was full */
+uint32_t serial_rx_overruns(void);
+
+/* Have notify() called from the IRQ handler whenever bytes arrive */
+void serial_set_rx_notify(void (*notify)(void));
+
+#endif /* SERIAL_H */
@@ -15,4 +15,16 @@ void shell_run(void);
 size_t shell_history_count(void);
 const char *shell_history_entry(size_t index);
 
+/* Newest history index below before whose text contains needle (-1 if none) */
+int shell_history_find(const char *needle, size_t needle_len, int before);
+
+/* Write commands not yet saved to the history file (also done every few
+   commands on its own) */
+int shell_history_save(void);
+
+/* Tab completion for keyboard_readline. The cursor has to be at the end
+   of the line when list is set; returns 1 if candidates were listed and
+   a new prompt printed, so the line must be drawn again from scratch */
+int shell_complete(char *buffer, int *len, int *pos, int max_len, int list);
+
 #endif /* SHELL_H */
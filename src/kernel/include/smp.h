@@ -0,0 +1,83 @@
+/*
+ * MelonOS - Multiprocessor Support
+ * Application processor startup, per-CPU data and cross-CPU calls
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "apic.h"
+#include "spinlock.h"
+
+#define SMP_MAX_CPUS APIC_MAX_CPUS
+
+/* Real-mode page the startup IPI points the APs at (must be below
+   1 MiB, 4 KiB aligned, and match TRAMPOLINE_BASE in boot.asm) */
+#define SMP_TRAMPOLINE_BASE 0x8000
+
+/* Stack each application processor starts on */
+#define SMP_STACK_SIZE 8192
+
+/* Function run on another CPU by smp_call */
+typedef void (*smp_call_fn_t)(void *arg);
+
+/*
+ * One per CPU, reached through the GS segment each CPU's GDT points at
+ * its own entry. self must stay first: this_cpu() reads it from gs:0.
+ */
+typedef struct percpu {
+    struct percpu *self;
+    int index;                    /* 0 is the bootstrap processor */
+    uint8_t apic_id;
+    volatile int online;
+
+    /* Cross-CPU call mailbox, guarded by call_lock */
+    spinlock_t call_lock;
+    smp_call_fn_t call_fn;
+    void *call_arg;
+    volatile uint32_t call_requested;
+    volatile uint32_t call_started;
+    volatile uint32_t call_completed;
+    uint32_t calls_handled;
+} percpu_t;
+
+/* This CPU's per-CPU area (valid from gdt_init on) */
+static inline percpu_t *this_cpu(void) {
+    percpu_t *cpu;
+    __asm__ volatile ("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline int smp_cpu_index(void) {
+    return this_cpu()->index;
+}
+
+/* Per-CPU area of the CPU with this index */
+percpu_t *percpu_of(int index);
+
+/* Start every application processor the APIC tables list and park it
+   in hlt; call with interrupts on, after apic_init. Returns the number
+   of CPUs online, the bootstrap processor included. */
+int smp_init(void);
+
+/* CPUs that finished starting */
+int smp_cpu_count(void);
+
+/*
+ * Run fn(arg) on CPU index from its IPI handler. Returns once the
+ * target has taken the request, or after fn has finished if wait is
+ * set; -1 if the CPU is not online. A call to the current CPU runs fn
+ * directly. Calls aimed at this CPU are served while waiting, so two
+ * CPUs calling each other do not deadlock.
+ */
+int smp_call(int index, smp_call_fn_t fn, void *arg, int wait);
+
+/* smp_call on every other online CPU */
+void smp_call_others(smp_call_fn_t fn, void *arg, int wait);
+
+/* Interrupt CPU index with an empty call, so it rechecks its run queue
+   on the way out of the IPI */
+void smp_kick(int index);
+
+#endif /* SMP_H */
@@ -0,0 +1,125 @@
+/*
+ * MelonOS - Spinlocks
+ * Ticket spinlocks, reader-writer locks and seqlocks, with IRQ-saving
+ * variants and optional contention counters
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+
+/*
+ * Counters for one lock or a family of locks. A lock only pays for them
+ * when it was given a lock_stats_t; they are listed (lock_stats_first)
+ * once the lock has been taken.
+ */
+typedef struct lock_stats {
+    const char *name;
+    volatile uint32_t acquired;    /* Times taken (reads included) */
+    volatile uint32_t contended;   /* Times the taker had to wait */
+    volatile uint32_t spins;       /* Pause rounds spent waiting */
+    volatile uint32_t retries;     /* Seqlock reads that started over */
+    volatile int listed;
+    struct lock_stats *next;
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(name) { (name), 0, 0, 0, 0, 0, 0 }
+
+/*
+ * The kernel's own locks count contention only in a LOCK_STATS=1 build
+ * (make LOCK_STATS=1); otherwise LOCK_STATS_REF drops the counters and
+ * the locks run without them.
+ */
+#ifndef LOCK_STATS
+#define LOCK_STATS 0
+#endif
+
+#if LOCK_STATS
+#define LOCK_STATS_REF(stats) (stats)
+#else
+#define LOCK_STATS_REF(stats) ((lock_stats_t *)0)
+#endif
+
+#define DEFINE_LOCK_STATS(var, name) \
+    static lock_stats_t var __attribute__((unused)) = LOCK_STATS_INIT(name)
+
+/* Served in arrival order: take a ticket, wait for owner to reach it */
+typedef struct {
+    volatile uint32_t next;
+    volatile uint32_t owner;
+    lock_stats_t *stats;
+} spinlock_t;
+
+#define SPINLOCK_INIT                 { 0, 0, 0 }
+#define SPINLOCK_INIT_STATS(stats)    { 0, 0, LOCK_STATS_REF(stats) }
+
+/* Any number of readers or one writer. A waiting writer holds off new
+   readers, so a steady stream of them cannot starve it. */
+typedef struct {
+    volatile int32_t state;        /* Readers inside, or -1 for a writer */
+    volatile uint32_t writers_waiting;
+    lock_stats_t *stats;
+} rwlock_t;
+
+#define RWLOCK_INIT                   { 0, 0, 0 }
+#define RWLOCK_INIT_STATS(stats)      { 0, 0, LOCK_STATS_REF(stats) }
+
+/* Readers never block a writer: they copy the data and retry if the
+   sequence changed meanwhile. For small data read far more often than
+   written, where a torn copy can simply be thrown away. */
+typedef struct {
+    volatile uint32_t sequence;    /* Odd while a write is in progress */
+    spinlock_t lock;               /* Orders writers */
+} seqlock_t;
+
+#define SEQLOCK_INIT                  { 0, SPINLOCK_INIT }
+#define SEQLOCK_INIT_STATS(stats)     { 0, SPINLOCK_INIT_STATS(stats) }
+
+/* The _init functions take stats as is; wrap it in LOCK_STATS_REF to
+   follow the build setting */
+void spin_lock_init(spinlock_t *lock, lock_stats_t *stats);
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+
+/* Returns non-zero if the lock was taken without waiting */
+int spin_trylock(spinlock_t *lock);
+
+int spin_is_locked(const spinlock_t *lock);
+
+/* For locks also taken from IRQ handlers: interrupts stay off while
+   held, and the flags go back to spin_unlock_irqrestore */
+uint32_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags);
+
+void rwlock_init(rwlock_t *lock, lock_stats_t *stats);
+void read_lock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+uint32_t read_lock_irqsave(rwlock_t *lock);
+void read_unlock_irqrestore(rwlock_t *lock, uint32_t flags);
+uint32_t write_lock_irqsave(rwlock_t *lock);
+void write_unlock_irqrestore(rwlock_t *lock, uint32_t flags);
+
+void seqlock_init(seqlock_t *lock, lock_stats_t *stats);
+
+/*
+ * Read side:
+ *     do {
+ *         seq = read_seqbegin(&lock);
+ *         copy = shared;
+ *     } while (read_seqretry(&lock, seq));
+ */
+uint32_t read_seqbegin(const seqlock_t *lock);
+int read_seqretry(seqlock_t *lock, uint32_t start);
+
+void write_seqlock(seqlock_t *lock);
+void write_sequnlock(seqlock_t *lock);
+uint32_t write_seqlock_irqsave(seqlock_t *lock);
+void write_sequnlock_irqrestore(seqlock_t *lock, uint32_t flags);
+
+/* Every lock_stats_t taken so far, newest first (follow ->next) */
+lock_stats_t *lock_stats_first(void);
+
+#endif /* SPINLOCK_H */
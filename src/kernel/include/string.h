@@ -30,9 +30,27 @@ char *strcat(char *dest, const char *src);
 /* Set memory */
 void *memset(void *ptr, int value, size_t num);
 
+/* Fill count 16-bit cells with value */
+void *memset16(void *ptr, uint16_t value, size_t count);
+
 /* Copy memory */
 void *memcpy(void *dest, const void *src, size_t num);
 
+/* Copy memory, handling overlapping regions */
+void *memmove(void *dest, const void *src, size_t num);
+
+/* Compare memory */
+int memcmp(const void *s1, const void *s2, size_t num);
+
+/* Find the first occurrence of needle in haystack (0 if absent) */
+void *memmem(const void *haystack, size_t haystack_len, const void *needle, size_t needle_len);
+
+/* Pick the fastest copy/fill routines for this CPU (call once at boot) */
+void string_init(void);
+
+/* Name of the copy/fill strategy selected by string_init */
+const char *string_accel_name(void);
+
 /* Convert string to integer */
 int atoi(const char *str);
 
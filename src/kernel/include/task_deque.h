@@ -0,0 +1,57 @@
+/*
+ * MelonOS - Task Deque
+ * Chase-Lev work-stealing deque behind the task pool, and the way
+ * parallel_for cuts a range into slices
+ */
+
+#ifndef TASK_DEQUE_H
+#define TASK_DEQUE_H
+
+#include <stdint.h>
+#include "task_pool.h"
+
+/*
+ * One owner pushes and pops at the bottom; anyone may steal from the
+ * top, and only the last task is contended. Threads taking turns as the
+ * owner must do so with interrupts off, so no switch lands halfway
+ * through a push or pop.
+ */
+typedef struct {
+    volatile int32_t top;         /* Next to steal; only ever grows */
+    volatile int32_t bottom;      /* Next free slot; owner only */
+    task_t *volatile slots[TASK_DEQUE_SIZE];
+    uint32_t executed;            /* Tasks task_run ran for this deque */
+    uint32_t stolen;              /* Of those, taken from another deque */
+} task_deque_t;
+
+/* Owner only. Push returns -1 if the deque is full; pop takes the newest
+   task, or returns 0 if there is none */
+int task_deque_push(task_deque_t *dq, task_t *task);
+task_t *task_deque_pop(task_deque_t *dq);
+
+/* Any CPU: take the oldest task, or 0 if there is none or another taker
+   got it first */
+task_t *task_deque_steal(task_deque_t *dq);
+
+/* Run a task, count it on dq (if any) and take it off its group's
+   pending count */
+void task_run(task_deque_t *dq, task_t *task);
+
+/*
+ * Add task to group and push it on dq (interrupts off for the push). If
+ * dq is 0 or full the task runs here instead. Returns 0 if queued, -1 if
+ * it already ran.
+ */
+int task_queue(task_deque_t *dq, task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg);
+
+/*
+ * Cut [begin, end) into near-equal slices, no more than max_slices and
+ * no more than there are grains in the range (a grain of 0 counts as 1).
+ * All slices but the last have the same size. Slice i covers
+ * [bounds[i], bounds[i + 1]), so bounds needs max_slices + 1 entries.
+ * Returns the number of slices, 0 for an empty range.
+ */
+uint32_t parallel_slices(uint32_t begin, uint32_t end, uint32_t grain,
+                         uint32_t max_slices, uint32_t *bounds);
+
+#endif /* TASK_DEQUE_H */
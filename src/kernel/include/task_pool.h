@@ -0,0 +1,59 @@
+/*
+ * MelonOS - Task Pool
+ * Short jobs spread over the CPUs: one worker thread per application
+ * processor, per-CPU work-stealing deques and parallel_for
+ */
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stdint.h>
+
+/* Tasks each CPU's deque holds; a spawn into a full deque runs inline */
+#define TASK_DEQUE_SIZE      256
+
+/* Most pieces parallel_for cuts a range into */
+#define PARALLEL_MAX_CHUNKS  32
+
+typedef struct {
+    volatile uint32_t pending;   /* Spawned and not yet finished */
+} task_group_t;
+
+#define TASK_GROUP_INIT { 0 }
+
+/* Caller-owned; must stay valid until task_wait on its group returns */
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    task_group_t *group;
+} task_t;
+
+/* Runs body on [begin, end) slices of a parallel_for range */
+typedef void (*parallel_body_t)(uint32_t begin, uint32_t end, void *arg);
+
+/* Start a worker on every other online CPU; call after sched_init.
+   Returns the number of workers (0 means everything runs inline). */
+int task_pool_init(void);
+
+/* Workers started by task_pool_init */
+int task_pool_workers(void);
+
+/* Queue task on the calling CPU's deque, where idle workers steal it */
+void task_spawn(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg);
+
+/* Run or steal tasks until every task of group has finished */
+void task_wait(task_group_t *group);
+
+/*
+ * Call body over [begin, end) in slices of at least grain items, on as
+ * many CPUs as will take them, and return once all have finished. The
+ * caller runs slices too. Slices run concurrently: body must only touch
+ * its own slice, or use atomics.
+ */
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, parallel_body_t body, void *arg);
+
+/* Tasks a CPU has run, and how many of them it stole from another CPU */
+uint32_t task_pool_executed(int cpu);
+uint32_t task_pool_stolen(int cpu);
+
+#endif /* TASK_POOL_H */
@@ -8,16 +8,44 @@
 
 #include <stdint.h>
 
+/* Input clock of every PIT channel, in Hz */
+#define PIT_FREQUENCY 1193180
+
+/* Vector of the timer interrupt: IRQ0 on the PIC, and the LAPIC timer
+   once it takes over (on every CPU) */
+#define TIMER_VECTOR 32
+
 /* Initialize the PIT timer at a given frequency */
 void timer_init(uint32_t frequency);
 
+/* Stop the periodic tick and program a one-shot for each deadline
+   instead, on the LAPIC timer if apic_init measured it and on the PIT
+   otherwise; needs the calibrated TSC clock (returns -1 without) */
+int timer_enable_oneshot(void);
+int timer_is_oneshot(void);
+
+/* "LAPIC" or "PIT", whichever raises the timer interrupt */
+const char *timer_source(void);
+
+/* Have a timer interrupt arrive no later than deadline_ns on the
+   clock_ns() scale; returns -1 if that cannot be promised (periodic
+   mode, or too many deadlines pending). Other CPUs hand the request to
+   CPU 0, which owns the timer. */
+int timer_wake_at(uint64_t deadline_ns);
+
 /* Get current tick count */
 uint32_t timer_get_ticks(void);
 
+/* Tick rate passed to timer_init */
+uint32_t timer_get_frequency(void);
+
+/* Timer interrupts taken since boot */
+uint32_t timer_get_interrupts(void);
+
 /* Get uptime in seconds */
 uint32_t timer_get_uptime(void);
 
-/* Sleep for a number of milliseconds (approximate) */
+/* Sleep for at least a number of milliseconds (see clock_sleep_ns) */
 void timer_sleep(uint32_t ms);
 
 #endif /* TIMER_H */
@@ -0,0 +1,44 @@
+/*
+ * MelonOS - Software Timers
+ * One-shot callbacks on a hashed timing wheel
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/* Slot width and count; deadlines are rounded up to a whole slot */
+#define TIMER_WHEEL_TICK_NS 1000000u
+#define TIMER_WHEEL_SLOTS   256
+#define TIMER_POOL_SIZE     64
+
+typedef void (*timer_callback_t)(void *arg);
+
+/* Run callback(arg) once clock_ns() reaches deadline_ns. Returns an id
+   for timer_cancel, or -1 when every timer is in use. Safe to call from
+   IRQ handlers and from callbacks (to re-arm a periodic timer). */
+int timer_add(uint64_t deadline_ns, timer_callback_t callback, void *arg);
+
+/* Stop a timer that has not run yet (returns -1 if it already ran or
+   the id is stale) */
+int timer_cancel(int id);
+
+/*
+ * Run the callbacks whose deadline has passed. They are never run from
+ * an interrupt: the "timers" thread calls this whenever it wakes, so
+ * callbacks may block and use the fs (under the locks its callers use).
+ */
+void timer_run_expired(void);
+
+/* Start the thread that runs expired callbacks; call after sched_init.
+   Returns -1 if it could not be created. */
+int timer_wheel_start(void);
+
+/* Non-zero if timer_run_expired has work now */
+int timer_work_due(void);
+
+/* Timers waiting to run */
+int timer_pending_count(void);
+
+#endif /* TIMER_WHEEL_H */
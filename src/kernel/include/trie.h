@@ -0,0 +1,56 @@
+/*
+ * MelonOS - Prefix Trie
+ * Word sets over caller-provided node storage, for prefix lookups
+ */
+
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Longest word trie_visit can hand to its callback */
+#define TRIE_MAX_WORD 64
+
+/*
+ * Children hang off first_child as a sibling list kept in byte order,
+ * so a walk visits words sorted. Index 0 is the root, which is never
+ * anyone's child or sibling, so 0 doubles as "none".
+ */
+typedef struct {
+    char ch;
+    uint8_t reserved;
+    uint16_t first_child;
+    uint16_t sibling;
+    uint16_t value;       /* Non-zero where a word ends */
+    uint16_t words;       /* Words in this subtree */
+} trie_node_t;
+
+typedef struct {
+    trie_node_t *nodes;
+    size_t capacity;
+    size_t used;
+} trie_t;
+
+/* Initialize an empty trie over storage for capacity nodes */
+void trie_init(trie_t *trie, trie_node_t *storage, size_t capacity);
+
+/* Remove every word */
+void trie_reset(trie_t *trie);
+
+/* Add word with a non-zero value (returns -1 if it is empty, already
+   present or the nodes run out; the trie is unchanged then) */
+int trie_insert(trie_t *trie, const char *word, uint16_t value);
+
+/* Value stored for word, 0 if absent */
+uint16_t trie_lookup(const trie_t *trie, const char *word);
+
+/* Count the words starting with prefix and write the characters they
+   all share after it to out (always terminated) */
+size_t trie_complete(const trie_t *trie, const char *prefix, char *out, size_t out_size);
+
+/* Call visit for each word starting with prefix, in sorted order */
+void trie_visit(const trie_t *trie, const char *prefix,
+                void (*visit)(const char *word, uint16_t value, void *ctx), void *ctx);
+
+#endif /* TRIE_H */
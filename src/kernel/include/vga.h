@@ -29,21 +29,40 @@ enum vga_color {
     VGA_COLOR_WHITE         = 15,
 };
 
+/* Text mode geometry */
 #define VGA_WIDTH  80
 #define VGA_HEIGHT 25
 
+/* Largest console a framebuffer mode may provide; the actual size is
+   reported by vga_get_width / vga_get_height */
+#define CONSOLE_MAX_COLS 160
+#define CONSOLE_MAX_ROWS 64
+
+/* Virtual consoles, switched with Alt+F1..F4 */
+#define VGA_CONSOLES 4
+
 /* Initialize VGA driver */
 void vga_init(void);
 
 /* Clear the screen */
 void vga_clear(void);
 
-/* Set the current text color */
+/* Set the current text color (also what SGR 0 resets to) */
 void vga_set_color(enum vga_color fg, enum vga_color bg);
 
 /* Print a single character */
 void vga_putchar(char c);
 
+/*
+ * Write len characters, updating the hardware cursor once at the end.
+ * ANSI CSI sequences are interpreted: cursor movement (A B C D G H f),
+ * erase (J K), SGR colours (m) and save/restore (s u).
+ */
+void vga_write(const char *buf, size_t len);
+
+/* Apply any deferred redraw and move the hardware cursor now */
+void vga_flush(void);
+
 /* Print a string */
 void vga_print(const char *str);
 
@@ -78,11 +97,36 @@ void vga_update_cursor(void);
 /* Move cursor to specific position */
 void vga_set_cursor(int x, int y);
 
+/* Console size in character cells */
+int vga_get_width(void);
+int vga_get_height(void);
+
 /* Get current cursor position */
 int vga_get_cursor_x(void);
 int vga_get_cursor_y(void);
 
+/* Absolute history line number holding the cursor */
+int vga_get_cursor_line(void);
+
+/* Newest history line before the given one containing text (-1 if none) */
+int vga_find_line(const char *text, int before);
+
+/* Scroll so the given history line is at the top of the screen */
+void vga_scroll_to_line(int line);
+
 /* Backspace - remove last character */
 void vga_backspace(void);
 
+/* Direct vga_* output to a virtual console; background consoles only
+   update their own history until they are shown */
+void vga_set_output_console(int index);
+int vga_get_output_console(void);
+
+/* Console on screen (or about to be, if a switch is pending) */
+int vga_get_active_console(void);
+
+/* Ask for another console to be shown; safe from IRQ context, takes
+   effect at the next vga_flush */
+void vga_request_console(int index);
+
 #endif /* VGA_H */
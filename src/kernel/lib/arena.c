@@ -0,0 +1,73 @@
+/*
+ * MelonOS - Arena Allocator
+ * Bump-pointer allocation over a fixed backing buffer
+ */
+
+#include "arena.h"
+#include "string.h"
+
+void arena_init(arena_t *arena, void *storage, size_t size) {
+    uintptr_t start = (uintptr_t)storage;
+    uintptr_t aligned = (start + (ARENA_ALIGN - 1)) & ~(uintptr_t)(ARENA_ALIGN - 1);
+
+    if (storage == 0 || size < aligned - start) {
+        arena->base = 0;
+        arena->size = 0;
+    } else {
+        arena->base = (uint8_t *)aligned;
+        arena->size = size - (aligned - start);
+    }
+
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size_t rounded;
+    void *ptr;
+
+    if (arena == 0 || arena->base == 0) {
+        return 0;
+    }
+
+    rounded = (size + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+    if (rounded < size || rounded > arena->size - arena->used) {
+        return 0;
+    }
+
+    ptr = arena->base + arena->used;
+    arena->used += rounded;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+
+    return ptr;
+}
+
+void *arena_zalloc(arena_t *arena, size_t size) {
+    void *ptr = arena_alloc(arena, size);
+
+    if (ptr != 0) {
+        memset(ptr, 0, size);
+    }
+
+    return ptr;
+}
+
+arena_mark_t arena_mark(const arena_t *arena) {
+    return arena->used;
+}
+
+void arena_release(arena_t *arena, arena_mark_t mark) {
+    if (mark <= arena->used) {
+        arena->used = mark;
+    }
+}
+
+void arena_reset(arena_t *arena) {
+    arena->used = 0;
+}
+
+size_t arena_remaining(const arena_t *arena) {
+    return arena->size - arena->used;
+}
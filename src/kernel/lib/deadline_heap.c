@@ -0,0 +1,48 @@
+/*
+ * MelonOS - Deadline Heap
+ * Sift-up push and sift-down pop over a fixed array
+ */
+
+#include "deadline_heap.h"
+
+void deadline_heap_reset(deadline_heap_t *heap) {
+    heap->count = 0;
+}
+
+int deadline_heap_push(deadline_heap_t *heap, uint64_t deadline) {
+    int i;
+
+    if (heap->count == DEADLINE_HEAP_SIZE) {
+        return -1;
+    }
+
+    i = heap->count++;
+    while (i > 0 && heap->entries[(i - 1) / 2] > deadline) {
+        heap->entries[i] = heap->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->entries[i] = deadline;
+    return 0;
+}
+
+void deadline_heap_pop(deadline_heap_t *heap) {
+    uint64_t last = heap->entries[--heap->count];
+    int i = 0;
+
+    while (1) {
+        int child = 2 * i + 1;
+
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && heap->entries[child + 1] < heap->entries[child]) {
+            child++;
+        }
+        if (heap->entries[child] >= last) {
+            break;
+        }
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    heap->entries[i] = last;
+}
@@ -0,0 +1,104 @@
+/*
+ * MelonOS - Command History
+ * Ring of fixed-size line slots; appending never moves older lines
+ */
+
+#include "history.h"
+#include "string.h"
+
+#define HISTORY_MASK (HISTORY_CAPACITY - 1)
+
+_Static_assert((HISTORY_CAPACITY & HISTORY_MASK) == 0, "capacity must be a power of two");
+_Static_assert(HISTORY_ENTRY_SIZE <= 256, "line length must fit in a byte");
+
+static inline uint32_t slot_of(const history_t *h, size_t index) {
+    return (h->end - (uint32_t)history_count(h) + (uint32_t)index) & HISTORY_MASK;
+}
+
+static void append_text(history_t *h, const char *text, size_t len) {
+    uint32_t slot = h->end & HISTORY_MASK;
+
+    if (len == 0) {
+        return;
+    }
+    if (len > HISTORY_ENTRY_SIZE - 1) {
+        len = HISTORY_ENTRY_SIZE - 1;
+    }
+
+    memcpy(h->text[slot], text, len);
+    h->text[slot][len] = '\0';
+    h->len[slot] = (uint8_t)len;
+    h->end++;
+}
+
+void history_reset(history_t *h) {
+    h->end = 0;
+}
+
+void history_append(history_t *h, const char *line) {
+    append_text(h, line, strlen(line));
+}
+
+size_t history_count(const history_t *h) {
+    return h->end < HISTORY_CAPACITY ? h->end : HISTORY_CAPACITY;
+}
+
+const char *history_entry(const history_t *h, size_t index) {
+    if (index >= history_count(h)) {
+        return 0;
+    }
+    return h->text[slot_of(h, index)];
+}
+
+int history_find(const history_t *h, const char *needle, size_t needle_len, int before) {
+    int count = (int)history_count(h);
+
+    if (needle_len == 0) {
+        return -1;
+    }
+    if (before > count) {
+        before = count;
+    }
+
+    for (int index = before - 1; index >= 0; index--) {
+        uint32_t slot = slot_of(h, (size_t)index);
+
+        if (h->len[slot] >= needle_len && memmem(h->text[slot], h->len[slot], needle, needle_len) != 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+size_t history_save(const history_t *h, char *out, size_t size) {
+    size_t count = history_count(h);
+    size_t first = count;
+    size_t need = 0;
+    size_t used = 0;
+
+    /* Walk back from the newest to see how many whole lines fit */
+    while (first > 0 && need + h->len[slot_of(h, first - 1)] + 1 <= size) {
+        first--;
+        need += h->len[slot_of(h, first)] + 1u;
+    }
+
+    for (size_t index = first; index < count; index++) {
+        uint32_t slot = slot_of(h, index);
+
+        memcpy(out + used, h->text[slot], h->len[slot]);
+        used += h->len[slot];
+        out[used++] = '\n';
+    }
+    return used;
+}
+
+void history_load(history_t *h, const char *data, size_t len) {
+    size_t start = 0;
+
+    for (size_t i = 0; i <= len; i++) {
+        if (i == len || data[i] == '\n') {
+            append_text(h, data + start, i - start);
+            start = i + 1;
+        }
+    }
+}
@@ -0,0 +1,512 @@
+/*
+ * MelonOS - Formatted Output
+ * printf-style formatter with staged, sink-based output
+ */
+
+#include "kprintf.h"
+#include "math64.h"
+#include "string.h"
+#include "vga.h"
+
+/* Output is staged here and handed to the sink in chunks of this size */
+#define KPRINTF_STAGE_SIZE 128
+
+#define FLAG_LEFT   0x01
+#define FLAG_ZERO   0x02
+#define FLAG_PLUS   0x04
+#define FLAG_SPACE  0x08
+#define FLAG_ALT    0x10
+
+enum {
+    LENGTH_INT,
+    LENGTH_CHAR,
+    LENGTH_SHORT,
+    LENGTH_LONG,
+    LENGTH_LLONG,
+    LENGTH_SIZE
+};
+
+typedef struct {
+    kprintf_sink_t *sink;
+    char stage[KPRINTF_STAGE_SIZE];
+    size_t staged;
+    int total;
+} format_state_t;
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t used;
+} buffer_sink_t;
+
+/* "00" "01" ... "99": two digits per lookup halves the divisions */
+static const char digit_pairs[200] = {
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899"
+};
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+/* ============ Integer conversion ============ */
+
+static size_t u32_digit_count(uint32_t value) {
+    if (value < 10u) return 1;
+    if (value < 100u) return 2;
+    if (value < 1000u) return 3;
+    if (value < 10000u) return 4;
+    if (value < 100000u) return 5;
+    if (value < 1000000u) return 6;
+    if (value < 10000000u) return 7;
+    if (value < 100000000u) return 8;
+    if (value < 1000000000u) return 9;
+    return 10;
+}
+
+/* Write exactly len digits of value, filling from the right */
+static void write_digits(char *end, uint32_t value, size_t len) {
+    char *p = end;
+
+    while (len >= 2) {
+        uint32_t pair = (value % 100u) * 2u;
+        value /= 100u;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+        len -= 2;
+    }
+
+    if (len) {
+        *--p = (char)('0' + value % 10u);
+    }
+}
+
+size_t kfmt_u32(char *buffer, uint32_t value) {
+    size_t len = u32_digit_count(value);
+    write_digits(buffer + len, value, len);
+    return len;
+}
+
+size_t kfmt_u64(char *buffer, uint64_t value) {
+    uint32_t low;
+    uint32_t middle;
+    uint64_t rest;
+    size_t len;
+
+    if ((value >> 32) == 0) {
+        return kfmt_u32(buffer, (uint32_t)value);
+    }
+
+    /* Peel off nine-digit groups so every divide is 64-by-32 */
+    rest = div64_u32(value, 1000000000u, &low);
+    if ((rest >> 32) == 0) {
+        len = kfmt_u32(buffer, (uint32_t)rest);
+    } else {
+        uint64_t top = div64_u32(rest, 1000000000u, &middle);
+        len = kfmt_u32(buffer, (uint32_t)top);
+        write_digits(buffer + len + 9, middle, 9);
+        len += 9;
+    }
+
+    write_digits(buffer + len + 9, low, 9);
+    return len + 9;
+}
+
+size_t kfmt_hex(char *buffer, uint64_t value, int uppercase) {
+    const char *digits = uppercase ? hex_upper : hex_lower;
+    uint32_t high = (uint32_t)(value >> 32);
+    uint32_t low = (uint32_t)value;
+    size_t len;
+
+    if (high) {
+        len = 8 + (size_t)(35 - __builtin_clz(high)) / 4;
+    } else if (low) {
+        len = (size_t)(35 - __builtin_clz(low)) / 4;
+    } else {
+        len = 1;
+    }
+
+    for (size_t i = len; i > 0; i--) {
+        buffer[i - 1] = digits[low & 0xF];
+        low = (low >> 4) | (high << 28);
+        high >>= 4;
+    }
+
+    return len;
+}
+
+static size_t kfmt_octal(char *buffer, uint64_t value) {
+    char scratch[22];
+    size_t len = 0;
+
+    do {
+        scratch[len++] = (char)('0' + (uint32_t)(value & 7u));
+        value >>= 3;
+    } while (value);
+
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = scratch[len - 1 - i];
+    }
+
+    return len;
+}
+
+/* ============ Staged output ============ */
+
+static void stage_flush(format_state_t *state) {
+    if (state->staged) {
+        state->sink->write(state->sink, state->stage, state->staged);
+        state->staged = 0;
+    }
+}
+
+static void emit(format_state_t *state, const char *data, size_t len) {
+    state->total += (int)len;
+
+    if (len >= KPRINTF_STAGE_SIZE) {
+        stage_flush(state);
+        state->sink->write(state->sink, data, len);
+        return;
+    }
+
+    if (state->staged + len > KPRINTF_STAGE_SIZE) {
+        stage_flush(state);
+    }
+
+    memcpy(state->stage + state->staged, data, len);
+    state->staged += len;
+}
+
+static void emit_repeat(format_state_t *state, char c, int count) {
+    while (count-- > 0) {
+        if (state->staged == KPRINTF_STAGE_SIZE) {
+            stage_flush(state);
+        }
+        state->stage[state->staged++] = c;
+        state->total++;
+    }
+}
+
+static void emit_padded(format_state_t *state, const char *prefix, size_t prefix_len,
+                        const char *digits, size_t len, int width, int precision, int flags) {
+    int zeros = 0;
+    int pad;
+
+    if (precision >= 0) {
+        if ((size_t)precision > len) {
+            zeros = precision - (int)len;
+        }
+    } else if ((flags & FLAG_ZERO) && !(flags & FLAG_LEFT)) {
+        zeros = width - (int)(prefix_len + len);
+    }
+
+    if (zeros < 0) {
+        zeros = 0;
+    }
+
+    pad = width - (int)(prefix_len + len) - zeros;
+
+    if (!(flags & FLAG_LEFT)) {
+        emit_repeat(state, ' ', pad);
+    }
+    emit(state, prefix, prefix_len);
+    emit_repeat(state, '0', zeros);
+    emit(state, digits, len);
+    if (flags & FLAG_LEFT) {
+        emit_repeat(state, ' ', pad);
+    }
+}
+
+static uint64_t fetch_unsigned(va_list *args, int length) {
+    switch (length) {
+        case LENGTH_CHAR:  return (unsigned char)va_arg(*args, unsigned int);
+        case LENGTH_SHORT: return (unsigned short)va_arg(*args, unsigned int);
+        case LENGTH_LONG:  return va_arg(*args, unsigned long);
+        case LENGTH_LLONG: return va_arg(*args, unsigned long long);
+        case LENGTH_SIZE:  return va_arg(*args, size_t);
+        default:           return va_arg(*args, unsigned int);
+    }
+}
+
+static int64_t fetch_signed(va_list *args, int length) {
+    switch (length) {
+        case LENGTH_CHAR:  return (signed char)va_arg(*args, int);
+        case LENGTH_SHORT: return (short)va_arg(*args, int);
+        case LENGTH_LONG:  return va_arg(*args, long);
+        case LENGTH_LLONG: return va_arg(*args, long long);
+        case LENGTH_SIZE:  return (int64_t)va_arg(*args, size_t);
+        default:           return va_arg(*args, int);
+    }
+}
+
+int kvformat(kprintf_sink_t *sink, const char *fmt, va_list args) {
+    format_state_t state;
+    va_list ap;
+
+    state.sink = sink;
+    state.staged = 0;
+    state.total = 0;
+    va_copy(ap, args);
+
+    while (*fmt) {
+        const char *start = fmt;
+        char digits[24];
+        char prefix[2];
+        size_t prefix_len = 0;
+        size_t len;
+        int flags = 0;
+        int width = 0;
+        int precision = -1;
+        int length = LENGTH_INT;
+
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        if (fmt != start) {
+            emit(&state, start, (size_t)(fmt - start));
+        }
+        if (*fmt == '\0') {
+            break;
+        }
+        fmt++;
+
+        /* Flags */
+        for (;; fmt++) {
+            if (*fmt == '-') flags |= FLAG_LEFT;
+            else if (*fmt == '0') flags |= FLAG_ZERO;
+            else if (*fmt == '+') flags |= FLAG_PLUS;
+            else if (*fmt == ' ') flags |= FLAG_SPACE;
+            else if (*fmt == '#') flags |= FLAG_ALT;
+            else break;
+        }
+
+        /* Width */
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) {
+                flags |= FLAG_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+
+        /* Precision */
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(ap, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+
+        /* Length modifier */
+        if (*fmt == 'h') {
+            fmt++;
+            length = LENGTH_SHORT;
+            if (*fmt == 'h') {
+                fmt++;
+                length = LENGTH_CHAR;
+            }
+        } else if (*fmt == 'l') {
+            fmt++;
+            length = LENGTH_LONG;
+            if (*fmt == 'l') {
+                fmt++;
+                length = LENGTH_LLONG;
+            }
+        } else if (*fmt == 'z') {
+            fmt++;
+            length = LENGTH_SIZE;
+        }
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t value = fetch_signed(&ap, length);
+                uint64_t magnitude = (value < 0) ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+                if (value < 0) {
+                    prefix[prefix_len++] = '-';
+                } else if (flags & FLAG_PLUS) {
+                    prefix[prefix_len++] = '+';
+                } else if (flags & FLAG_SPACE) {
+                    prefix[prefix_len++] = ' ';
+                }
+
+                len = (precision == 0 && magnitude == 0) ? 0 : kfmt_u64(digits, magnitude);
+                emit_padded(&state, prefix, prefix_len, digits, len, width, precision, flags);
+                break;
+            }
+            case 'u': {
+                uint64_t value = fetch_unsigned(&ap, length);
+                len = (precision == 0 && value == 0) ? 0 : kfmt_u64(digits, value);
+                emit_padded(&state, prefix, 0, digits, len, width, precision, flags);
+                break;
+            }
+            case 'x':
+            case 'X': {
+                uint64_t value = fetch_unsigned(&ap, length);
+                if ((flags & FLAG_ALT) && value != 0) {
+                    prefix[prefix_len++] = '0';
+                    prefix[prefix_len++] = *fmt;
+                }
+                len = (precision == 0 && value == 0) ? 0 : kfmt_hex(digits, value, *fmt == 'X');
+                emit_padded(&state, prefix, prefix_len, digits, len, width, precision, flags);
+                break;
+            }
+            case 'o': {
+                uint64_t value = fetch_unsigned(&ap, length);
+                len = (precision == 0 && value == 0) ? 0 : kfmt_octal(digits, value);
+                if ((flags & FLAG_ALT) && (len == 0 || digits[0] != '0')) {
+                    prefix[prefix_len++] = '0';
+                }
+                emit_padded(&state, prefix, prefix_len, digits, len, width, precision, flags);
+                break;
+            }
+            case 'p': {
+                uintptr_t value = (uintptr_t)va_arg(ap, void *);
+
+                /* Pointers always show every hex digit */
+                len = kfmt_hex(digits, value, 0);
+                prefix[0] = '0';
+                prefix[1] = 'x';
+                emit_padded(&state, prefix, 2, digits, len, width, (int)(sizeof(void *) * 2), flags & FLAG_LEFT);
+                break;
+            }
+            case 'c': {
+                char c = (char)va_arg(ap, int);
+                emit_padded(&state, prefix, 0, &c, 1, width, -1, flags & FLAG_LEFT);
+                break;
+            }
+            case 's': {
+                const char *str = va_arg(ap, const char *);
+                if (str == 0) {
+                    str = "(null)";
+                }
+                len = 0;
+                while (str[len] && (precision < 0 || len < (size_t)precision)) {
+                    len++;
+                }
+                emit_padded(&state, prefix, 0, str, len, width, -1, flags & FLAG_LEFT);
+                break;
+            }
+            case '%':
+                emit(&state, "%", 1);
+                break;
+            case '\0':
+                emit(&state, "%", 1);
+                fmt--;
+                break;
+            default:
+                /* Unknown conversion: echo it so the mistake is visible */
+                emit(&state, "%", 1);
+                emit(&state, fmt, 1);
+                break;
+        }
+
+        fmt++;
+    }
+
+    va_end(ap);
+    stage_flush(&state);
+    return state.total;
+}
+
+int kformat(kprintf_sink_t *sink, const char *fmt, ...) {
+    va_list args;
+    int written;
+
+    va_start(args, fmt);
+    written = kvformat(sink, fmt, args);
+    va_end(args);
+    return written;
+}
+
+/* ============ Buffer sink ============ */
+
+static void buffer_sink_write(kprintf_sink_t *sink, const char *data, size_t len) {
+    buffer_sink_t *target = (buffer_sink_t *)sink->context;
+    size_t room;
+
+    if (target->used + 1 >= target->size) {
+        return;
+    }
+
+    room = target->size - 1 - target->used;
+    if (len > room) {
+        len = room;
+    }
+
+    memcpy(target->buffer + target->used, data, len);
+    target->used += len;
+}
+
+int kvsnprintf(char *buffer, size_t size, const char *fmt, va_list args) {
+    buffer_sink_t target;
+    kprintf_sink_t sink;
+    int written;
+
+    target.buffer = buffer;
+    target.size = size;
+    target.used = 0;
+    sink.write = buffer_sink_write;
+    sink.context = &target;
+
+    written = kvformat(&sink, fmt, args);
+    if (size > 0) {
+        buffer[target.used] = '\0';
+    }
+    return written;
+}
+
+int ksnprintf(char *buffer, size_t size, const char *fmt, ...) {
+    va_list args;
+    int written;
+
+    va_start(args, fmt);
+    written = kvsnprintf(buffer, size, fmt, args);
+    va_end(args);
+    return written;
+}
+
+/* ============ Console sink ============ */
+
+static void console_sink_write(kprintf_sink_t *sink, const char *data, size_t len) {
+    (void)sink;
+    vga_write(data, len);
+}
+
+int kvprintf(const char *fmt, va_list args) {
+    kprintf_sink_t sink;
+
+    sink.write = console_sink_write;
+    sink.context = 0;
+    return kvformat(&sink, fmt, args);
+}
+
+int kprintf(const char *fmt, ...) {
+    va_list args;
+    int written;
+
+    va_start(args, fmt);
+    written = kvprintf(fmt, args);
+    va_end(args);
+    return written;
+}
@@ -0,0 +1,238 @@
+/*
+ * MelonOS - Scrollback Store
+ * Console history kept as a byte ring of run-length encoded lines
+ */
+
+#include "scrollback.h"
+#include "string.h"
+
+/*
+ * Record layout, one per line, packed back to back in the ring:
+ *
+ *   [len] [fill] [n] n * ([attr] [run])
+ *
+ * followed by len text bytes. n == 0 means every cell uses the fill
+ * attribute, and cells past len are blanks in fill, so the usual short
+ * single-colour line costs 3 + len bytes instead of two per cell.
+ */
+#define SB_MASK    (SCROLLBACK_STORE_BYTES - 1)
+#define SB_CHECKPOINT_SHIFT SCROLLBACK_CHECKPOINT_SHIFT
+
+_Static_assert((SCROLLBACK_STORE_BYTES & SB_MASK) == 0, "store size must be a power of two");
+_Static_assert(CONSOLE_MAX_COLS <= 255, "line length must fit in a byte");
+
+static inline uint8_t store_get(const scrollback_t *sb, uint32_t pos) {
+    return sb->store[pos & SB_MASK];
+}
+
+static inline uint32_t checkpoint_index(int line) {
+    return ((uint32_t)line >> SB_CHECKPOINT_SHIFT) % SCROLLBACK_CHECKPOINTS;
+}
+
+static inline uint32_t record_text(const scrollback_t *sb, uint32_t pos) {
+    return pos + 3 + 2u * store_get(sb, pos + 2);
+}
+
+static inline uint32_t record_len(const scrollback_t *sb, uint32_t pos) {
+    return store_get(sb, pos);
+}
+
+static inline uint32_t record_next(const scrollback_t *sb, uint32_t pos) {
+    return record_text(sb, pos) + record_len(sb, pos);
+}
+
+static uint32_t locate(const scrollback_t *sb, int line) {
+    int at = line & ~((1 << SB_CHECKPOINT_SHIFT) - 1);
+    uint32_t pos;
+
+    if (at <= sb->first_line) {
+        at = sb->first_line;
+        pos = sb->head_pos;
+    } else {
+        pos = sb->checkpoint[checkpoint_index(at)];
+    }
+
+    while (at < line) {
+        pos = record_next(sb, pos);
+        at++;
+    }
+    return pos;
+}
+
+static void evict_oldest(scrollback_t *sb) {
+    sb->head_pos = record_next(sb, sb->head_pos);
+    sb->first_line++;
+}
+
+void scrollback_reset(scrollback_t *sb, int base_line) {
+    sb->head_pos = 0;
+    sb->tail_pos = 0;
+    sb->first_line = base_line;
+    sb->end_line = base_line;
+}
+
+int scrollback_first(const scrollback_t *sb) {
+    return sb->first_line;
+}
+
+int scrollback_end(const scrollback_t *sb) {
+    return sb->end_line;
+}
+
+void scrollback_append(scrollback_t *sb, const uint16_t *cells, int width) {
+    uint8_t record[3 + 2 * CONSOLE_MAX_COLS + CONSOLE_MAX_COLS];
+    uint8_t *text;
+    uint32_t size;
+    uint16_t last = cells[width - 1];
+    uint8_t fill = (uint8_t)(last >> 8);
+    int len = width;
+    int runs = 0;
+
+    /* Trailing blanks in the fill attribute are implied */
+    if ((last & 0xFF) == ' ') {
+        while (len > 0 && cells[len - 1] == last) {
+            len--;
+        }
+    }
+
+    record[1] = fill;
+    for (int x = 0; x < len; ) {
+        uint8_t attr = (uint8_t)(cells[x] >> 8);
+        int run = 1;
+
+        while (x + run < len && (uint8_t)(cells[x + run] >> 8) == attr) {
+            run++;
+        }
+        record[3 + 2 * runs] = attr;
+        record[4 + 2 * runs] = (uint8_t)run;
+        runs++;
+        x += run;
+    }
+
+    if (runs == 1 && record[3] == fill) {
+        runs = 0;
+    }
+    record[0] = (uint8_t)len;
+    record[2] = (uint8_t)runs;
+    text = &record[3 + 2 * runs];
+
+    for (int x = 0; x < len; x++) {
+        text[x] = (uint8_t)cells[x];
+    }
+    size = (uint32_t)(text - record) + (uint32_t)len;
+
+    while (sb->first_line < sb->end_line &&
+           (sb->tail_pos - sb->head_pos + size > SCROLLBACK_STORE_BYTES ||
+            sb->end_line - sb->first_line >= SCROLLBACK_MAX_LINES)) {
+        evict_oldest(sb);
+    }
+
+    if ((sb->end_line & ((1 << SB_CHECKPOINT_SHIFT) - 1)) == 0) {
+        sb->checkpoint[checkpoint_index(sb->end_line)] = sb->tail_pos;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        sb->store[(sb->tail_pos + i) & SB_MASK] = record[i];
+    }
+    sb->tail_pos += size;
+    sb->end_line++;
+}
+
+int scrollback_read(const scrollback_t *sb, int line, uint16_t *cells, int width) {
+    uint32_t pos;
+    uint32_t text;
+    uint32_t len;
+    uint16_t blank;
+    int x = 0;
+
+    if (line < sb->first_line || line >= sb->end_line) {
+        return -1;
+    }
+
+    pos = locate(sb, line);
+    text = record_text(sb, pos);
+    len = record_len(sb, pos);
+    if (len > (uint32_t)width) {
+        len = (uint32_t)width;  /* Recorded wider than the reader wants */
+    }
+    blank = (uint16_t)(' ' | store_get(sb, pos + 1) << 8);
+
+    if (store_get(sb, pos + 2) == 0) {
+        for (; x < (int)len; x++) {
+            cells[x] = (uint16_t)(store_get(sb, text + x) | (blank & 0xFF00));
+        }
+    } else {
+        uint8_t runs = store_get(sb, pos + 2);
+
+        for (uint8_t r = 0; r < runs; r++) {
+            uint16_t attr = (uint16_t)(store_get(sb, pos + 3 + 2u * r) << 8);
+            int end = x + store_get(sb, pos + 4 + 2u * r);
+
+            if (end > (int)len) {
+                end = (int)len;
+            }
+
+            for (; x < end; x++) {
+                cells[x] = (uint16_t)(store_get(sb, text + x) | attr);
+            }
+        }
+    }
+
+    memset16(&cells[x], blank, width - x);
+    return 0;
+}
+
+static int record_contains(const scrollback_t *sb, uint32_t pos, const char *needle, size_t needle_len) {
+    char text[CONSOLE_MAX_COLS];
+    uint32_t start = record_text(sb, pos);
+    uint32_t len = record_len(sb, pos);
+
+    if (len < needle_len) {
+        return 0;
+    }
+
+    /* Only the text bytes are touched; attribute runs are never decoded */
+    for (uint32_t x = 0; x < len; x++) {
+        text[x] = (char)store_get(sb, start + x);
+    }
+    return memmem(text, len, needle, needle_len) != 0;
+}
+
+int scrollback_find(const scrollback_t *sb, const char *needle, size_t needle_len, int before) {
+    int block;
+
+    if (needle_len == 0 || needle_len > CONSOLE_MAX_COLS) {
+        return -1;
+    }
+    if (before > sb->end_line) {
+        before = sb->end_line;
+    }
+
+    /* Records only chain forwards, so walk one checkpoint block at a time
+       from the newest and keep the last hit inside it */
+    block = (before - 1) & ~((1 << SB_CHECKPOINT_SHIFT) - 1);
+    while (before > sb->first_line) {
+        int line = block < sb->first_line ? sb->first_line : block;
+        uint32_t pos = locate(sb, line);
+        int found = -1;
+
+        for (; line < before; line++) {
+            if (record_contains(sb, pos, needle, needle_len)) {
+                found = line;
+            }
+            pos = record_next(sb, pos);
+        }
+
+        if (found >= 0) {
+            return found;
+        }
+        before = block;
+        block -= 1 << SB_CHECKPOINT_SHIFT;
+    }
+
+    return -1;
+}
+
+size_t scrollback_bytes_used(const scrollback_t *sb) {
+    return sb->tail_pos - sb->head_pos;
+}
@@ -0,0 +1,218 @@
+/*
+ * MelonOS - Spinlocks
+ * Ticket, reader-writer and sequence locks; contention is only counted
+ * for locks that carry a lock_stats_t
+ */
+
+#include "spinlock.h"
+#include "cpu.h"
+
+/* Listed lock_stats_t, pushed the first time each is used */
+static lock_stats_t *stats_list = 0;
+
+static void stats_list_add(lock_stats_t *stats) {
+    lock_stats_t *head;
+
+    if (__atomic_exchange_n(&stats->listed, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    head = __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE);
+    do {
+        stats->next = head;
+    } while (!__atomic_compare_exchange_n(&stats_list, &head, stats, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+/* Account one acquisition that waited for spins pause rounds */
+static void stats_record(lock_stats_t *stats, uint32_t spins) {
+    if (stats == 0) {
+        return;
+    }
+    if (!stats->listed) {
+        stats_list_add(stats);
+    }
+    __atomic_add_fetch(&stats->acquired, 1, __ATOMIC_RELAXED);
+    if (spins != 0) {
+        __atomic_add_fetch(&stats->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->spins, spins, __ATOMIC_RELAXED);
+    }
+}
+
+lock_stats_t *lock_stats_first(void) {
+    return __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE);
+}
+
+void spin_lock_init(spinlock_t *lock, lock_stats_t *stats) {
+    lock->next = 0;
+    lock->owner = 0;
+    lock->stats = stats;
+}
+
+void spin_lock(spinlock_t *lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint32_t spins = 0;
+
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        cpu_pause();
+        spins++;
+    }
+    stats_record(lock->stats, spins);
+}
+
+void spin_unlock(spinlock_t *lock) {
+    /* Only the holder writes owner, so a plain increment is enough */
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+int spin_trylock(spinlock_t *lock) {
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+    uint32_t expected = owner;
+
+    /* Free only if no ticket is out past the owner's */
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    stats_record(lock->stats, 0);
+    return 1;
+}
+
+int spin_is_locked(const spinlock_t *lock) {
+    return __atomic_load_n(&lock->next, __ATOMIC_RELAXED) !=
+           __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+}
+
+uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+void rwlock_init(rwlock_t *lock, lock_stats_t *stats) {
+    lock->state = 0;
+    lock->writers_waiting = 0;
+    lock->stats = stats;
+}
+
+void read_lock(rwlock_t *lock) {
+    uint32_t spins = 0;
+
+    while (1) {
+        int32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+
+        if (state >= 0 && __atomic_load_n(&lock->writers_waiting, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&lock->state, &state, state + 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        cpu_pause();
+        spins++;
+    }
+    stats_record(lock->stats, spins);
+}
+
+void read_unlock(rwlock_t *lock) {
+    __atomic_sub_fetch(&lock->state, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t *lock) {
+    uint32_t spins = 0;
+
+    __atomic_add_fetch(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    while (1) {
+        int32_t state = 0;
+
+        if (__atomic_compare_exchange_n(&lock->state, &state, -1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        cpu_pause();
+        spins++;
+    }
+    __atomic_sub_fetch(&lock->writers_waiting, 1, __ATOMIC_RELAXED);
+    stats_record(lock->stats, spins);
+}
+
+void write_unlock(rwlock_t *lock) {
+    __atomic_store_n(&lock->state, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t read_lock_irqsave(rwlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+
+    read_lock(lock);
+    return flags;
+}
+
+void read_unlock_irqrestore(rwlock_t *lock, uint32_t flags) {
+    read_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+uint32_t write_lock_irqsave(rwlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+
+    write_lock(lock);
+    return flags;
+}
+
+void write_unlock_irqrestore(rwlock_t *lock, uint32_t flags) {
+    write_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+void seqlock_init(seqlock_t *lock, lock_stats_t *stats) {
+    lock->sequence = 0;
+    spin_lock_init(&lock->lock, stats);
+}
+
+uint32_t read_seqbegin(const seqlock_t *lock) {
+    uint32_t sequence;
+
+    while ((sequence = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        cpu_pause();
+    }
+    return sequence;
+}
+
+int read_seqretry(seqlock_t *lock, uint32_t start) {
+    /* The reads of the data must complete before the sequence is
+       checked again */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) == start) {
+        return 0;
+    }
+    if (lock->lock.stats) {
+        __atomic_add_fetch(&lock->lock.stats->retries, 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+void write_seqlock(seqlock_t *lock) {
+    spin_lock(&lock->lock);
+    __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void write_sequnlock(seqlock_t *lock) {
+    __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELEASE);
+    spin_unlock(&lock->lock);
+}
+
+uint32_t write_seqlock_irqsave(seqlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+
+    write_seqlock(lock);
+    return flags;
+}
+
+void write_sequnlock_irqrestore(seqlock_t *lock, uint32_t flags) {
+    write_sequnlock(lock);
+    cpu_irq_restore(flags);
+}
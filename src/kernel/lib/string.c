@@ -4,11 +4,56 @@
  */
 
 #include "string.h"
+#include "cpu.h"
+
+/* The rep-string variants need x86; other hosts (the host test build)
+   only get the word loops */
+#if defined(__i386__) || defined(__x86_64__)
+#define STRING_REP_ASM 1
+#else
+#define STRING_REP_ASM 0
+#endif
+
+/* Copies and fills shorter than this stay in a plain byte loop */
+#define STRING_SMALL_SIZE 16
+
+#define WORD_ONES  0x01010101u
+#define WORD_HIGHS 0x80808080u
+
+/* Word views that may alias any object; the unaligned one is for sources */
+typedef uint32_t __attribute__((may_alias)) word_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) uword_t;
+
+typedef void *(*memcpy_fn_t)(void *dest, const void *src, size_t num);
+typedef void *(*memset_fn_t)(void *ptr, int value, size_t num);
+
+static void *memcpy_words(void *dest, const void *src, size_t num);
+static void *memset_words(void *ptr, int value, size_t num);
+
+/* Portable word loops until string_init has looked at CPUID */
+static memcpy_fn_t memcpy_impl = memcpy_words;
+static memset_fn_t memset_impl = memset_words;
+static const char *accel_name = "32-bit words";
 
 size_t strlen(const char *str) {
-    size_t len = 0;
-    while (str[len]) len++;
-    return len;
+    const char *p = str;
+    const word_t *w;
+
+    /* Byte steps up to a word boundary, then test four bytes at a time.
+       Aligned loads never cross into the next page. */
+    while ((uintptr_t)p & 3) {
+        if (*p == '\0') return (size_t)(p - str);
+        p++;
+    }
+
+    w = (const word_t *)p;
+    while (((*w - WORD_ONES) & ~*w & WORD_HIGHS) == 0) {
+        w++;
+    }
+
+    p = (const char *)w;
+    while (*p) p++;
+    return (size_t)(p - str);
 }
 
 int strcmp(const char *s1, const char *s2) {
@@ -49,19 +94,237 @@ char *strcat(char *dest, const char *src) {
     return dest;
 }
 
-void *memset(void *ptr, int value, size_t num) {
+/* ============ Copy/fill variants ============ */
+
+static void *memcpy_words(void *dest, const void *src, size_t num) {
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+
+    /* Align the destination; x86 tolerates the unaligned source loads */
+    while (num && ((uintptr_t)d & 3)) {
+        *d++ = *s++;
+        num--;
+    }
+
+    while (num >= 4) {
+        *(word_t *)d = *(const uword_t *)s;
+        d += 4;
+        s += 4;
+        num -= 4;
+    }
+
+    while (num--) *d++ = *s++;
+    return dest;
+}
+
+#if STRING_REP_ASM
+static void *memcpy_rep_movsd(void *dest, const void *src, size_t num) {
+    void *d = dest;
+    const void *s = src;
+    size_t words = num >> 2;
+    size_t tail = num & 3;
+
+    __asm__ volatile ("rep movsl" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(tail) : : "memory");
+    return dest;
+}
+
+static void *memcpy_erms(void *dest, const void *src, size_t num) {
+    void *d = dest;
+    const void *s = src;
+
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(num) : : "memory");
+    return dest;
+}
+#endif
+
+static void *memset_words(void *ptr, int value, size_t num) {
     unsigned char *p = (unsigned char *)ptr;
+    uint32_t pattern = WORD_ONES * (unsigned char)value;
+
+    while (num && ((uintptr_t)p & 3)) {
+        *p++ = (unsigned char)value;
+        num--;
+    }
+
+    while (num >= 4) {
+        *(word_t *)p = pattern;
+        p += 4;
+        num -= 4;
+    }
+
     while (num--) *p++ = (unsigned char)value;
     return ptr;
 }
 
+#if STRING_REP_ASM
+static void *memset_rep_stosd(void *ptr, int value, size_t num) {
+    void *p = ptr;
+    uint32_t pattern = WORD_ONES * (unsigned char)value;
+    size_t words = num >> 2;
+    size_t tail = num & 3;
+
+    __asm__ volatile ("rep stosl" : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+    __asm__ volatile ("rep stosb" : "+D"(p), "+c"(tail) : "a"(pattern) : "memory");
+    return ptr;
+}
+
+static void *memset_erms(void *ptr, int value, size_t num) {
+    void *p = ptr;
+
+    __asm__ volatile ("rep stosb" : "+D"(p), "+c"(num) : "a"(value) : "memory");
+    return ptr;
+}
+#endif
+
+void string_init(void) {
+#if STRING_REP_ASM
+    cpuid_regs_t regs;
+
+    /* Without CPUID this is a 386/early 486, where the word loops win */
+    if (!cpu_has_cpuid()) {
+        return;
+    }
+
+    memcpy_impl = memcpy_rep_movsd;
+    memset_impl = memset_rep_stosd;
+    accel_name = "rep movsd/stosd";
+
+    cpu_cpuid(0, 0, &regs);
+    if (regs.eax < 7) {
+        return;
+    }
+
+    cpu_cpuid(7, 0, &regs);
+    if (regs.ebx & CPUID_7_EBX_ERMS) {
+        memcpy_impl = memcpy_erms;
+        memset_impl = memset_erms;
+        accel_name = "rep movsb/stosb (ERMS)";
+    }
+#endif
+}
+
+const char *string_accel_name(void) {
+    return accel_name;
+}
+
+/* ============ Public memory routines ============ */
+
+void *memset(void *ptr, int value, size_t num) {
+    if (num < STRING_SMALL_SIZE) {
+        unsigned char *p = (unsigned char *)ptr;
+        while (num--) *p++ = (unsigned char)value;
+        return ptr;
+    }
+    return memset_impl(ptr, value, num);
+}
+
+void *memset16(void *ptr, uint16_t value, size_t count) {
+    uint16_t *p = (uint16_t *)ptr;
+    uint32_t pattern = (uint32_t)value | ((uint32_t)value << 16);
+    size_t pairs;
+
+    if (count && ((uintptr_t)p & 2)) {
+        *p++ = value;
+        count--;
+    }
+
+    pairs = count >> 1;
+#if STRING_REP_ASM
+    __asm__ volatile ("rep stosl" : "+D"(p), "+c"(pairs) : "a"(pattern) : "memory");
+#else
+    while (pairs--) {
+        *(word_t *)p = pattern;
+        p += 2;
+    }
+#endif
+
+    if (count & 1) {
+        *p = value;
+    }
+    return ptr;
+}
+
 void *memcpy(void *dest, const void *src, size_t num) {
+    if (num < STRING_SMALL_SIZE) {
+        unsigned char *d = (unsigned char *)dest;
+        const unsigned char *s = (const unsigned char *)src;
+        while (num--) *d++ = *s++;
+        return dest;
+    }
+    return memcpy_impl(dest, src, num);
+}
+
+void *memmove(void *dest, const void *src, size_t num) {
     unsigned char *d = (unsigned char *)dest;
     const unsigned char *s = (const unsigned char *)src;
-    while (num--) *d++ = *s++;
+
+    /* Every forward variant reads each unit before the write that could
+       clobber it, so only a destination above the source needs care */
+    if (d <= s || d >= s + num) {
+        return memcpy(dest, src, num);
+    }
+
+    d += num;
+    s += num;
+
+    while (num && ((uintptr_t)d & 3)) {
+        *--d = *--s;
+        num--;
+    }
+
+    while (num >= 4) {
+        d -= 4;
+        s -= 4;
+        *(word_t *)d = *(const uword_t *)s;
+        num -= 4;
+    }
+
+    while (num--) *--d = *--s;
     return dest;
 }
 
+int memcmp(const void *s1, const void *s2, size_t num) {
+    const unsigned char *a = (const unsigned char *)s1;
+    const unsigned char *b = (const unsigned char *)s2;
+
+    /* Skip equal words; the byte loop pins down the first difference */
+    while (num >= 4 && *(const uword_t *)a == *(const uword_t *)b) {
+        a += 4;
+        b += 4;
+        num -= 4;
+    }
+
+    while (num--) {
+        if (*a != *b) {
+            return *a - *b;
+        }
+        a++;
+        b++;
+    }
+
+    return 0;
+}
+
+void *memmem(const void *haystack, size_t haystack_len, const void *needle, size_t needle_len) {
+    const unsigned char *h = (const unsigned char *)haystack;
+    const unsigned char *n = (const unsigned char *)needle;
+
+    if (needle_len == 0) {
+        return (void *)h;
+    }
+
+    while (haystack_len >= needle_len) {
+        if (*h == *n && memcmp(h, n, needle_len) == 0) {
+            return (void *)h;
+        }
+        h++;
+        haystack_len--;
+    }
+
+    return 0;
+}
+
 int atoi(const char *str) {
     int result = 0;
     int sign = 1;
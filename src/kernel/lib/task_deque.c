@@ -0,0 +1,129 @@
+/*
+ * MelonOS - Task Deque
+ * Chase-Lev push, pop and steal, the inline fallback for a full deque,
+ * and parallel_for's range slicing
+ */
+
+#include "task_deque.h"
+#include "cpu.h"
+
+#define DEQUE_MASK (TASK_DEQUE_SIZE - 1)
+
+_Static_assert((TASK_DEQUE_SIZE & DEQUE_MASK) == 0, "deque size must be a power of two");
+
+int task_deque_push(task_deque_t *dq, task_t *task) {
+    int32_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    int32_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+
+    if (b - t >= TASK_DEQUE_SIZE) {
+        return -1;
+    }
+    __atomic_store_n(&dq->slots[b & DEQUE_MASK], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+task_t *task_deque_pop(task_deque_t *dq) {
+    int32_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    int32_t t;
+    task_t *task = 0;
+
+    /* Claim the bottom slot before looking at top, so a thief and the
+       owner cannot both miss each other */
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t <= b) {
+        task = __atomic_load_n(&dq->slots[b & DEQUE_MASK], __ATOMIC_RELAXED);
+        if (t == b) {
+            /* Last task: race the thieves for it */
+            if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                task = 0;
+            }
+            __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+task_t *task_deque_steal(task_deque_t *dq) {
+    int32_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    int32_t b;
+    task_t *task;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return 0;
+    }
+
+    task = __atomic_load_n(&dq->slots[t & DEQUE_MASK], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return task;
+}
+
+void task_run(task_deque_t *dq, task_t *task) {
+    task_group_t *group = task->group;
+
+    task->fn(task->arg);
+    if (dq != 0) {
+        dq->executed++;
+    }
+    __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELEASE);
+}
+
+int task_queue(task_deque_t *dq, task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg) {
+    uint32_t flags;
+    int queued = -1;
+
+    task->fn = fn;
+    task->arg = arg;
+    task->group = group;
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+
+    if (dq != 0) {
+        flags = cpu_irq_save();
+        queued = task_deque_push(dq, task);
+        cpu_irq_restore(flags);
+    }
+    if (queued != 0) {
+        task_run(dq, task);
+    }
+    return queued;
+}
+
+uint32_t parallel_slices(uint32_t begin, uint32_t end, uint32_t grain,
+                         uint32_t max_slices, uint32_t *bounds) {
+    uint32_t count;
+    uint32_t size;
+    uint32_t n = 0;
+
+    if (begin >= end || max_slices == 0) {
+        return 0;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    /* One slice per grain, up to max_slices, then spread the range over
+       that many; rounding the size up can leave fewer slices than that */
+    count = (end - begin) / grain + ((end - begin) % grain != 0);
+    if (count > max_slices) {
+        count = max_slices;
+    }
+    size = (end - begin) / count + ((end - begin) % count != 0);
+
+    bounds[0] = begin;
+    while (bounds[n] < end) {
+        bounds[n + 1] = end - bounds[n] > size ? bounds[n] + size : end;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,186 @@
+/*
+ * MelonOS - Prefix Trie
+ * Sorted sibling-list trie with per-subtree word counts
+ */
+
+#include "trie.h"
+#include "string.h"
+
+#define TRIE_ROOT 0
+
+static uint16_t find_child(const trie_t *trie, uint16_t node, char ch) {
+    uint16_t child = trie->nodes[node].first_child;
+
+    while (child != 0 && (uint8_t)trie->nodes[child].ch < (uint8_t)ch) {
+        child = trie->nodes[child].sibling;
+    }
+    return (child != 0 && trie->nodes[child].ch == ch) ? child : 0;
+}
+
+/* Node reached by spelling prefix from the root, -1 if there is none */
+static int find_node(const trie_t *trie, const char *prefix) {
+    uint16_t node = TRIE_ROOT;
+
+    for (; *prefix; prefix++) {
+        node = find_child(trie, node, *prefix);
+        if (node == 0) {
+            return -1;
+        }
+    }
+    return node;
+}
+
+/* Link a fresh node for ch into node's children, keeping byte order */
+static uint16_t add_child(trie_t *trie, uint16_t node, char ch) {
+    uint16_t fresh = (uint16_t)trie->used++;
+    uint16_t *link = &trie->nodes[node].first_child;
+
+    while (*link != 0 && (uint8_t)trie->nodes[*link].ch < (uint8_t)ch) {
+        link = &trie->nodes[*link].sibling;
+    }
+
+    memset(&trie->nodes[fresh], 0, sizeof(trie->nodes[fresh]));
+    trie->nodes[fresh].ch = ch;
+    trie->nodes[fresh].sibling = *link;
+    *link = fresh;
+    return fresh;
+}
+
+void trie_init(trie_t *trie, trie_node_t *storage, size_t capacity) {
+    trie->nodes = storage;
+    trie->capacity = capacity > 0xFFFF ? 0xFFFF : capacity;
+    trie_reset(trie);
+}
+
+void trie_reset(trie_t *trie) {
+    if (trie->nodes == 0 || trie->capacity == 0) {
+        trie->used = 0;
+        return;
+    }
+
+    memset(&trie->nodes[TRIE_ROOT], 0, sizeof(trie->nodes[TRIE_ROOT]));
+    trie->used = 1;
+}
+
+int trie_insert(trie_t *trie, const char *word, uint16_t value) {
+    uint16_t node = TRIE_ROOT;
+    const char *rest = word;
+    size_t missing;
+
+    if (trie->used == 0 || word == 0 || word[0] == '\0' || value == 0) {
+        return -1;
+    }
+
+    /* Check the whole insert fits before touching any counts */
+    while (*rest) {
+        uint16_t child = find_child(trie, node, *rest);
+        if (child == 0) {
+            break;
+        }
+        node = child;
+        rest++;
+    }
+
+    missing = strlen(rest);
+    if (missing == 0 && trie->nodes[node].value != 0) {
+        return -1;
+    }
+    if (missing > trie->capacity - trie->used) {
+        return -1;
+    }
+
+    node = TRIE_ROOT;
+    trie->nodes[node].words++;
+    for (; *word; word++) {
+        uint16_t child = find_child(trie, node, *word);
+        if (child == 0) {
+            child = add_child(trie, node, *word);
+        }
+        node = child;
+        trie->nodes[node].words++;
+    }
+
+    trie->nodes[node].value = value;
+    return 0;
+}
+
+uint16_t trie_lookup(const trie_t *trie, const char *word) {
+    int node;
+
+    if (trie->used == 0 || word == 0) {
+        return 0;
+    }
+
+    node = find_node(trie, word);
+    return node < 0 ? 0 : trie->nodes[node].value;
+}
+
+size_t trie_complete(const trie_t *trie, const char *prefix, char *out, size_t out_size) {
+    size_t used = 0;
+    int node;
+
+    if (out_size > 0) {
+        out[0] = '\0';
+    }
+    if (trie->used == 0 || prefix == 0) {
+        return 0;
+    }
+
+    node = find_node(trie, prefix);
+    if (node < 0) {
+        return 0;
+    }
+
+    /* Follow the chain while no word ends and nothing branches */
+    for (uint16_t at = (uint16_t)node; used + 1 < out_size; ) {
+        uint16_t child = trie->nodes[at].first_child;
+
+        if (trie->nodes[at].value != 0 || child == 0 || trie->nodes[child].sibling != 0) {
+            break;
+        }
+        out[used++] = trie->nodes[child].ch;
+        at = child;
+    }
+
+    if (out_size > 0) {
+        out[used] = '\0';
+    }
+    return trie->nodes[node].words;
+}
+
+static void visit_subtree(const trie_t *trie, uint16_t node, char *word, size_t len,
+                          void (*visit)(const char *word, uint16_t value, void *ctx), void *ctx) {
+    if (trie->nodes[node].value != 0) {
+        word[len] = '\0';
+        visit(word, trie->nodes[node].value, ctx);
+    }
+
+    if (len + 1 >= TRIE_MAX_WORD) {
+        return;
+    }
+
+    for (uint16_t child = trie->nodes[node].first_child; child != 0; child = trie->nodes[child].sibling) {
+        word[len] = trie->nodes[child].ch;
+        visit_subtree(trie, child, word, len + 1, visit, ctx);
+    }
+}
+
+void trie_visit(const trie_t *trie, const char *prefix,
+                void (*visit)(const char *word, uint16_t value, void *ctx), void *ctx) {
+    char word[TRIE_MAX_WORD];
+    size_t len;
+    int node;
+
+    if (trie->used == 0 || prefix == 0 || visit == 0) {
+        return;
+    }
+
+    len = strlen(prefix);
+    node = find_node(trie, prefix);
+    if (node < 0 || len >= TRIE_MAX_WORD) {
+        return;
+    }
+
+    memcpy(word, prefix, len);
+    visit_subtree(trie, (uint16_t)node, word, len, visit, ctx);
+}
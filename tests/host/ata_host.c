@@ -0,0 +1,141 @@
+/*
+ * MelonOS - Host ATA Shim
+ * Sector I/O against RAM or a scratch copy of a raw disk image for the
+ * host build
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ata.h"
+#include "host.h"
+#include "string.h"
+
+/* Same size as the QEMU disk image built by the Makefile */
+#define HOST_DISK_SECTORS (16u * 1024u * 1024u / ATA_SECTOR_SIZE)
+
+static uint8_t *ram_disk = 0;
+static int image_fd = -1;
+static uint64_t sector_reads = 0;
+static uint64_t sector_writes = 0;
+
+/*
+ * Both test and bench reformat the disk, so the image itself is never
+ * opened for writing: its sectors are copied to an unlinked scratch file
+ * and all I/O goes there. Returns -1 if the image cannot be read.
+ */
+int host_ata_use_image(const char *path) {
+    char scratch[] = "/tmp/melonos_host_XXXXXX";
+    uint8_t buffer[64 * ATA_SECTOR_SIZE];
+    ssize_t got;
+    int source;
+
+    source = open(path, O_RDONLY);
+    if (source < 0) {
+        perror(path);
+        return -1;
+    }
+
+    image_fd = mkstemp(scratch);
+    if (image_fd < 0) {
+        perror(scratch);
+        close(source);
+        return -1;
+    }
+    unlink(scratch);
+
+    while ((got = read(source, buffer, sizeof(buffer))) > 0) {
+        if (write(image_fd, buffer, (size_t)got) != got) {
+            got = -1;
+            break;
+        }
+    }
+    close(source);
+
+    if (got < 0) {
+        perror(path);
+        close(image_fd);
+        image_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void host_ata_wipe(void) {
+    /* Only the scratch copy; reads past its end come back as zeroes */
+    if (image_fd >= 0 && ftruncate(image_fd, 0) != 0) {
+        perror("ftruncate");
+    }
+    if (ram_disk != 0) {
+        memset(ram_disk, 0, (size_t)HOST_DISK_SECTORS * ATA_SECTOR_SIZE);
+    }
+}
+
+void host_ata_reset_counters(void) {
+    sector_reads = 0;
+    sector_writes = 0;
+}
+
+uint64_t host_ata_reads(void) {
+    return sector_reads;
+}
+
+uint64_t host_ata_writes(void) {
+    return sector_writes;
+}
+
+int ata_init(void) {
+    if (image_fd >= 0 || ram_disk != 0) {
+        return 0;
+    }
+
+    ram_disk = calloc(HOST_DISK_SECTORS, ATA_SECTOR_SIZE);
+    return ram_disk != 0 ? 0 : -1;
+}
+
+int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+    if (buffer == 0 || lba >= HOST_DISK_SECTORS) {
+        return -1;
+    }
+
+    sector_reads++;
+
+    if (image_fd >= 0) {
+        ssize_t got = pread(image_fd, buffer, ATA_SECTOR_SIZE, (off_t)lba * ATA_SECTOR_SIZE);
+        if (got < 0) {
+            return -1;
+        }
+        /* Past the end of a short image reads as zeroes */
+        memset(buffer + got, 0, ATA_SECTOR_SIZE - (size_t)got);
+        return 0;
+    }
+
+    if (ram_disk == 0) {
+        return -1;
+    }
+
+    memcpy(buffer, ram_disk + (size_t)lba * ATA_SECTOR_SIZE, ATA_SECTOR_SIZE);
+    return 0;
+}
+
+int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+    if (buffer == 0 || lba >= HOST_DISK_SECTORS) {
+        return -1;
+    }
+
+    sector_writes++;
+
+    if (image_fd >= 0) {
+        ssize_t put = pwrite(image_fd, buffer, ATA_SECTOR_SIZE, (off_t)lba * ATA_SECTOR_SIZE);
+        return put == ATA_SECTOR_SIZE ? 0 : -1;
+    }
+
+    if (ram_disk == 0) {
+        return -1;
+    }
+
+    memcpy(ram_disk + (size_t)lba * ATA_SECTOR_SIZE, buffer, ATA_SECTOR_SIZE);
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * MelonOS - Host Clock Shim
+ * A monotonic clock the tests move by hand, and a one-shot timer that
+ * only records the wakeups asked of it
+ */
+
+#include "clock.h"
+#include "host.h"
+#include "timer.h"
+
+static uint64_t fake_ns = 0;
+static uint64_t last_wake = 0;
+static uint32_t wake_requests = 0;
+
+uint64_t clock_ns(void) {
+    return fake_ns;
+}
+
+int timer_wake_at(uint64_t deadline_ns) {
+    last_wake = deadline_ns;
+    wake_requests++;
+    return 0;
+}
+
+void host_clock_set(uint64_t ns) {
+    fake_ns = ns;
+}
+
+uint64_t host_timer_last_wake(void) {
+    return last_wake;
+}
+
+uint32_t host_timer_wake_requests(void) {
+    return wake_requests;
+}
@@ -0,0 +1,12 @@
+/*
+ * MelonOS - Host Console Shim
+ * Routes kernel console output to stdout for the host build
+ */
+
+#include <stdio.h>
+
+#include "vga.h"
+
+void vga_write(const char *buf, size_t len) {
+    fwrite(buf, 1, len, stdout);
+}
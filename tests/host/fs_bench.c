@@ -0,0 +1,180 @@
+/*
+ * MelonOS - Host Benchmarks
+ * Microbenchmarks for fs.c operations, reported in ns/op
+ */
+
+#include <stdio.h>
+
+#include "fs.h"
+#include "host.h"
+#include "kprintf.h"
+#include "string.h"
+
+#define BENCH_FILE_SIZE 100
+
+typedef struct {
+    const char *name;
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t reads;
+    uint64_t writes;
+} bench_result_t;
+
+static bench_result_t results[8];
+static size_t result_count = 0;
+
+static bench_result_t *bench_slot(const char *name) {
+    for (size_t i = 0; i < result_count; i++) {
+        if (strcmp(results[i].name, name) == 0) {
+            return &results[i];
+        }
+    }
+
+    results[result_count].name = name;
+    return &results[result_count++];
+}
+
+static void bench_record(const char *name, uint64_t ops, uint64_t start_ns) {
+    bench_result_t *slot = bench_slot(name);
+
+    slot->ns += host_now_ns() - start_ns;
+    slot->ops += ops;
+    slot->reads += host_ata_reads();
+    slot->writes += host_ata_writes();
+}
+
+static void bench_begin(uint64_t *start_ns) {
+    host_ata_reset_counters();
+    *start_ns = host_now_ns();
+}
+
+static int bench_files(int file_count) {
+    uint8_t data[BENCH_FILE_SIZE];
+    uint8_t back[BENCH_FILE_SIZE];
+    fs_entry_info_t entries[128];
+    char name[16];
+    uint64_t start;
+    size_t count;
+    uint32_t got;
+
+    memset(data, 'm', sizeof(data));
+
+    bench_begin(&start);
+    for (int i = 0; i < file_count; i++) {
+        ksnprintf(name, sizeof(name), "bench%d", i);
+        if (fs_write_file(name, data, sizeof(data)) != 0) {
+            fprintf(stderr, "create %s failed\n", name);
+            return -1;
+        }
+    }
+    bench_record("create", (uint64_t)file_count, start);
+
+    bench_begin(&start);
+    for (int i = 0; i < file_count; i++) {
+        if (fs_list_dir("", entries, 128, &count) != 0 || count != (size_t)file_count) {
+            fprintf(stderr, "list failed\n");
+            return -1;
+        }
+    }
+    bench_record("list", (uint64_t)file_count, start);
+
+    bench_begin(&start);
+    for (int i = 0; i < file_count; i++) {
+        ksnprintf(name, sizeof(name), "bench%d", i);
+        if (fs_read_file(name, back, sizeof(back), &got) != 0 || got != sizeof(back)) {
+            fprintf(stderr, "read %s failed\n", name);
+            return -1;
+        }
+    }
+    bench_record("read", (uint64_t)file_count, start);
+
+    bench_begin(&start);
+    for (int i = 0; i < file_count; i++) {
+        ksnprintf(name, sizeof(name), "bench%d", i);
+        if (fs_delete_file(name) != 0) {
+            fprintf(stderr, "delete %s failed\n", name);
+            return -1;
+        }
+    }
+    bench_record("delete", (uint64_t)file_count, start);
+
+    return 0;
+}
+
+static int bench_resolve(int depth, int iterations) {
+    char path[FS_PATH_MAX_LEN + 1];
+    size_t used = 0;
+    uint64_t start;
+
+    path[0] = '\0';
+    for (int level = 0; level < depth; level++) {
+        used += (size_t)ksnprintf(path + used, sizeof(path) - used, "/d%d", level);
+        if (used >= sizeof(path) || fs_mkdir(path) != 0) {
+            fprintf(stderr, "mkdir %s failed\n", path);
+            return -1;
+        }
+    }
+
+    bench_begin(&start);
+    for (int i = 0; i < iterations; i++) {
+        if (fs_set_cwd(path) != 0) {
+            fprintf(stderr, "resolve %s failed\n", path);
+            return -1;
+        }
+    }
+    bench_record("resolve", (uint64_t)iterations, start);
+
+    fs_set_cwd("/");
+    for (int level = depth; level > 0; level--) {
+        char *slash = path + used;
+        while (slash > path && *--slash != '/') {
+        }
+        if (fs_rmdir(path) != 0) {
+            fprintf(stderr, "rmdir %s failed\n", path);
+            return -1;
+        }
+        *slash = '\0';
+        used = (size_t)(slash - path);
+    }
+
+    return 0;
+}
+
+int host_run_bench(int file_count, int depth, int rounds) {
+    fs_info_t info;
+
+    host_ata_wipe();
+    if (fs_format() != 0 || fs_get_info(&info) != 0) {
+        fprintf(stderr, "format failed\n");
+        return 1;
+    }
+
+    if (file_count < 1 || (uint32_t)file_count >= info.total_inodes) {
+        fprintf(stderr, "file count must be 1..%u\n", info.total_inodes - 1);
+        return 2;
+    }
+
+    if (depth < 1 || depth * 4 > FS_PATH_MAX_LEN) {
+        fprintf(stderr, "depth must be 1..%d\n", FS_PATH_MAX_LEN / 4);
+        return 2;
+    }
+
+    for (int round = 0; round < rounds; round++) {
+        if (bench_files(file_count) != 0 || bench_resolve(depth, file_count) != 0) {
+            return 1;
+        }
+    }
+
+    printf("files=%d depth=%d rounds=%d\n", file_count, depth, rounds);
+    printf("%-10s %10s %12s %12s %12s\n", "benchmark", "ops", "ns/op", "sect-rd/op", "sect-wr/op");
+    for (size_t i = 0; i < result_count; i++) {
+        const bench_result_t *r = &results[i];
+        printf("%-10s %10llu %12.1f %12.1f %12.1f\n", r->name,
+               (unsigned long long)r->ops,
+               (double)r->ns / (double)r->ops,
+               (double)r->reads / (double)r->ops,
+               (double)r->writes / (double)r->ops);
+    }
+
+    return 0;
+}
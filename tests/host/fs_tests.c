@@ -0,0 +1,204 @@
+/*
+ * MelonOS - Host Filesystem Tests
+ * Functional checks for fs.c on the disk shim
+ */
+
+#include "fs.h"
+#include "host.h"
+#include "kprintf.h"
+#include "string.h"
+
+static void fresh_fs(void) {
+    host_ata_wipe();
+    CHECK(fs_format() == 0);
+    CHECK(fs_is_ready());
+}
+
+static uint32_t free_blocks(void) {
+    fs_info_t info;
+    CHECK(fs_get_info(&info) == 0);
+    return info.free_data_blocks;
+}
+
+static int dir_contains(const char *path, const char *name, uint8_t type) {
+    fs_entry_info_t entries[96];
+    size_t count = 0;
+
+    if (fs_list_dir(path, entries, 96, &count) != 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count && i < 96; i++) {
+        if (strcmp(entries[i].name, name) == 0 && entries[i].type == type) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/* ============ Filesystem ============ */
+
+static void test_format(void) {
+    fs_info_t info;
+    char cwd[FS_PATH_MAX_LEN + 1];
+    size_t count = 99;
+    fs_entry_info_t entries[4];
+
+    fresh_fs();
+    CHECK(fs_get_info(&info) == 0);
+    CHECK(info.used_inodes == 1);
+    CHECK(info.free_data_blocks == info.total_data_blocks);
+    CHECK(fs_get_cwd(cwd, sizeof(cwd)) == 0 && strcmp(cwd, "/") == 0);
+    CHECK(fs_list_dir("/", entries, 4, &count) == 0 && count == 0);
+}
+
+static void test_write_read_sizes(void) {
+    static const uint32_t sizes[] = { 0, 1, 511, 512, 513, 2048, FS_READ_BUFFER_SIZE };
+    uint8_t data[FS_READ_BUFFER_SIZE];
+    uint8_t back[FS_READ_BUFFER_SIZE];
+
+    fresh_fs();
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t got = 0xFFFFFFFFu;
+        memset(back, 0, sizeof(back));
+        CHECK(fs_write_file("blob", data, sizes[i]) == 0);
+        CHECK(fs_read_file("blob", back, sizeof(back), &got) == 0);
+        CHECK(got == sizes[i]);
+        CHECK(memcmp(back, data, sizes[i]) == 0);
+    }
+
+    CHECK(fs_write_file("huge", data, FS_READ_BUFFER_SIZE + 1) != 0);
+    CHECK(fs_write_file("blob", data, 1024) == 0);
+    {
+        uint32_t got = 0;
+        CHECK(fs_read_file("blob", back, 1000, &got) != 0);
+    }
+}
+
+static void test_overwrite_frees_blocks(void) {
+    uint8_t data[FS_READ_BUFFER_SIZE];
+    uint32_t before;
+
+    fresh_fs();
+    memset(data, 'x', sizeof(data));
+    before = free_blocks();
+
+    CHECK(fs_write_file("f", data, 7 * 512) == 0);
+    CHECK(free_blocks() == before - 7);
+    CHECK(fs_write_file("f", data, 512) == 0);
+    CHECK(free_blocks() == before - 1);
+    CHECK(fs_delete_file("f") == 0);
+    CHECK(free_blocks() == before);
+}
+
+static void test_directories(void) {
+    char cwd[FS_PATH_MAX_LEN + 1];
+    uint8_t back[16];
+    uint32_t got = 0;
+    uint32_t gen;
+
+    fresh_fs();
+    CHECK(fs_mkdir("a") == 0);
+    CHECK(fs_mkdir("a") != 0);
+    CHECK(fs_mkdir("/a/b") == 0);
+    CHECK(fs_mkdir("a/b/c") == 0);
+    CHECK(fs_mkdir("missing/x") != 0);
+    CHECK(dir_contains("/", "a", FS_NODE_DIR));
+    CHECK(dir_contains("a/b", "c", FS_NODE_DIR));
+
+    CHECK(fs_write_file("a/b/c/note", (const uint8_t *)"hello", 5) == 0);
+    CHECK(fs_set_cwd("a/b") == 0);
+    CHECK(fs_get_cwd(cwd, sizeof(cwd)) == 0 && strcmp(cwd, "/a/b") == 0);
+    CHECK(fs_read_file("c/note", back, sizeof(back), &got) == 0 && got == 5);
+    CHECK(fs_read_file("../b/./c/note", back, sizeof(back), &got) == 0);
+    CHECK(fs_read_file("/a/b/c/note", back, sizeof(back), &got) == 0);
+    CHECK(memcmp(back, "hello", 5) == 0);
+
+    CHECK(fs_set_cwd("..") == 0);
+    CHECK(fs_get_cwd(cwd, sizeof(cwd)) == 0 && strcmp(cwd, "/a") == 0);
+    CHECK(fs_set_cwd("b/c/note") != 0);
+    CHECK(fs_set_cwd("/") == 0);
+
+    CHECK(fs_rmdir("a/b/c") != 0);
+    CHECK(fs_delete_file("a/b/c") != 0);
+    CHECK(fs_delete_file("a/b/c/note") == 0);
+    CHECK(fs_rmdir("a/b/c") == 0);
+    CHECK(!dir_contains("a/b", "c", FS_NODE_DIR));
+    CHECK(fs_rmdir("/") != 0);
+
+    /* Listings stay valid until a change or a cd */
+    gen = fs_generation();
+    CHECK(dir_contains("a", "b", FS_NODE_DIR) && fs_generation() == gen);
+    CHECK(fs_mkdir("a/d") == 0 && fs_generation() != gen);
+    gen = fs_generation();
+    CHECK(fs_set_cwd("a") == 0 && fs_generation() != gen);
+    CHECK(fs_set_cwd("/") == 0);
+}
+
+static void test_names(void) {
+    char long_name[FS_NAME_MAX_LEN + 2];
+
+    fresh_fs();
+    memset(long_name, 'n', sizeof(long_name) - 1);
+    long_name[sizeof(long_name) - 1] = '\0';
+
+    CHECK(fs_write_file("bad name", (const uint8_t *)"x", 1) != 0);
+    CHECK(fs_write_file(long_name, (const uint8_t *)"x", 1) != 0);
+    long_name[FS_NAME_MAX_LEN] = '\0';
+    CHECK(fs_write_file(long_name, (const uint8_t *)"x", 1) == 0);
+    CHECK(fs_mkdir("..") != 0);
+    CHECK(fs_mkdir(".") != 0);
+}
+
+static void test_inode_exhaustion(void) {
+    char name[16];
+    int created = 0;
+    fs_info_t info;
+
+    fresh_fs();
+    for (int i = 0; i < 200; i++) {
+        ksnprintf(name, sizeof(name), "f%d", i);
+        if (fs_write_file(name, (const uint8_t *)"", 0) != 0) {
+            break;
+        }
+        created++;
+    }
+
+    CHECK(fs_get_info(&info) == 0);
+    CHECK(created == (int)info.total_inodes - 1);
+    CHECK(info.used_inodes == info.total_inodes);
+    CHECK(fs_delete_file("f0") == 0);
+    CHECK(fs_mkdir("d") == 0);
+}
+
+static void test_remount(void) {
+    uint8_t back[8];
+    uint32_t got = 0;
+
+    fresh_fs();
+    CHECK(fs_mkdir("keep") == 0);
+    CHECK(fs_write_file("keep/data", (const uint8_t *)"persist", 7) == 0);
+    CHECK(fs_init() == 0);
+    CHECK(fs_read_file("/keep/data", back, sizeof(back), &got) == 0);
+    CHECK(got == 7 && memcmp(back, "persist", 7) == 0);
+
+    host_ata_wipe();
+    CHECK(fs_init() != 0);
+    CHECK(!fs_is_ready());
+}
+
+const host_test_t host_fs_tests[] = {
+    { "fs_format",               test_format },
+    { "fs_write_read_sizes",     test_write_read_sizes },
+    { "fs_overwrite_frees",      test_overwrite_frees_blocks },
+    { "fs_directories",          test_directories },
+    { "fs_names",                test_names },
+    { "fs_inode_exhaustion",     test_inode_exhaustion },
+    { "fs_remount",              test_remount },
+    { 0, 0 },
+};
@@ -0,0 +1,56 @@
+/*
+ * MelonOS - Host Test Harness
+ * Shared declarations for the Linux-native fs/lib test build
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spinlock.h"
+
+/* Disk shim: RAM-backed by default, or a scratch copy of a raw image
+   file (the image itself is left untouched) */
+int host_ata_use_image(const char *path);
+void host_ata_wipe(void);
+void host_ata_reset_counters(void);
+uint64_t host_ata_reads(void);
+uint64_t host_ata_writes(void);
+
+/* Monotonic nanoseconds from the host clock */
+uint64_t host_now_ns(void);
+
+/* Clock shim: clock_ns() returns what was last set, and timer_wake_at
+   only records the deadline asked for */
+void host_clock_set(uint64_t ns);
+uint64_t host_timer_last_wake(void);
+uint32_t host_timer_wake_requests(void);
+
+/* A spinlock declared with SPINLOCK_INIT_STATS in a LOCK_STATS=1 unit */
+spinlock_t *host_lock_stats_probe(void);
+
+/* One named test; CHECK records each condition it checks, and a
+   failing one is reported with its file and line */
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} host_test_t;
+
+void host_check(int ok, const char *expr, const char *file, int line);
+
+#define CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+
+/* Each area's tests, ended by an entry with no name; main.c runs them */
+extern const host_test_t host_fs_tests[];
+extern const host_test_t host_lib_tests[];
+extern const host_test_t host_timer_tests[];
+extern const host_test_t host_lock_tests[];
+extern const host_test_t host_task_tests[];
+
+/* Test runner and benchmarks; each returns a process exit status */
+int host_run_tests(void);
+int host_run_bench(int file_count, int depth, int rounds);
+
+#endif /* HOST_H */
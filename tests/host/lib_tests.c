@@ -0,0 +1,244 @@
+/*
+ * MelonOS - Host Library Tests
+ * String, formatting, container and 64-bit math code from lib/
+ */
+
+#include "arena.h"
+#include "history.h"
+#include "host.h"
+#include "kprintf.h"
+#include "math64.h"
+#include "scrollback.h"
+#include "string.h"
+#include "trie.h"
+
+/* ============ Library ============ */
+
+static void test_string(void) {
+    uint8_t buf[64];
+    uint16_t cells[9];
+
+    for (int i = 0; i < 64; i++) {
+        buf[i] = (uint8_t)i;
+    }
+    memmove(buf + 3, buf, 40);
+    CHECK(buf[3] == 0 && buf[42] == 39 && buf[2] == 2);
+    memmove(buf, buf + 5, 40);
+    CHECK(buf[0] == 2 && buf[39] == 44);
+
+    CHECK(memcmp("abcdefgh", "abcdefgh", 8) == 0);
+    CHECK(memcmp("abcdefgh", "abcdefgi", 8) < 0);
+    CHECK(memcmp("abcdzfgh", "abcdafgh", 8) > 0);
+    CHECK(strlen("") == 0 && strlen("melon") == 5);
+    CHECK(strlen("a somewhat longer string for the word loop") == 42);
+
+    memset16(cells, 0x0741, 9);
+    CHECK(cells[0] == 0x0741 && cells[8] == 0x0741);
+}
+
+static void test_kprintf(void) {
+    char out[64];
+
+    CHECK(ksnprintf(out, sizeof(out), "%d|%5u|%-4s|%03x", -12, 34u, "ab", 0xfu) == 18);
+    CHECK(strcmp(out, "-12|   34|ab  |00f") == 0);
+    ksnprintf(out, sizeof(out), "%llu %lld", 18446744073709551615ull, -9000000000ll);
+    CHECK(strcmp(out, "18446744073709551615 -9000000000") == 0);
+    CHECK(ksnprintf(out, 4, "melon") == 5 && strcmp(out, "mel") == 0);
+}
+
+static void test_arena(void) {
+    static uint8_t storage[256];
+    arena_t arena;
+    arena_mark_t mark;
+    void *a;
+    void *b;
+
+    arena_init(&arena, storage, sizeof(storage));
+    a = arena_alloc(&arena, 3);
+    b = arena_alloc(&arena, 8);
+    CHECK(a != 0 && b != 0);
+    CHECK(((uintptr_t)b & (ARENA_ALIGN - 1)) == 0);
+    CHECK((uint8_t *)b - (uint8_t *)a == ARENA_ALIGN);
+
+    mark = arena_mark(&arena);
+    CHECK(arena_alloc(&arena, 100) != 0);
+    arena_release(&arena, mark);
+    CHECK(arena_mark(&arena) == mark);
+
+    CHECK(arena_alloc(&arena, 4096) == 0);
+    arena_reset(&arena);
+    CHECK(arena_remaining(&arena) == arena.size);
+}
+
+static void fill_line(uint16_t *cells, const char *text, uint8_t attr) {
+    size_t len = strlen(text);
+
+    for (int x = 0; x < VGA_WIDTH; x++) {
+        cells[x] = (uint16_t)(((size_t)x < len ? text[x] : ' ') | attr << 8);
+    }
+}
+
+static scrollback_t sb;
+
+static void test_scrollback(void) {
+    uint16_t in[VGA_WIDTH];
+    uint16_t out[VGA_WIDTH];
+    char text[16];
+
+    scrollback_reset(&sb, 0);
+    fill_line(in, "melon $ ls", 0x0A);
+    scrollback_append(&sb, in, VGA_WIDTH);
+    CHECK(scrollback_bytes_used(&sb) == 3 + 10);
+    CHECK(scrollback_read(&sb, 0, out, VGA_WIDTH) == 0 && memcmp(in, out, sizeof(in)) == 0);
+
+    /* Mixed colours and a line with no trailing blanks */
+    fill_line(in, "  [ OK ] disk", 0x07);
+    in[4] = (uint16_t)('O' | 0x0A << 8);
+    in[5] = (uint16_t)('K' | 0x0A << 8);
+    scrollback_append(&sb, in, VGA_WIDTH);
+    CHECK(scrollback_read(&sb, 1, out, VGA_WIDTH) == 0 && memcmp(in, out, sizeof(in)) == 0);
+    for (int x = 0; x < VGA_WIDTH; x++) {
+        in[x] = (uint16_t)(('a' + x % 26) | (x & 1 ? 0x1F : 0x4E) << 8);
+    }
+    scrollback_append(&sb, in, VGA_WIDTH);
+    CHECK(scrollback_read(&sb, 2, out, VGA_WIDTH) == 0 && memcmp(in, out, sizeof(in)) == 0);
+    CHECK(scrollback_read(&sb, 3, out, VGA_WIDTH) != 0);
+
+    /* Short lines are capped by line count, then found through checkpoints */
+    scrollback_reset(&sb, 0);
+    for (int i = 0; i < SCROLLBACK_MAX_LINES + 500; i++) {
+        ksnprintf(text, sizeof(text), "line %d", i);
+        fill_line(in, text, 0x07);
+        scrollback_append(&sb, in, VGA_WIDTH);
+    }
+    CHECK(scrollback_first(&sb) == 500 && scrollback_end(&sb) == SCROLLBACK_MAX_LINES + 500);
+    CHECK(scrollback_read(&sb, 777, out, VGA_WIDTH) == 0 && (char)out[5] == '7' && (char)out[8] == ' ');
+    CHECK(scrollback_find(&sb, "line 777", 8, 7770) == 777);
+    CHECK(scrollback_find(&sb, "line 9", 6, 9000) == 999);
+    CHECK(scrollback_find(&sb, "line 12", 7, scrollback_end(&sb)) == 1299);
+    CHECK(scrollback_find(&sb, "line 499", 8, 4990) == -1);
+
+    /* Long multi-colour lines are capped by bytes instead */
+    for (int x = 0; x < VGA_WIDTH; x++) {
+        in[x] = (uint16_t)(('a' + x % 26) | (x & 1 ? 0x1F : 0x4E) << 8);
+    }
+    for (int i = 0; i < 4000; i++) {
+        scrollback_append(&sb, in, VGA_WIDTH);
+    }
+    CHECK(scrollback_bytes_used(&sb) <= SCROLLBACK_STORE_BYTES);
+    CHECK(scrollback_end(&sb) - scrollback_first(&sb) < SCROLLBACK_MAX_LINES);
+}
+
+static history_t hist;
+
+static void test_history(void) {
+    char text[HISTORY_CAPACITY * 12];
+    size_t size;
+
+    history_reset(&hist);
+    history_append(&hist, "");
+    CHECK(history_count(&hist) == 0);
+
+    /* Past capacity the oldest entries are overwritten in place */
+    for (int i = 0; i < HISTORY_CAPACITY + 10; i++) {
+        ksnprintf(text, sizeof(text), "cmd %d", i);
+        history_append(&hist, text);
+    }
+    CHECK(history_count(&hist) == HISTORY_CAPACITY);
+    CHECK(strcmp(history_entry(&hist, 0), "cmd 10") == 0);
+    CHECK(strcmp(history_entry(&hist, HISTORY_CAPACITY - 1), "cmd 265") == 0);
+    CHECK(history_entry(&hist, HISTORY_CAPACITY) == 0);
+
+    CHECK(history_find(&hist, "cmd 2", 5, HISTORY_CAPACITY) == HISTORY_CAPACITY - 1);
+    CHECK(history_find(&hist, "cmd 2", 5, 245) == 244);
+    CHECK(history_find(&hist, "cmd 9", 5, 1000) == 89);
+    CHECK(history_find(&hist, "cmd 5", 5, 40) == -1);
+    CHECK(history_find(&hist, "nope", 4, 1000) == -1);
+
+    /* Saving keeps the newest lines that fit; loading appends them */
+    size = history_save(&hist, text, 20);
+    CHECK(size == 16 && memcmp(text, "cmd 264\ncmd 265\n", 16) == 0);
+    size = history_save(&hist, text, sizeof(text));
+    history_reset(&hist);
+    history_load(&hist, text, size);
+    CHECK(history_count(&hist) == HISTORY_CAPACITY);
+    CHECK(strcmp(history_entry(&hist, 0), "cmd 10") == 0);
+    CHECK(strcmp(history_entry(&hist, HISTORY_CAPACITY - 1), "cmd 265") == 0);
+}
+
+static void collect_word(const char *word, uint16_t value, void *ctx) {
+    char *out = (char *)ctx;
+
+    (void)value;
+    strcat(out, word);
+    strcat(out, " ");
+}
+
+static void test_trie(void) {
+    trie_node_t nodes[32];
+    trie_t trie;
+    char extra[TRIE_MAX_WORD];
+    char words[64];
+
+    trie_init(&trie, nodes, 32);
+    CHECK(trie_insert(&trie, "mkdir", 1) == 0);
+    CHECK(trie_insert(&trie, "mkfs", 2) == 0);
+    CHECK(trie_insert(&trie, "ls", 3) == 0);
+    CHECK(trie_insert(&trie, "lsblk", 4) == 0);
+    CHECK(trie_insert(&trie, "ls", 5) != 0);
+    CHECK(trie_insert(&trie, "", 6) != 0);
+
+    CHECK(trie_lookup(&trie, "mkfs") == 2 && trie_lookup(&trie, "lsblk") == 4);
+    CHECK(trie_lookup(&trie, "mk") == 0 && trie_lookup(&trie, "mkfsx") == 0);
+
+    CHECK(trie_complete(&trie, "m", extra, sizeof(extra)) == 2 && strcmp(extra, "k") == 0);
+    CHECK(trie_complete(&trie, "mkd", extra, sizeof(extra)) == 1 && strcmp(extra, "ir") == 0);
+    CHECK(trie_complete(&trie, "l", extra, sizeof(extra)) == 2 && strcmp(extra, "s") == 0);
+    CHECK(trie_complete(&trie, "ls", extra, sizeof(extra)) == 2 && extra[0] == '\0');
+    CHECK(trie_complete(&trie, "", extra, sizeof(extra)) == 4);
+    CHECK(trie_complete(&trie, "x", extra, sizeof(extra)) == 0);
+
+    words[0] = '\0';
+    trie_visit(&trie, "", collect_word, words);
+    CHECK(strcmp(words, "ls lsblk mkdir mkfs ") == 0);
+
+    /* A word that does not fit leaves the trie untouched */
+    CHECK(trie_insert(&trie, "abcdefghijklmnopqrstuvwxyz", 7) != 0);
+    CHECK(trie_complete(&trie, "", extra, sizeof(extra)) == 4 && trie_lookup(&trie, "a") == 0);
+    trie_reset(&trie);
+    CHECK(trie_lookup(&trie, "ls") == 0);
+}
+
+
+static void test_math64(void) {
+    uint64_t big = 0x123456789ABCDEF0ull;
+    uint32_t rem = 0;
+
+    /* The high half is divided first; its remainder carries into the low */
+    CHECK(div64_u32(big, 7, &rem) == big / 7 && rem == big % 7);
+    CHECK(div64_u32(big, 0xFFFFFFFFu, &rem) == big / 0xFFFFFFFFu && rem == big % 0xFFFFFFFFu);
+    CHECK(div64_u32(~0ull, 0xFFFFFFFFu, &rem) == 0x100000001ull && rem == 0);
+    CHECK(div64_u32(~0ull, 2, &rem) == 0x7FFFFFFFFFFFFFFFull && rem == 1);
+    CHECK(div64_u32(big, 1, &rem) == big && rem == 0);
+    CHECK(div64_u32(5, 10, &rem) == 0 && rem == 5);
+    CHECK(div64_u32(0, 3, 0) == 0);
+    CHECK(div64_u32(1ull << 32, 1u << 31, 0) == 2);
+
+    /* Results past 2^32, and a 96-bit product that only fits after the shift */
+    CHECK(mul64_u32_shr(1ull << 40, 1000, 10) == 1000ull << 30);
+    CHECK(mul64_u32_shr(10000000000ull, 1u << 31, 32) == 5000000000ull);
+    CHECK(mul64_u32_shr(0xFFFFFFFFull, 0xFFFFFFFFu, 32) == 0xFFFFFFFEull);
+    CHECK(mul64_u32_shr(~0ull, 0x80000000u, 32) == 0x7FFFFFFFFFFFFFFFull);
+    CHECK(mul64_u32_shr(3ull << 40, 5, 0) == 15ull << 40);
+}
+
+const host_test_t host_lib_tests[] = {
+    { "lib_string",              test_string },
+    { "lib_kprintf",             test_kprintf },
+    { "lib_arena",               test_arena },
+    { "lib_scrollback",          test_scrollback },
+    { "lib_trie",                test_trie },
+    { "lib_history",             test_history },
+    { "math64",                  test_math64 },
+    { 0, 0 },
+};
@@ -0,0 +1,19 @@
+/*
+ * MelonOS - Host Lock Stats Probe
+ * A lock declared the way the kernel declares its own, as compiled by
+ * make LOCK_STATS=1; the tests themselves build with the default
+ */
+
+#undef LOCK_STATS
+#define LOCK_STATS 1
+
+#include "host.h"
+#include "spinlock.h"
+
+DEFINE_LOCK_STATS(probe_stats, "probe");
+
+static spinlock_t probe_lock = SPINLOCK_INIT_STATS(&probe_stats);
+
+spinlock_t *host_lock_stats_probe(void) {
+    return &probe_lock;
+}
@@ -0,0 +1,219 @@
+/*
+ * MelonOS - Host Lock Tests
+ * Spinlocks, reader-writer locks, seqlocks and lock statistics, with
+ * pthreads standing in for CPUs
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "spinlock.h"
+#include "string.h"
+
+/* ============ Locks ============ */
+
+/* Threads append their tag here in the order they got the lock */
+static char lock_log[16];
+static int lock_log_len = 0;
+
+static void log_taken(char tag) {
+    lock_log[__atomic_fetch_add(&lock_log_len, 1, __ATOMIC_SEQ_CST)] = tag;
+}
+
+static void reset_lock_log(void) {
+    memset(lock_log, 0, sizeof(lock_log));
+    lock_log_len = 0;
+}
+
+static void wait_until_u32(volatile uint32_t *value, uint32_t target) {
+    while (__atomic_load_n(value, __ATOMIC_ACQUIRE) != target) {
+        sched_yield();
+    }
+}
+
+static lock_stats_t spin_stats = LOCK_STATS_INIT("host spin");
+static spinlock_t spin = SPINLOCK_INIT;
+
+static void *ticket_waiter(void *arg) {
+    spin_lock(&spin);
+    log_taken(*(const char *)arg);
+    spin_unlock(&spin);
+    return 0;
+}
+
+static void test_spinlock(void) {
+    static const char tags[] = "abcd";
+    pthread_t threads[4];
+
+    spin_lock_init(&spin, &spin_stats);
+    CHECK(!spin_is_locked(&spin));
+    CHECK(spin_trylock(&spin));
+    CHECK(spin_is_locked(&spin));
+    CHECK(!spin_trylock(&spin));
+    spin_unlock(&spin);
+    CHECK(!spin_is_locked(&spin));
+
+    /* Waiters are served in the order they took their tickets */
+    reset_lock_log();
+    spin_lock(&spin);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], 0, ticket_waiter, (void *)&tags[i]);
+        wait_until_u32(&spin.next, spin.owner + 2 + (uint32_t)i);
+    }
+    CHECK(!spin_trylock(&spin));
+    spin_unlock(&spin);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], 0);
+    }
+    CHECK(strcmp(lock_log, "abcd") == 0);
+    CHECK(!spin_is_locked(&spin));
+
+    /* The trylock and the holder's take were free; every waiter spun.
+       Failed trylocks are not acquisitions. */
+    CHECK(spin_stats.acquired == 6 && spin_stats.contended == 4 && spin_stats.spins >= 4);
+}
+
+static rwlock_t rw = RWLOCK_INIT;
+
+static void *rw_writer(void *arg) {
+    (void)arg;
+    write_lock(&rw);
+    log_taken('W');
+    write_unlock(&rw);
+    return 0;
+}
+
+static void *rw_reader(void *arg) {
+    (void)arg;
+    read_lock(&rw);
+    log_taken('R');
+    read_unlock(&rw);
+    return 0;
+}
+
+static void test_rwlock(void) {
+    pthread_t writer;
+    pthread_t reader;
+
+    /* Readers share the lock */
+    read_lock(&rw);
+    read_lock(&rw);
+    CHECK(rw.state == 2);
+    read_unlock(&rw);
+
+    /* A writer waiting on a reader holds off readers that come later,
+       even though the lock is only read-held */
+    reset_lock_log();
+    pthread_create(&writer, 0, rw_writer, 0);
+    wait_until_u32(&rw.writers_waiting, 1);
+    pthread_create(&reader, 0, rw_reader, 0);
+    usleep(20000);
+    CHECK(lock_log_len == 0);
+
+    read_unlock(&rw);
+    pthread_join(writer, 0);
+    pthread_join(reader, 0);
+    CHECK(strcmp(lock_log, "WR") == 0);
+    CHECK(rw.state == 0 && rw.writers_waiting == 0);
+}
+
+static lock_stats_t seq_stats = LOCK_STATS_INIT("host seq");
+static seqlock_t seq;
+static uint32_t seq_pair[2];
+static volatile int seq_read_done = 0;
+
+static void *seq_reader(void *arg) {
+    uint32_t *copy = arg;
+    uint32_t start;
+
+    do {
+        start = read_seqbegin(&seq);
+        copy[0] = seq_pair[0];
+        copy[1] = seq_pair[1];
+    } while (read_seqretry(&seq, start));
+    seq_read_done = 1;
+    return 0;
+}
+
+static void test_seqlock(void) {
+    uint32_t copy[2] = { 0, 0 };
+    pthread_t reader;
+    uint32_t start;
+
+    seqlock_init(&seq, &seq_stats);
+
+    /* A read that overlaps a write must start over */
+    start = read_seqbegin(&seq);
+    write_seqlock(&seq);
+    CHECK((seq.sequence & 1) != 0);
+    CHECK(read_seqretry(&seq, start));
+    seq_pair[0] = 1;
+    seq_pair[1] = 1;
+    write_sequnlock(&seq);
+    CHECK(read_seqretry(&seq, start));
+    CHECK(seq_stats.retries == 2);
+
+    start = read_seqbegin(&seq);
+    CHECK(start == 2 && !read_seqretry(&seq, start));
+
+    /* A read begun mid-write waits for the writer and sees its result */
+    write_seqlock(&seq);
+    seq_pair[0] = 2;
+    pthread_create(&reader, 0, seq_reader, copy);
+    usleep(20000);
+    CHECK(!seq_read_done);
+    seq_pair[1] = 2;
+    write_sequnlock(&seq);
+    pthread_join(reader, 0);
+    CHECK(seq_read_done && copy[0] == 2 && copy[1] == 2);
+}
+
+static lock_stats_t default_stats = LOCK_STATS_INIT("host default");
+static spinlock_t default_lock = SPINLOCK_INIT_STATS(&default_stats);
+
+static int stats_listed(const lock_stats_t *stats) {
+    for (lock_stats_t *s = lock_stats_first(); s; s = s->next) {
+        if (s == stats) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void test_lock_stats(void) {
+    spinlock_t *probe = host_lock_stats_probe();
+
+    /* These tests build without LOCK_STATS, so a lock declared like the
+       kernel's own carries no counters */
+    spin_lock(&default_lock);
+    spin_unlock(&default_lock);
+#if LOCK_STATS
+    CHECK(default_lock.stats == &default_stats && default_stats.acquired == 1);
+#else
+    CHECK(default_lock.stats == 0 && default_stats.acquired == 0);
+    CHECK(!stats_listed(&default_stats));
+#endif
+
+    /* The same declaration in a LOCK_STATS=1 unit counts, and the
+       counters are listed once the lock has been taken */
+    CHECK(probe->stats != 0 && !stats_listed(probe->stats));
+    spin_lock(probe);
+    spin_unlock(probe);
+    CHECK(spin_trylock(probe));
+    spin_unlock(probe);
+    CHECK(probe->stats->acquired == 2 && probe->stats->contended == 0);
+    CHECK(stats_listed(probe->stats) && strcmp(probe->stats->name, "probe") == 0);
+
+    /* Counters passed in directly count in either build */
+    CHECK(stats_listed(&spin_stats) && stats_listed(&seq_stats));
+}
+
+const host_test_t host_lock_tests[] = {
+    { "lock_spinlock",           test_spinlock },
+    { "lock_rwlock",             test_rwlock },
+    { "lock_seqlock",            test_seqlock },
+    { "lock_stats",              test_lock_stats },
+    { 0, 0 },
+};
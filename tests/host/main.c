@@ -0,0 +1,102 @@
+/*
+ * MelonOS - Host Test Harness
+ * Entry point, check counting and test registry for the Linux-native
+ * tests and benchmarks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "host.h"
+#include "string.h"
+
+uint64_t host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static const host_test_t *const suites[] = {
+    host_fs_tests,
+    host_lib_tests,
+    host_timer_tests,
+    host_lock_tests,
+    host_task_tests,
+};
+
+static int failures = 0;
+static int checks = 0;
+
+void host_check(int ok, const char *expr, const char *file, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        printf("    FAIL %s:%d: %s\n", file, line, expr);
+    }
+}
+
+int host_run_tests(void) {
+    int failed_tests = 0;
+
+    for (size_t s = 0; s < sizeof(suites) / sizeof(suites[0]); s++) {
+        for (const host_test_t *test = suites[s]; test->name != 0; test++) {
+            int before = failures;
+            test->run();
+            printf("  %-24s %s\n", test->name, failures == before ? "ok" : "FAILED");
+            if (failures != before) {
+                failed_tests++;
+            }
+        }
+    }
+
+    printf("%d checks, %d failed tests\n", checks, failed_tests);
+    return failed_tests == 0 ? 0 : 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [--image PATH] test\n"
+            "       %s [--image PATH] bench [-n FILES] [-d DEPTH] [-r ROUNDS]\n"
+            "Both reformat the disk; with --image they run on a scratch copy of PATH.\n",
+            argv0, argv0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode = 0;
+    int file_count = 64;
+    int depth = 8;
+    int rounds = 50;
+
+    string_init();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            if (host_ata_use_image(argv[++i]) != 0) {
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            file_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (mode == 0) {
+            mode = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (mode != 0 && strcmp(mode, "test") == 0) {
+        return host_run_tests();
+    }
+
+    if (mode != 0 && strcmp(mode, "bench") == 0) {
+        return host_run_bench(file_count, depth, rounds);
+    }
+
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,48 @@
+/*
+ * MelonOS - Host Scheduler Shim
+ * Mutexes for the single-threaded host build; taking one that is
+ * already held would deadlock the kernel, so it aborts here. There are
+ * no kernel threads to create, wake or put to sleep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sched.h"
+
+void mutex_lock(mutex_t *mutex) {
+    if (mutex->locked) {
+        fprintf(stderr, "mutex_lock: mutex already held (recursive locking)\n");
+        abort();
+    }
+    mutex->locked = 1;
+}
+
+int mutex_trylock(mutex_t *mutex) {
+    if (mutex->locked) {
+        return 0;
+    }
+    mutex->locked = 1;
+    return 1;
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    mutex->locked = 0;
+}
+
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg, int priority, int cpu) {
+    (void)name;
+    (void)entry;
+    (void)arg;
+    (void)priority;
+    (void)cpu;
+    return 0;
+}
+
+void thread_wake(thread_t *thread) {
+    (void)thread;
+}
+
+void sched_sleep_until(uint64_t deadline_ns) {
+    (void)deadline_ns;
+}
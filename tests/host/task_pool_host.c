@@ -0,0 +1,49 @@
+/*
+ * MelonOS - Host Task Pool Shim
+ * Runs tasks and parallel_for slices inline for the host build, through
+ * the kernel's own queueing and slicing (lib/task_deque.c)
+ */
+
+#include "task_pool.h"
+#include "task_deque.h"
+
+static uint32_t executed = 0;
+
+int task_pool_init(void) {
+    return 0;
+}
+
+int task_pool_workers(void) {
+    return 0;
+}
+
+void task_spawn(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg) {
+    /* No deque: there are no workers to take it, so it runs here */
+    task_queue(0, group, task, fn, arg);
+    executed++;
+}
+
+void task_wait(task_group_t *group) {
+    (void)group;
+}
+
+/* The slices the kernel would queue, one after another, so bodies see
+   the partial ranges they get from the kernel's pool */
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, parallel_body_t body, void *arg) {
+    uint32_t bounds[PARALLEL_MAX_CHUNKS + 1];
+    uint32_t count = body != 0 ? parallel_slices(begin, end, grain, PARALLEL_MAX_CHUNKS, bounds) : 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        body(bounds[i], bounds[i + 1], arg);
+        executed++;
+    }
+}
+
+uint32_t task_pool_executed(int cpu) {
+    return cpu == 0 ? executed : 0;
+}
+
+uint32_t task_pool_stolen(int cpu) {
+    (void)cpu;
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * MelonOS - Host Task Pool Tests
+ * The work-stealing deque and parallel_for slicing, with a pthread
+ * as the thief
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "host.h"
+#include "string.h"
+#include "task_deque.h"
+
+/* ============ Task pool ============ */
+
+static task_deque_t deque;
+static task_t deque_tasks[TASK_DEQUE_SIZE + 1];
+static uint32_t task_runs = 0;
+
+static void count_run(void *arg) {
+    (void)arg;
+    task_runs++;
+}
+
+static void test_task_deque(void) {
+    task_group_t group = TASK_GROUP_INIT;
+    int ok = 1;
+
+    /* The owner takes its newest task, thieves the oldest */
+    for (int i = 0; i < 4; i++) {
+        CHECK(task_deque_push(&deque, &deque_tasks[i]) == 0);
+    }
+    CHECK(task_deque_pop(&deque) == &deque_tasks[3]);
+    CHECK(task_deque_steal(&deque) == &deque_tasks[0]);
+    CHECK(task_deque_pop(&deque) == &deque_tasks[2]);
+    CHECK(task_deque_steal(&deque) == &deque_tasks[1]);
+    CHECK(task_deque_pop(&deque) == 0 && task_deque_steal(&deque) == 0);
+
+    /* A last task stolen first is gone for the owner, and the other way
+       round */
+    CHECK(task_deque_push(&deque, &deque_tasks[0]) == 0);
+    CHECK(task_deque_steal(&deque) == &deque_tasks[0]);
+    CHECK(task_deque_pop(&deque) == 0);
+    CHECK(task_deque_push(&deque, &deque_tasks[1]) == 0);
+    CHECK(task_deque_pop(&deque) == &deque_tasks[1]);
+    CHECK(task_deque_steal(&deque) == 0);
+    CHECK(deque.top == deque.bottom);
+
+    /* A full deque refuses the push, and task_queue runs the task inline */
+    for (int i = 0; i < TASK_DEQUE_SIZE; i++) {
+        ok &= task_queue(&deque, &group, &deque_tasks[i], count_run, 0) == 0;
+    }
+    CHECK(ok && task_runs == 0 && group.pending == TASK_DEQUE_SIZE);
+    CHECK(task_deque_push(&deque, &deque_tasks[TASK_DEQUE_SIZE]) != 0);
+    CHECK(task_queue(&deque, &group, &deque_tasks[TASK_DEQUE_SIZE], count_run, 0) != 0);
+    CHECK(task_runs == 1 && deque.executed == 1 && group.pending == TASK_DEQUE_SIZE);
+
+    /* Draining it runs each queued task once, newest first */
+    ok = 1;
+    for (int i = TASK_DEQUE_SIZE - 1; i >= 0; i--) {
+        task_t *task = task_deque_pop(&deque);
+
+        ok &= task == &deque_tasks[i];
+        if (task != 0) {
+            task_run(&deque, task);
+        }
+    }
+    CHECK(ok && task_deque_pop(&deque) == 0);
+    CHECK(task_runs == TASK_DEQUE_SIZE + 1 && deque.executed == TASK_DEQUE_SIZE + 1);
+    CHECK(group.pending == 0);
+
+    /* Without a deque the task runs at once and counts nowhere */
+    CHECK(task_queue(0, &group, &deque_tasks[0], count_run, 0) != 0);
+    CHECK(task_runs == TASK_DEQUE_SIZE + 2 && group.pending == 0);
+}
+
+#define RACE_TASKS 65536
+
+static task_deque_t race_deque;
+static task_t race_tasks[RACE_TASKS];
+static volatile uint32_t race_taken[RACE_TASKS];
+static volatile int race_done = 0;
+
+static void *race_thief(void *arg) {
+    uint32_t *stolen = arg;
+
+    while (!__atomic_load_n(&race_done, __ATOMIC_ACQUIRE)) {
+        task_t *task = task_deque_steal(&race_deque);
+
+        if (task != 0) {
+            __atomic_add_fetch(&race_taken[task - race_tasks], 1, __ATOMIC_RELAXED);
+            (*stolen)++;
+        }
+    }
+    return 0;
+}
+
+static void test_task_deque_race(void) {
+    uint32_t stolen = 0;
+    uint32_t popped = 0;
+    pthread_t thief;
+    int once = 1;
+    int i = 0;
+
+    /* The owner pushes one task at a time (now and then three) and pops
+       them back while a thief steals: the last task goes to exactly one
+       of them, never both or neither */
+    pthread_create(&thief, 0, race_thief, &stolen);
+    while (i < RACE_TASKS) {
+        int batch = (i % 4 == 0 && RACE_TASKS - i >= 3) ? 3 : 1;
+        task_t *task;
+
+        for (int j = 0; j < batch; j++) {
+            task_deque_push(&race_deque, &race_tasks[i++]);
+        }
+        if (i % 64 == 0) {
+            sched_yield();
+        }
+        while ((task = task_deque_pop(&race_deque)) != 0) {
+            __atomic_add_fetch(&race_taken[task - race_tasks], 1, __ATOMIC_RELAXED);
+            popped++;
+        }
+    }
+    __atomic_store_n(&race_done, 1, __ATOMIC_RELEASE);
+    pthread_join(thief, 0);
+
+    for (i = 0; i < RACE_TASKS; i++) {
+        once &= race_taken[i] == 1;
+    }
+    CHECK(once);
+    CHECK(popped + stolen == RACE_TASKS && stolen > 0);
+    CHECK(race_deque.top == race_deque.bottom);
+}
+
+#define SLICE_RANGE 1100
+
+static uint8_t slice_hits[SLICE_RANGE];
+
+static void mark_slice(uint32_t begin, uint32_t end, void *arg) {
+    uint32_t *calls = arg;
+
+    for (uint32_t i = begin; i < end; i++) {
+        slice_hits[i]++;
+    }
+    (*calls)++;
+}
+
+/* Every index of [begin, end) hit exactly once and nothing else */
+static int hit_once(uint32_t begin, uint32_t end) {
+    int ok = 1;
+
+    for (uint32_t i = 0; i < SLICE_RANGE; i++) {
+        ok &= slice_hits[i] == (i >= begin && i < end);
+    }
+    memset(slice_hits, 0, sizeof(slice_hits));
+    return ok;
+}
+
+static void test_parallel_slices(void) {
+    static const uint32_t sizes[] = { 1, 2, 7, 31, 33, 97, 100, 257, 1000, 1023 };
+    static const uint32_t grains[] = { 0, 1, 3, 7, 64 };
+    static const uint32_t maxima[] = { 1, 4, 5, 12, PARALLEL_MAX_CHUNKS };
+    uint32_t bounds[PARALLEL_MAX_CHUNKS + 1];
+    int covered = 1;
+    int shaped = 1;
+    uint32_t calls;
+
+    /* Sizes that do not divide evenly still come out covered exactly
+       once, in no more slices than allowed and of near-equal size */
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+            for (size_t m = 0; m < sizeof(maxima) / sizeof(maxima[0]); m++) {
+                uint32_t begin = 5 * (uint32_t)m;
+                uint32_t end = begin + sizes[s];
+                uint32_t grain = grains[g] ? grains[g] : 1;
+                uint32_t count = parallel_slices(begin, end, grains[g], maxima[m], bounds);
+
+                shaped &= count >= 1 && count <= maxima[m];
+                shaped &= count <= sizes[s] / grain + (sizes[s] % grain != 0);
+                shaped &= bounds[0] == begin && bounds[count] == end;
+                for (uint32_t i = 0; i < count; i++) {
+                    shaped &= bounds[i + 1] > bounds[i];
+                    shaped &= bounds[i + 1] - bounds[i] <= bounds[1] - bounds[0];
+                    if (i + 1 < count) {
+                        shaped &= bounds[i + 1] - bounds[i] == bounds[1] - bounds[0];
+                    }
+                    mark_slice(bounds[i], bounds[i + 1], &calls);
+                }
+                covered &= hit_once(begin, end);
+
+                calls = 0;
+                parallel_for(begin, end, grains[g], mark_slice, &calls);
+                covered &= hit_once(begin, end) && calls >= 1 && calls <= PARALLEL_MAX_CHUNKS;
+            }
+        }
+    }
+    CHECK(shaped);
+    CHECK(covered);
+
+    CHECK(parallel_slices(10, 10, 1, 4, bounds) == 0);
+    CHECK(parallel_slices(10, 5, 1, 4, bounds) == 0);
+    calls = 0;
+    parallel_for(10, 10, 1, mark_slice, &calls);
+    CHECK(calls == 0 && hit_once(0, 0));
+
+    /* 10 items in grains of 4 make three slices, and the cap merges them */
+    CHECK(parallel_slices(0, 10, 4, 8, bounds) == 3);
+    CHECK(bounds[1] == 4 && bounds[2] == 8 && bounds[3] == 10);
+    CHECK(parallel_slices(0, 10, 4, 2, bounds) == 2 && bounds[1] == 5);
+}
+
+const host_test_t host_task_tests[] = {
+    { "task_deque",              test_task_deque },
+    { "task_deque_race",         test_task_deque_race },
+    { "task_parallel_slices",    test_parallel_slices },
+    { 0, 0 },
+};
@@ -0,0 +1,186 @@
+/*
+ * MelonOS - Host Timer Tests
+ * TSC scaling, the deadline heap and the timer wheel on a fake clock
+ */
+
+#include "deadline_heap.h"
+#include "host.h"
+#include "math64.h"
+#include "string.h"
+#include "timer_wheel.h"
+
+/* ============ Timekeeping ============ */
+
+/* Whether got is within tolerance of want */
+static int near(uint64_t got, uint64_t want, uint64_t tolerance) {
+    return got > want ? got - want <= tolerance : want - got <= tolerance;
+}
+
+static void test_pick_scale(void) {
+    /* 1 MHz up to 10 GHz, as clock_init sees them in kHz */
+    static const uint32_t rates_khz[] = { 1000, 33000, 1193182, 2400000, 3999999, 10000000 };
+    const uint64_t year_s = 365ull * 24 * 3600;
+
+    for (size_t i = 0; i < sizeof(rates_khz) / sizeof(rates_khz[0]); i++) {
+        uint64_t hz = (uint64_t)rates_khz[i] * 1000;
+        uint32_t ns_mult;
+        uint32_t ns_shift;
+        uint32_t cycles_mult;
+        uint32_t cycles_shift;
+
+        pick_scale(1000000u, rates_khz[i], &ns_mult, &ns_shift);
+        pick_scale(rates_khz[i], 1000000u, &cycles_mult, &cycles_shift);
+
+        /* Full precision: the top multiplier bit is used unless the
+           shift is already at its limit */
+        CHECK(ns_shift <= 32 && (ns_shift == 32 || (ns_mult >> 31) != 0));
+        CHECK(cycles_shift <= 32 && (cycles_shift == 32 || (cycles_mult >> 31) != 0));
+
+        /* One second and one year, the latter past 2^32 ns and, at GHz
+           rates, past 2^56 cycles without overflowing. The multiplier is
+           rounded down, so the result may be short by result / mult. */
+        CHECK(near(mul64_u32_shr(hz, ns_mult, ns_shift), 1000000000ull,
+                   1000000000ull / ns_mult + 2));
+        CHECK(near(mul64_u32_shr(hz * year_s, ns_mult, ns_shift), 1000000000ull * year_s,
+                   1000000000ull * year_s / ns_mult + 2));
+        CHECK(near(mul64_u32_shr(1000000000ull, cycles_mult, cycles_shift), hz,
+                   hz / cycles_mult + 2));
+        CHECK(near(mul64_u32_shr(1000000000ull * year_s, cycles_mult, cycles_shift), hz * year_s,
+                   hz * year_s / cycles_mult + 2));
+    }
+}
+
+static deadline_heap_t heap;
+
+static void test_deadline_heap(void) {
+    static const uint64_t pushed[] = { 50, 10, 40, 10, 5000000000ull, 30, 20, 10, 60 };
+    static const uint64_t popped[] = { 10, 10, 10, 20, 30, 40, 50, 60, 5000000000ull };
+    int in_order = 1;
+
+    deadline_heap_reset(&heap);
+    for (size_t i = 0; i < sizeof(pushed) / sizeof(pushed[0]); i++) {
+        CHECK(deadline_heap_push(&heap, pushed[i]) == 0);
+    }
+    CHECK(deadline_heap_count(&heap) == 9);
+
+    /* Earliest first, with every duplicate kept */
+    for (size_t i = 0; i < sizeof(popped) / sizeof(popped[0]); i++) {
+        in_order &= deadline_heap_min(&heap) == popped[i];
+        deadline_heap_pop(&heap);
+    }
+    CHECK(in_order);
+    CHECK(deadline_heap_count(&heap) == 0);
+
+    /* Full at DEADLINE_HEAP_SIZE; a failed push leaves the heap intact */
+    in_order = 1;
+    for (int i = 0; i < DEADLINE_HEAP_SIZE; i++) {
+        in_order &= deadline_heap_push(&heap, (uint64_t)((i * 37) % DEADLINE_HEAP_SIZE) + 100) == 0;
+    }
+    CHECK(in_order);
+    CHECK(deadline_heap_push(&heap, 1) != 0);
+    CHECK(deadline_heap_count(&heap) == DEADLINE_HEAP_SIZE && deadline_heap_min(&heap) == 100);
+
+    in_order = 1;
+    for (int i = 0; i < DEADLINE_HEAP_SIZE; i++) {
+        in_order &= deadline_heap_min(&heap) == (uint64_t)i + 100;
+        deadline_heap_pop(&heap);
+    }
+    CHECK(in_order);
+
+    /* Popping makes room again */
+    CHECK(deadline_heap_push(&heap, 7) == 0 && deadline_heap_min(&heap) == 7);
+}
+
+/* Wheel ticks on the fake clock */
+#define WHEEL_TICK(t) ((uint64_t)(t) * TIMER_WHEEL_TICK_NS)
+
+static int wheel_fired[8];
+
+static void count_fire(void *arg) {
+    (*(int *)arg)++;
+}
+
+/* Move the fake clock to a tick (plus ns) and run what is due */
+static void wheel_run_at(uint64_t tick, uint64_t ns) {
+    host_clock_set(WHEEL_TICK(tick) + ns);
+    timer_run_expired();
+}
+
+static void test_timer_wheel(void) {
+    const uint64_t base = 1000;
+    int ids[TIMER_POOL_SIZE];
+    int all_added = 1;
+    int stale;
+    int id;
+
+    memset(wheel_fired, 0, sizeof(wheel_fired));
+    host_clock_set(WHEEL_TICK(base));
+
+    /* Rounded up to the next whole slot, never run early */
+    CHECK(timer_add(WHEEL_TICK(base + 1) + 1, count_fire, &wheel_fired[0]) >= 0);
+    CHECK(timer_add(WHEEL_TICK(base + 2), count_fire, &wheel_fired[1]) >= 0);
+    CHECK(host_timer_last_wake() == WHEEL_TICK(base + 2));
+    wheel_run_at(base + 1, TIMER_WHEEL_TICK_NS - 1);
+    CHECK(wheel_fired[0] == 0 && wheel_fired[1] == 0 && !timer_work_due());
+    host_clock_set(WHEEL_TICK(base + 2));
+    CHECK(timer_work_due());
+    timer_run_expired();
+    CHECK(wheel_fired[0] == 1 && wheel_fired[1] == 1);
+    CHECK(timer_pending_count() == 0 && !timer_work_due());
+
+    /* Past TIMER_WHEEL_SLOTS the slot comes round first and is passed
+       over until the last rotation */
+    CHECK(timer_add(WHEEL_TICK(base + 2 + TIMER_WHEEL_SLOTS + 44), count_fire, &wheel_fired[2]) >= 0);
+    wheel_run_at(base + 2 + 44, 0);
+    CHECK(wheel_fired[2] == 0);
+    wheel_run_at(base + 2 + TIMER_WHEEL_SLOTS + 43, 0);
+    CHECK(wheel_fired[2] == 0);
+    wheel_run_at(base + 2 + TIMER_WHEEL_SLOTS + 44, 0);
+    CHECK(wheel_fired[2] == 1);
+
+    /* Several turns at once, with the scan capped at one */
+    CHECK(timer_add(WHEEL_TICK(base + 1000), count_fire, &wheel_fired[3]) >= 0);
+    wheel_run_at(base + 1500, 0);
+    CHECK(wheel_fired[3] == 1 && timer_pending_count() == 0);
+
+    /* Already past, or exactly now: runs on the next pass */
+    CHECK(timer_add(WHEEL_TICK(base + 1400), count_fire, &wheel_fired[4]) >= 0);
+    CHECK(timer_add(0, count_fire, &wheel_fired[4]) >= 0);
+    CHECK(timer_add(WHEEL_TICK(base + 1500), count_fire, &wheel_fired[4]) >= 0);
+    CHECK(timer_work_due());
+    wheel_run_at(base + 1500, 0);
+    CHECK(wheel_fired[4] == 3);
+
+    /* A reused pool slot gets a new generation, so the old id is stale */
+    stale = timer_add(WHEEL_TICK(base + 1600), count_fire, &wheel_fired[5]);
+    CHECK(stale >= 0 && timer_cancel(stale) == 0);
+    id = timer_add(WHEEL_TICK(base + 1600), count_fire, &wheel_fired[5]);
+    CHECK(id >= 0 && (id & 0xFF) == (stale & 0xFF) && id != stale);
+    CHECK(timer_cancel(stale) != 0 && timer_pending_count() == 1);
+    CHECK(timer_cancel(id) == 0 && timer_cancel(id) != 0);
+    CHECK(timer_cancel(-1) != 0 && timer_cancel(TIMER_POOL_SIZE) != 0);
+
+    /* Once run, an id cannot be cancelled */
+    id = timer_add(WHEEL_TICK(base + 1601), count_fire, &wheel_fired[6]);
+    wheel_run_at(base + 1601, 0);
+    CHECK(wheel_fired[5] == 0 && wheel_fired[6] == 1 && timer_cancel(id) != 0);
+
+    /* The pool holds TIMER_POOL_SIZE timers */
+    for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+        ids[i] = timer_add(WHEEL_TICK(base + 1700 + (uint64_t)i * 7), count_fire, &wheel_fired[7]);
+        all_added &= ids[i] >= 0;
+    }
+    CHECK(all_added && timer_pending_count() == TIMER_POOL_SIZE);
+    CHECK(timer_add(WHEEL_TICK(base + 1700), count_fire, &wheel_fired[7]) < 0);
+    CHECK(timer_cancel(ids[10]) == 0);
+    CHECK(timer_add(WHEEL_TICK(base + 1700), count_fire, &wheel_fired[7]) >= 0);
+    wheel_run_at(base + 1700 + TIMER_POOL_SIZE * 7, 0);
+    CHECK(wheel_fired[7] == TIMER_POOL_SIZE && timer_pending_count() == 0);
+}
+
+const host_test_t host_timer_tests[] = {
+    { "clock_pick_scale",        test_pick_scale },
+    { "timer_deadline_heap",     test_deadline_heap },
+    { "timer_wheel",             test_timer_wheel },
+    { 0, 0 },
+};